@@ -0,0 +1,392 @@
+#include "archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+/*The members and symbols of an archive being created*/
+typedef struct archive_builder {
+	unsigned char    **objects;
+	size_t           *sizes;
+	archive_member_t *members;
+	archive_symbol_t *symbols;
+	int              nsymbols;
+	int              symbols_capacity;
+	char             *names;
+	size_t           names_size;
+	size_t           names_capacity;
+} archive_builder_t;
+
+/*This method forms the hash value of a symbol name, same as calc_hash()*/
+unsigned archive_hash(const char *name)
+{
+	unsigned hashval;
+
+	for (hashval = 0; *name != '\0'; name++) {
+		hashval = *name + 31 * hashval;
+	}
+	return hashval;
+}
+
+/*This method adds a name to the names of an archive being created
+ * returns the offset of the name or -1 in case of failure*/
+long archive_add_name(archive_builder_t *b, const char *name)
+{
+	size_t len, offset;
+	char *names;
+
+	len = strlen(name) + 1;
+	if (b->names_size + len > b->names_capacity) {
+		b->names_capacity = 2 * (b->names_size + len);
+		names = realloc(b->names, b->names_capacity);
+		if (names == NULL) {
+			fprintf(stderr, "Failed to allocate archive\n");
+			return -1;
+		}
+		b->names = names;
+	}
+
+	offset = b->names_size;
+	memcpy(b->names + offset, name, len);
+	b->names_size += len;
+	return offset;
+}
+
+/*This method reads a module and adds it to an archive being created
+ * returns 0 in case of success and -1 otherwise*/
+int archive_add_member(archive_builder_t *b, int member, const char *module)
+{
+	static assembler_state_t state;
+	assembler_options_t options;
+	archive_symbol_t *symbols;
+	const char *base;
+	long name;
+	int i;
+
+	memset(&options, 0, sizeof(options));
+	options.relocatable = 1; /* The members are moved when they are linked */
+	memset(&state, 0, sizeof(state));
+	state.filename = module;
+	state.options = &options;
+	state.errfile = stderr;
+
+	switch (read_object(&state)) {
+	case -1:
+		return -1;
+	case 0:
+		fprintf(stderr, "Module %s cannot be moved, assemble it with --relocatable\n", module);
+		return -1;
+	}
+	if (object_build(&state, &b->objects[member], &b->sizes[member]) < 0) {
+		return -1;
+	}
+
+	base = strrchr(module, '/');
+	name = archive_add_name(b, (base == NULL) ? module : base + 1);
+	if (name < 0) {
+		return -1;
+	}
+	b->members[member].name = name;
+	b->members[member].size = b->sizes[member];
+	b->members[member].reserved = 0;
+
+	if (b->nsymbols + state.nentries > b->symbols_capacity) {
+		b->symbols_capacity = 2 * (b->nsymbols + state.nentries);
+		symbols = realloc(b->symbols, b->symbols_capacity * sizeof(*symbols));
+		if (symbols == NULL) {
+			fprintf(stderr, "Failed to allocate archive\n");
+			return -1;
+		}
+		b->symbols = symbols;
+	}
+	for (i = 0; i < state.nentries; i++) {
+		name = archive_add_name(b, state.entries[i].name);
+		if (name < 0) {
+			return -1;
+		}
+		b->symbols[b->nsymbols].name = name;
+		b->symbols[b->nsymbols].member = member;
+		b->nsymbols++;
+	}
+	return 0;
+}
+
+/*This method builds the index of the symbols of an archive being created
+ * returns 0 in case of success and -1 if a symbol is defined by two members*/
+int archive_build_index(archive_builder_t *b, uint32_t index[], uint32_t size)
+{
+	const char *name;
+	uint32_t i;
+	int s, other;
+	int error_flag;
+
+	error_flag = 0;
+	for (s = 0; s < b->nsymbols; s++) {
+		name = b->names + b->symbols[s].name;
+		for (i = archive_hash(name) & (size - 1); index[i] != 0; i = (i + 1) & (size - 1)) {
+			other = index[i] - 1;
+			if (strcmp(b->names + b->symbols[other].name, name) == 0) {
+				fprintf(stderr, "Entry %s of %s is already defined in %s\n", name,
+						b->names + b->members[b->symbols[s].member].name,
+						b->names + b->members[b->symbols[other].member].name);
+				error_flag = -1;
+				break;
+			}
+		}
+		if (index[i] == 0) {
+			index[i] = s + 1;
+		}
+	}
+	return error_flag;
+}
+
+/*This method writes the archive
+ * returns 0 in case of success and -1 otherwise*/
+int archive_write(archive_builder_t *b, const char *path, int n)
+{
+	static const char padding[8];
+	archive_header_t h;
+	uint32_t *index;
+	uint32_t index_size;
+	size_t offset;
+	int ret;
+	int i;
+	FILE *f;
+
+	for (index_size = 1; index_size < 2 * (uint32_t)b->nsymbols; index_size *= 2)
+		;
+	index = calloc(index_size, sizeof(*index));
+	if (index == NULL) {
+		fprintf(stderr, "Failed to allocate archive\n");
+		return -1;
+	}
+	if (archive_build_index(b, index, index_size) < 0) {
+		free(index);
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, ARCHIVE_MAGIC, sizeof(h.magic));
+	h.version = ARCHIVE_VERSION;
+	h.byte_order = OBJECT_BYTE_ORDER;
+	h.nmembers = n;
+	h.members = ALIGN8(sizeof(h));
+	h.nsymbols = b->nsymbols;
+	h.symbols = h.members + n * sizeof(archive_member_t);
+	h.index_size = index_size;
+	h.index = h.symbols + b->nsymbols * sizeof(archive_symbol_t);
+	h.names = h.index + index_size * sizeof(*index);
+	h.names_size = b->names_size;
+
+	offset = ALIGN8(h.names + h.names_size);
+	for (i = 0; i < n; i++) {
+		b->members[i].offset = offset;
+		offset = ALIGN8(offset + b->sizes[i]);
+	}
+	h.size = offset;
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open file %s for writing\n", path);
+		free(index);
+		return -1;
+	}
+
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(padding, 1, h.members - sizeof(h), f);
+	fwrite(b->members, sizeof(*b->members), n, f);
+	fwrite(b->symbols, sizeof(*b->symbols), b->nsymbols, f);
+	fwrite(index, sizeof(*index), index_size, f);
+	fwrite(b->names, 1, b->names_size, f);
+	offset = h.names + h.names_size;
+	for (i = 0; i < n; i++) {
+		fwrite(padding, 1, b->members[i].offset - offset, f);
+		fwrite(b->objects[i], 1, b->sizes[i], f);
+		offset = b->members[i].offset + b->sizes[i];
+	}
+	fwrite(padding, 1, h.size - offset, f);
+
+	ret = ferror(f) ? -1 : 0;
+	if (fclose(f) != 0 || ret < 0) {
+		fprintf(stderr, "Failed to write file %s\n", path);
+		ret = -1;
+	}
+	free(index);
+	return ret;
+}
+
+/*This method creates an archive of assembled modules, each read from its binary object or
+ * its text outputs
+ * returns 0 in case of success and -1 otherwise*/
+int archive_create(const char *path, const job_list_t *modules)
+{
+	archive_builder_t b;
+	int error_flag;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.objects = calloc(modules->n + 1, sizeof(*b.objects));
+	b.sizes = calloc(modules->n + 1, sizeof(*b.sizes));
+	b.members = calloc(modules->n + 1, sizeof(*b.members));
+	if (b.objects == NULL || b.sizes == NULL || b.members == NULL) {
+		fprintf(stderr, "Failed to allocate archive\n");
+		error_flag = -1;
+	} else {
+		error_flag = 0;
+		for (i = 0; i < modules->n; i++) {
+			if (archive_add_member(&b, i, modules->jobs[i].name) < 0) {
+				error_flag = -1;
+			}
+		}
+		if (error_flag == 0) {
+			error_flag = archive_write(&b, path, modules->n);
+		}
+	}
+
+	for (i = 0; b.objects != NULL && i < modules->n; i++) {
+		free(b.objects[i]);
+	}
+	free(b.objects);
+	free(b.sizes);
+	free(b.members);
+	free(b.symbols);
+	free(b.names);
+	return error_flag;
+}
+
+/*This method checks that the tables of a mapped archive are inside it
+ * returns 0 in case of success and -1 otherwise*/
+int archive_check(const archive_t *ar)
+{
+	const archive_header_t *h = ar->header;
+	uint32_t i;
+
+	if (h->members % 4 != 0 || h->members > ar->size ||
+		(ar->size - h->members) / sizeof(archive_member_t) < h->nmembers ||
+		h->symbols % 4 != 0 || h->symbols > ar->size ||
+		(ar->size - h->symbols) / sizeof(archive_symbol_t) < h->nsymbols ||
+		h->index % 4 != 0 || h->index > ar->size || h->index_size == 0 ||
+		(h->index_size & (h->index_size - 1)) != 0 ||
+		(ar->size - h->index) / sizeof(uint32_t) < h->index_size ||
+		h->names > ar->size || ar->size - h->names < h->names_size ||
+		(h->names_size > 0 && ar->names[h->names_size - 1] != '\0')) {
+		return -1;
+	}
+
+	for (i = 0; i < h->nmembers; i++) {
+		if (ar->members[i].name >= h->names_size || ar->members[i].offset % 8 != 0 ||
+			ar->members[i].offset > ar->size || ar->size - ar->members[i].offset < ar->members[i].size) {
+			return -1;
+		}
+	}
+	for (i = 0; i < h->nsymbols; i++) {
+		if (ar->symbols[i].name >= h->names_size || ar->symbols[i].member >= h->nmembers) {
+			return -1;
+		}
+	}
+	for (i = 0; i < h->index_size; i++) {
+		if (ar->index[i] > h->nsymbols) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*This method maps an archive to memory and checks it. Nothing is parsed or copied, the
+ * tables and the members are used right from the mapping
+ * returns 0 in case of success and -1 otherwise*/
+int archive_map(archive_t *ar, const char *path)
+{
+	const archive_header_t *h;
+	struct stat st;
+	int fd;
+
+	ar->path = path;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open file %s for reading\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*h)) {
+		fprintf(stderr, "%s is not an archive\n", path);
+		close(fd);
+		return -1;
+	}
+
+	ar->size = st.st_size;
+	ar->map = mmap(NULL, ar->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ar->map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map file %s\n", path);
+		return -1;
+	}
+
+	h = ar->header = ar->map;
+	ar->members = (const archive_member_t *)((const char *)ar->map + h->members);
+	ar->symbols = (const archive_symbol_t *)((const char *)ar->map + h->symbols);
+	ar->index = (const uint32_t *)((const char *)ar->map + h->index);
+	ar->names = (const char *)ar->map + h->names;
+
+	if (memcmp(h->magic, ARCHIVE_MAGIC, sizeof(h->magic)) != 0 || h->version != ARCHIVE_VERSION) {
+		fprintf(stderr, "%s is not an archive\n", path);
+	} else if (h->byte_order != OBJECT_BYTE_ORDER) {
+		fprintf(stderr, "Archive %s was written by a host of another byte order\n", path);
+	} else if (h->size != ar->size || archive_check(ar) < 0) {
+		fprintf(stderr, "Invalid archive %s\n", path);
+	} else {
+		return 0;
+	}
+
+	archive_unmap(ar);
+	return -1;
+}
+
+/*This method unmaps an archive mapped by archive_map()*/
+void archive_unmap(archive_t *ar)
+{
+	munmap(ar->map, ar->size);
+	ar->map = NULL;
+}
+
+/*This method finds the member that defines a symbol, with a single lookup in the index
+ * returns the member or -1 if no member defines it*/
+int archive_find(const archive_t *ar, const char *name)
+{
+	uint32_t mask, i;
+	const archive_symbol_t *s;
+
+	mask = ar->header->index_size - 1;
+	for (i = archive_hash(name) & mask; ar->index[i] != 0; i = (i + 1) & mask) {
+		s = &ar->symbols[ar->index[i] - 1];
+		if (strcmp(ar->names + s->name, name) == 0) {
+			return s->member;
+		}
+	}
+	return -1;
+}
+
+/*This method returns the name of a member - the base name of the module it was made of*/
+const char *archive_member_name(const archive_t *ar, int member)
+{
+	return ar->names + ar->members[member].name;
+}
+
+/*This method checks a member and points obj at it, inside the mapping of the archive.
+ * obj must not be unmapped
+ * returns 0 in case of success and -1 otherwise*/
+int archive_member(const archive_t *ar, int member, object_file_t *obj)
+{
+	char path[2 * MAX_PATH];
+
+	obj->map = (char *)ar->map + ar->members[member].offset;
+	obj->size = ar->members[member].size;
+
+	sprintf(path, "%.*s(%.*s)", MAX_PATH - 2, ar->path, MAX_PATH - 2, archive_member_name(ar, member));
+	return object_check(obj, path);
+}
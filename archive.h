@@ -0,0 +1,65 @@
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "object.h"
+#include "jobs.h"
+
+#define ARCHIVE_EXT     "oba"
+#define ARCHIVE_MAGIC   "AS1A"
+#define ARCHIVE_VERSION 1
+
+/*The header of an archive - many binary objects (members) with an index of the entries
+ * they define. Like an object it is in host byte order and used as it is once mapped.
+ * The member table, the symbol table, the index and the names follow the header, and
+ * the members come last, each at an 8 byte aligned offset*/
+typedef struct archive_header {
+	char     magic[4];
+	uint16_t version;
+	uint16_t byte_order; /* OBJECT_BYTE_ORDER */
+	uint32_t nmembers;
+	uint32_t members;    /* Offset of the member table */
+	uint32_t nsymbols;
+	uint32_t symbols;    /* Offset of the symbol table */
+	uint32_t index_size; /* A power of 2 */
+	uint32_t index;      /* Offset of the index - open addressing hash of the symbols,
+	                      * each slot holds a symbol number + 1, or 0 when empty */
+	uint32_t names;      /* Offset of the names, each ends with '\0' */
+	uint32_t names_size;
+	uint32_t size;       /* Of the whole archive */
+} archive_header_t;
+
+typedef struct archive_member {
+	uint32_t name;       /* Offset in the names */
+	uint32_t offset;     /* Of the binary object */
+	uint32_t size;
+	uint32_t reserved;
+} archive_member_t;
+
+/*An entry defined by a member*/
+typedef struct archive_symbol {
+	uint32_t name;       /* Offset in the names */
+	uint32_t member;
+} archive_symbol_t;
+
+/*An archive mapped to memory*/
+typedef struct archive {
+	const archive_header_t *header;
+	const archive_member_t *members;
+	const archive_symbol_t *symbols;
+	const uint32_t         *index;
+	const char             *names;
+	void                   *map;
+	size_t                 size;
+	const char             *path;
+} archive_t;
+
+unsigned archive_hash(const char *name);
+int archive_create(const char *path, const job_list_t *modules);
+int archive_map(archive_t *ar, const char *path);
+void archive_unmap(archive_t *ar);
+int archive_find(const archive_t *ar, const char *name);
+const char *archive_member_name(const archive_t *ar, int member);
+int archive_member(const archive_t *ar, int member, object_file_t *obj);
+
+#endif
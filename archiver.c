@@ -0,0 +1,143 @@
+#include "archive.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*This method lists the members of an archive and the entries each of them defines
+ * returns 0 in case of success and -1 otherwise*/
+int archive_list(const archive_t *ar)
+{
+	object_file_t obj;
+	char base32[3];
+	uint32_t i;
+	int j;
+
+	for (i = 0; i < ar->header->nmembers; i++) {
+		if (archive_member(ar, i, &obj) < 0) {
+			return -1;
+		}
+		printf("%s: %d code and %d data words\n", archive_member_name(ar, i),
+			   obj.header->code_size, obj.header->data_size);
+		for (j = 0; j < obj.header->nentries; j++) {
+			to_base32(obj.entries[j].address, base32);
+			printf("\t%s %s\n", obj.names + obj.entries[j].name, base32);
+		}
+	}
+	return 0;
+}
+
+/*This method writes a member of an archive to <member>.obb
+ * returns 0 in case of success and -1 otherwise*/
+int archive_extract(const archive_t *ar, int member)
+{
+	char path[MAX_PATH];
+	object_file_t obj;
+	int ret;
+	FILE *f;
+
+	if (archive_member(ar, member, &obj) < 0) {
+		return -1;
+	}
+	if (strlen(archive_member_name(ar, member)) + 5 > MAX_PATH) {
+		fprintf(stderr, "File name %s is too long\n", archive_member_name(ar, member));
+		return -1;
+	}
+
+	sprintf(path, "%s.%s", archive_member_name(ar, member), OBJECT_EXT);
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open file %s for writing\n", path);
+		return -1;
+	}
+	ret = (fwrite(obj.map, 1, obj.size, f) == obj.size) ? 0 : -1;
+	if (fclose(f) != 0 || ret < 0) {
+		fprintf(stderr, "Failed to write file %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*This method runs a command on a mapped archive - t lists it, x extracts the given
+ * members (all of them when none is given) and s finds the members of the given symbols
+ * returns 0 in case of success and -1 otherwise*/
+int archive_command(char command, const char *path, char *names[], int n)
+{
+	archive_t ar;
+	int error_flag;
+	int i, member;
+
+	if (archive_map(&ar, path) < 0) {
+		return -1;
+	}
+
+	error_flag = 0;
+	if (command == 't') {
+		error_flag = archive_list(&ar);
+	} else if (command == 'x' && n == 0) {
+		for (member = 0; member < (int)ar.header->nmembers; member++) {
+			if (archive_extract(&ar, member) < 0) {
+				error_flag = -1;
+			}
+		}
+	} else if (command == 'x') {
+		for (i = 0; i < n; i++) {
+			for (member = 0; member < (int)ar.header->nmembers &&
+					strcmp(archive_member_name(&ar, member), names[i]) != 0; member++)
+				;
+			if (member == (int)ar.header->nmembers) {
+				fprintf(stderr, "No member %s in %s\n", names[i], path);
+				error_flag = -1;
+			} else if (archive_extract(&ar, member) < 0) {
+				error_flag = -1;
+			}
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			member = archive_find(&ar, names[i]);
+			if (member < 0) {
+				printf("%s: not defined\n", names[i]);
+				error_flag = -1;
+			} else {
+				printf("%s: %s\n", names[i], archive_member_name(&ar, member));
+			}
+		}
+	}
+
+	archive_unmap(&ar);
+	return error_flag;
+}
+
+/*This method is the main of the archiver - creates an archive of assembled modules given
+ * in the command line (directly or listed in @manifest files), or reads one*/
+int main(int argc, char *argv[])
+{
+	job_list_t modules;
+	int error_flag;
+	int i;
+
+	if (argc < 3 || strlen(argv[1]) != 1 || strchr("ctxs", argv[1][0]) == NULL) {
+		fprintf(stderr, "Usage: %s c archive module...\n"
+						"       %s t archive\n"
+						"       %s x archive [member...]\n"
+						"       %s s archive symbol...\n", argv[0], argv[0], argv[0], argv[0]);
+		return 1;
+	}
+
+	if (argv[1][0] != 'c') {
+		return (archive_command(argv[1][0], argv[2], argv + 3, argc - 3) < 0) ? 1 : 0;
+	}
+
+	jobs_init(&modules);
+	error_flag = 0;
+	for (i = 3; i < argc; i++) {
+		if (jobs_add_argument(&modules, argv[i]) < 0) {
+			error_flag = 1;
+		}
+	}
+	if (!error_flag && archive_create(argv[2], &modules) < 0) {
+		error_flag = 1;
+	}
+	jobs_free(&modules);
+	return error_flag;
+}
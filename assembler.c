@@ -1,17 +1,41 @@
 #include "assembler.h"
 #include "symtable.h"
-
+#include "jobs.h"
+#include "watch.h"
+#include "incr.h"
+#include "object.h"
+#include "map.h"
+
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 /*This method initialize the state of the assembler
  * returns 0 in case of success and -1 otherwise*/
-int init_state(assembler_state_t *state, const char *filename)
+int init_state(assembler_state_t *state, const char *filename, const assembler_options_t *options)
 {
 	state->IC = 0;
 	state->DC = 0;
+	state->ninstructions = 0;
+	state->words_saved = 0;
+	state->ndata_blocks = 0;
+	state->data_words_saved = 0;
+	state->line_number = 0;
 	symtab_init(&state->symbols);
+	macro_init(&state->macros);
+	state->macro = NULL;
+	state->macro_use_line = 0;
+	state->nstruct_types = 0;
+	state->line_struct_type = -1;
+	state->nstruct_fields = 0;
+	state->field_scope = FIELDS_NONE;
 	state->filename = filename;
+	state->includer = NULL;
+	state->includes = NULL;
+	state->options = options;
+	state->errfile = stderr;
+	state->io = NULL;
 	return 0;
 }
 
@@ -19,168 +43,497 @@ int init_state(assembler_state_t *state, const char *filename)
 void cleanup_state(assembler_state_t *state)
 {
 	symtab_free(&state->symbols);
+	macro_free(&state->macros);
+	include_deps_free(state->includes);
+	state->includes = NULL;
 }
 
-/*This method does the first and only pass of transformation of the assembler file to 32 special base
+/*This method assembles a single source line - splits it to tokens, parses the operation
+ * and defines the label of the line if there is one
  * returns 0 in case of success and -1 otherwise */
-int generate_code_and_data(assembler_state_t *state)
+int assemble_line(assembler_state_t *state, char *line)
 {
 	char *label, *operation, *operands;
 	operation_info_t *opinfo;
-	char line[MAX_LINE_LENGTH];
-	FILE *asfile;
 	char *p;
 	int ret;
 	int ic, dc;
-	int error_flag;
+	int symbol;
 
-	/* open .as file */
-	asfile = open_file_with_ext(state->filename, "as", "r");
-	if (asfile == NULL) {
-		return -1;
+	/* The macro stage takes definitions and expands the uses of macros */
+	ret = macro_line(state, line);
+	if (ret != 0) {
+		return (ret < 0) ? ret : 0;
 	}
 
-	state-> line_number = 0;
+	/* Remove trailing '\n' and everything after ';' */
+	p = strpbrk(line, "\n;");
+	if (p != NULL) {
+		*p = '\0';
+	}
 
-	error_flag = 0;
+	ret = tokenize_line(line, &label, &operation, &operands, state);
+	if (ret < 0) {
+		return ret; /*Lexical analyzing did not went well*/
+	}
 
-	while (fgets(line, MAX_LINE_LENGTH, asfile) != NULL) {
+	if (operation == NULL) {
+		return 0;
+	}
 
-		state-> line_number++;
-		/* Remove trailing '\n' and everything after ';' */
-		p = strpbrk(line, "\n;");
-		if (p != NULL) {
-			*p = '\0';
-		}
+	opinfo = find_operation(operation);
+	if (opinfo == NULL) {
+		fprintf(state->errfile, "Missing operation '%s', in line '%d'\n", operation, state -> line_number );
+		return -1;
+	}
 
-		ret = tokenize_line(line, &label, &operation, &operands, state);
-		if (ret < 0) {
-			error_flag = ret; /*Lexical analyzing did not went well*/
-			continue;
-		}
+	ic = state->IC;
+	dc = state->DC;
+	ret = opinfo->parse(opinfo, state, operands);
+	if (ret < 0) {
+		return ret;
+	}
 
-		if (operation == NULL) {
-			continue;
+	symbol = -1;
+	if (label != NULL) { /*There is a label*/
+		symbol = symtab_new_label(&state->symbols, label, opinfo->symtype, ic, dc, state);
+		if (symbol < 0) {
+			return symbol;
 		}
+	}
 
-		opinfo = find_operation(operation);
-		if (opinfo == NULL) {
-			fprintf(stderr, "Missing operation '%s', in line '%d'\n", operation, state -> line_number );
-			error_flag = -1;
-			continue;
-		}
+	if (opinfo->symtype == SYMBOL_TYPE_DATA) {
+		record_data_block(state, dc, symbol, strcmp(opinfo->name, ".string") == 0,
+				          strcmp(opinfo->name, ".struct") == 0 ? state->line_struct_type : -1);
+	}
+
+	return 0;
+}
+
+/*This method assembles all the lines of a source held in memory, counting lines from
+ * state->line_number on, and encodes the instructions
+ * returns 0 in case of success and -1 otherwise */
+int generate_from_buffer(assembler_state_t *state, const char *buf, long len)
+{
+	char line[MAX_LINE_LENGTH];
+	long pos;
+	int ret;
+	int error_flag;
+
+	error_flag = 0;
+	pos = 0;
+
+	while (get_line(line, MAX_LINE_LENGTH, buf, len, &pos)) {
+		state-> line_number++;
 
-		ic = state->IC;
-		dc = state->DC;
-		ret = opinfo->parse(opinfo, state, operands);
+		ret = assemble_line(state, line);
 		if (ret < 0) {
 			error_flag = ret;
-			continue;
 		}
+	}
 
-		if (label != NULL) { /*There is a label*/
-			symtab_new_label(&state->symbols, label, opinfo->symtype, ic, dc);
-			if (ret < 0) {
-				error_flag = ret;
-				continue;
-			}
-		}
+	ret = macro_finish(state);
+	if (ret < 0) {
+		error_flag = ret;
+	}
+
+	/* Every label is defined, with its struct type */
+	ret = struct_resolve(state);
+	if (ret < 0) {
+		error_flag = ret;
+	}
+
+	/* The parse has found every error there is to find */
+	if (state->options->check) {
+		return error_flag;
+	}
+
+	if (state->options->optimize) {
+		optimize_instructions(state);
+	}
+
+	ret = encode_instructions(state);
+	if (ret < 0) {
+		error_flag = ret;
 	}
 
-	fclose(asfile);
 	return error_flag;
 }
 
-/*This method write the obj file of the assembler
+/*This method does the first and only pass of transformation of the assembler file to 32 special base
+ * buf holds the contents of the .as file
  * returns 0 in case of success and -1 otherwise */
-int write_object(assembler_state_t *state)
+int generate_code_and_data(assembler_state_t *state, const char *buf, long len)
 {
-	char addr_base32[3], word_base32[3];
-	int i, address, word;
-	FILE *obfile;
-
-	/* open .ob file */
-	obfile = open_file_with_ext(state->filename, "ob", "w");
-	if (obfile == NULL) {
-		return -1;
-	}
+	int ret;
 
-	address = ASSEMBLY_CODE_START_ADDRESS;
+	state-> line_number = 0;
 
-	for (i = 0; i < state->IC; i++) {
-		word = state->code[i];
-		to_base32(address, addr_base32);
-		to_base32(word, word_base32);
-		fprintf(obfile, "%s %s\n", addr_base32, word_base32);
-		address++;
+	/* A big source is split between the worker threads. The peephole pass needs to see
+	 * the whole instruction stream, and a macro or a constant may be used far from its
+	 * definition, so they keep the source in one piece */
+	if (state->options->jobs > 1 && len >= PARALLEL_MIN_FILE_SIZE && !state->options->optimize &&
+		!macro_in_buffer(buf, len) && !expr_in_buffer(buf, len)) {
+		ret = generate_code_and_data_parallel(state, buf, len);
+	} else {
+		ret = generate_from_buffer(state, buf, len);
 	}
 
-	for (i = 0; i < state->DC; i++) {
-		word = state->data[i];
-		to_base32(address, addr_base32);
-		to_base32(word, word_base32);
-		fprintf(obfile, "%s %s\n", addr_base32, word_base32);
-		address++;
+	if (state->IC > LENGTH_MEMORY || state->DC > LENGTH_MEMORY) {
+		fprintf(state->errfile, "Program is too large - %d code and %d data words\n", state->IC, state->DC);
+		return -1;
 	}
 
-	fclose(obfile);
+	/* Before the fix-up, which places the data after the code */
+	if (ret == 0 && state->options->compact_data && !state->options->check) {
+		compact_data(state);
+	}
 
-	return 0;
+	return ret;
 }
 
-/* Assemble the given <filename>.as to <filename>.obj, <filename>.ext, <filename>.ent.
+/* Assemble the given <filename>.as to <filename>.obj, <filename>.ext, <filename>.ent
+ * (or to <filename>.obb with --binary), <filename>.rel with --relocatable and the source
+ * map <filename>.map (<filename>.mpb with --binary) with --map, and the entries and
+ * externals <filename>.dep with --deps.
+ * With --check the source is only parsed and its symbols checked, nothing is written.
+ * source is the read request of the .as file, the outputs are queued to io. When includes
+ * is not NULL it is given the files the source included, even if it failed.
  * returns 0 in case of success and -1 otherwise */
-int assemble_one_file(const char *filename)
+int assemble_one_file(const char *filename, const assembler_options_t *options,
+		              io_ctx_t *io, io_request_t *source, include_dep_t **includes)
 {
 	assembler_state_t state;
 	int ret;
 
-	ret = init_state(&state, filename);
+	ret = io_wait(io, source);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = init_state(&state, filename, options);
 	if(ret < 0){
 		return ret;
 	}
+	state.io = io;
 
-	ret = generate_code_and_data(&state);
+	ret = generate_code_and_data(&state, source->buf, source->len);
+	if (includes != NULL) {
+		include_deps_free(*includes);
+		*includes = state.includes;
+		state.includes = NULL;
+	}
 	if(ret < 0) {
 		cleanup_state(&state);
 		return ret;
 	}
 
-	ret = symtab_update_relocations_and_write(&state.symbols, &state);
+	if (options->check) {
+		ret = symtab_check(&state.symbols, &state);
+		cleanup_state(&state);
+		return ret;
+	}
+
+	if (options->map) {
+		map_collect_labels(&state);
+	}
+
+	ret = symtab_update_relocations(&state.symbols, &state);
 	if(ret < 0) {
 		cleanup_state(&state);
 		return ret;
 	}
 
-	ret = write_object(&state);
+	if (options->binary) {
+		ret = write_binary_object(&state);
+	} else {
+		ret = write_text_object(&state);
+	}
+	if (ret == 0 && options->map) {
+		ret = options->binary ? write_binary_map(&state) : write_map(&state);
+	}
+	if (ret == 0 && options->deps) {
+		ret = write_dependencies(&state);
+	}
 	if(ret < 0) {
 		cleanup_state(&state);
 		return ret;
 	}
 
+	if (options->optimize) {
+		printf("%s: peephole pass saved %d word(s)\n", filename, state.words_saved);
+	}
+	if (options->compact_data) {
+		printf("%s: data compaction saved %d word(s)\n", filename, state.data_words_saved);
+	}
+
 	cleanup_state(&state);
 	return 0;
 }
 
+/*The files of a run, shared by all the workers*/
+typedef struct run_queue {
+	job_list_t                *jobs;
+	const assembler_options_t *options;
+	int                       next;   /* Next job to take */
+	int                       failed; /* Stop taking jobs, unless keep_going */
+	pthread_mutex_t           lock;
+} run_queue_t;
+
+/*This method takes the next job of the run
+ * returns the job or NULL when there are no more*/
+job_t *take_job(run_queue_t *q)
+{
+	job_t *job;
+
+	job = NULL;
+	pthread_mutex_lock(&q->lock);
+	if ((!q->failed || q->options->keep_going) && q->next < q->jobs->n) {
+		job = &q->jobs->jobs[q->next++];
+	}
+	pthread_mutex_unlock(&q->lock);
+	return job;
+}
+
+/*This method marks the run as failed, so no more jobs are taken unless keep_going*/
+void fail_run(run_queue_t *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->failed = 1;
+	pthread_mutex_unlock(&q->lock);
+}
+
+/*This method is the thread function of a worker - it keeps taking jobs and assembling
+ * them until there are none left or a file fails (unless keep_going). The next io_depth sources are read
+ * while a file is assembled, and the outputs are written in the background.
+ * failures are reported through q->failed*/
+void *assemble_worker(void *arg)
+{
+	run_queue_t *q = arg;
+	io_request_t *sources;
+	job_t **window;
+	io_ctx_t io;
+	int size, head, count, slot;
+	int ret;
+	job_t *job;
+
+	size = q->options->io_depth + 1;
+	sources = calloc(size, sizeof(*sources));
+	window = calloc(size, sizeof(*window));
+	if (sources == NULL || window == NULL) {
+		fprintf(stderr, "Failed to allocate file window\n");
+		free(sources);
+		free(window);
+		fail_run(q);
+		return NULL;
+	}
+
+	io_init(&io, 2 * size, q->options->use_uring);
+
+	ret = 0;
+	head = 0;
+	count = 0;
+	for (;;) {
+		/* Keep the window of sources being read full */
+		while (count < size && (job = take_job(q)) != NULL) {
+			slot = (head + count) % size;
+			window[slot] = job;
+			io_submit_read(&io, job->name, "as", &sources[slot]);
+			count++;
+		}
+		io_kick(&io);
+
+		if (count == 0) {
+			break;
+		}
+
+		ret = assemble_one_file(window[head]->outname, q->options, &io, &sources[head],
+				                q->options->watch ? &window[head]->includes : NULL);
+		io_release(&io, &sources[head]);
+		head = (head + 1) % size;
+		count--;
+
+		if (ret < 0) { /*assemble_one_file already gives specified error*/
+			fail_run(q);
+			if (!q->options->keep_going) {
+				break;
+			}
+		}
+	}
+
+	/* Drop the sources that were read ahead of a failure */
+	for (; count > 0; count--) {
+		io_release(&io, &sources[head]);
+		head = (head + 1) % size;
+	}
+
+	if (io_flush(&io) < 0) {
+		fail_run(q);
+	}
+
+	io_cleanup(&io);
+	free(sources);
+	free(window);
+	return NULL;
+}
+
+/* Assemble all the jobs, stopping at the first failure unless keep_going. With more than one job
+ * (-j) and more than one file, the files are assembled by a pool of worker threads,
+ * each of them assembling a whole file at a time.
+ * returns 0 in case of success and -1 otherwise */
+int assemble_files(job_list_t *jobs, const assembler_options_t *options)
+{
+	assembler_options_t worker_options;
+	pthread_t *threads;
+	run_queue_t q;
+	int n, i;
+
+	q.jobs = jobs;
+	q.options = options;
+	q.next = 0;
+	q.failed = 0;
+	pthread_mutex_init(&q.lock, NULL);
+
+	n = (options->jobs < jobs->n) ? options->jobs : jobs->n;
+	threads = (n > 1) ? calloc(n, sizeof(*threads)) : NULL;
+	if (threads == NULL) {
+		assemble_worker(&q);
+	} else {
+		/* The threads already split the work, every file is parsed serially */
+		worker_options = *options;
+		worker_options.jobs = 1;
+		q.options = &worker_options;
+
+		for (i = 0; i < n; i++) {
+			if (pthread_create(&threads[i], NULL, assemble_worker, &q) != 0) {
+				break;
+			}
+		}
+		n = i;
+
+		if (n == 0) {
+			assemble_worker(&q);
+		}
+		for (i = 0; i < n; i++) {
+			pthread_join(threads[i], NULL);
+		}
+		free(threads);
+	}
+
+	pthread_mutex_destroy(&q.lock);
+	return q.failed ? -1 : 0;
+}
+
+/*This method parses the command line options, which come before the file names
+ * returns the index of the first file name or -1 for invalid options*/
+int parse_options(int argc, char* argv[], assembler_options_t *options)
+{
+	const char *value;
+	int i;
+
+	options->jobs = 1;
+	options->io_depth = IO_DEFAULT_DEPTH;
+	options->use_uring = 1;
+	options->keep_going = 0;
+	options->watch = 0;
+	options->serve = 0;
+	options->optimize = 0;
+	options->compact_data = 0;
+	options->binary = 0;
+	options->relocatable = 0;
+	options->map = 0;
+	options->check = 0;
+	options->deps = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "--serve") == 0) {
+			options->serve = 1;
+		} else if (strcmp(argv[i], "--watch") == 0) {
+			options->watch = 1;
+			options->keep_going = 1;
+		} else if (strcmp(argv[i], "-O") == 0) {
+			options->optimize = 1;
+		} else if (strcmp(argv[i], "--compact-data") == 0) {
+			options->compact_data = 1;
+		} else if (strcmp(argv[i], "--binary") == 0) {
+			options->binary = 1;
+		} else if (strcmp(argv[i], "--relocatable") == 0) {
+			options->relocatable = 1;
+		} else if (strcmp(argv[i], "--map") == 0) {
+			options->map = 1;
+		} else if (strcmp(argv[i], "--check") == 0) {
+			options->check = 1;
+		} else if (strcmp(argv[i], "--deps") == 0) {
+			options->deps = 1;
+		} else if (strcmp(argv[i], "-k") == 0) {
+			options->keep_going = 1;
+		} else if (strcmp(argv[i], "--sync-io") == 0) {
+			options->use_uring = 0;
+		} else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+			options->io_depth = atoi(argv[++i]);
+			if (options->io_depth < 1) {
+				fprintf(stderr, "Invalid I/O depth '%s'\n", argv[i]);
+				return -1;
+			}
+		} else if (strncmp(argv[i], "-j", 2) == 0) {
+			value = argv[i] + 2;
+			if (*value == '\0' && i + 1 < argc) {
+				value = argv[++i];
+			}
+			options->jobs = atoi(value);
+			if (options->jobs < 1) {
+				fprintf(stderr, "Invalid number of jobs '%s'\n", value);
+				return -1;
+			}
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+			return -1;
+		}
+	}
+
+	return i;
+}
+
 /*This method is the main of this project - go through all the files .as given in command line
+ * (directly or listed in @manifest files)
  * and returns 0 in case of success making target files - ent, ext, obj and -1 otherwise */
 int main(int argc, char* argv[])
 {
+	assembler_options_t options;
+	job_list_t jobs;
 	int ret;
 	int i;
 
+	i = parse_options(argc, argv, &options);
+	if (i < 0) {
+		return 1;
+	}
+
+	if (options.serve) {
+		return (incr_serve(stdin, stdout, &options) < 0) ? 1 : 0;
+	}
+
 	/* Check if no arguments provided */
-	if (argc == 1) {
+	if (i == argc) {
 		fprintf(stderr, "Expected an argument\n");
 		return 1;
 	}
 
-	for (i = 1; i < argc; i++){
-		ret = assemble_one_file(argv[i]);
-		if (ret < 0) { /*assemble_one_file already gives specified error*/
-			break;
+	jobs_init(&jobs);
+	for (; i < argc; i++) {
+		ret = jobs_add_argument(&jobs, argv[i]);
+		if (ret < 0) {
+			jobs_free(&jobs);
+			return 1;
 		}
 	}
+	jobs_schedule(&jobs, options.jobs);
+
+	ret = assemble_files(&jobs, &options);
+	if (options.watch) {
+		ret = watch_files(&jobs, &options);
+	}
 
+	jobs_free(&jobs);
 	return ret;
 }
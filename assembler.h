@@ -3,6 +3,9 @@
 
 #include "defs.h"
 #include "symtable.h"
+#include "io.h"
+#include "macro.h"
+#include "jobs.h"
 
 #define BIT(n)                   (1 << (n))
 
@@ -11,14 +14,137 @@
 #define LEGAL_ADDRMODE_12       (BIT(1)|BIT(2))
 #define LEGAL_ADDRMODE_NONE     0
 
+typedef enum opcode {
+	OPCODE_MOV  = 0,
+	OPCODE_CMP  = 1,
+	OPCODE_ADD  = 2,
+	OPCODE_SUB  = 3,
+	OPCODE_NOT  = 4,
+	OPCODE_CLR  = 5,
+	OPCODE_LEA  = 6,
+	OPCODE_INC  = 7,
+	OPCODE_DEC  = 8,
+	OPCODE_JMP  = 9,
+	OPCODE_BNE  = 10,
+	OPCODE_RED  = 11,
+	OPCODE_PRN  = 12,
+	OPCODE_JSR  = 13,
+	OPCODE_RTS  = 14,
+	OPCODE_STOP = 15
+} opcode_t;
+
+/*The instructions - name, opcode, legal addressing modes of the 1st and 2nd operand and
+ * number of operands. Both ops[] and the decoding table of the disassembler are built from it*/
+#define INSTRUCTIONS(X) \
+	X("mov",  OPCODE_MOV,  LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  2) \
+	X("cmp",  OPCODE_CMP,  LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_0123, 2) \
+	X("add",  OPCODE_ADD,  LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  2) \
+	X("sub",  OPCODE_SUB,  LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  2) \
+	X("lea",  OPCODE_LEA,  LEGAL_ADDRMODE_12,   LEGAL_ADDRMODE_123,  2) \
+	X("not",  OPCODE_NOT,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("clr",  OPCODE_CLR,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("inc",  OPCODE_INC,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("dec",  OPCODE_DEC,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("jmp",  OPCODE_JMP,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("bne",  OPCODE_BNE,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("red",  OPCODE_RED,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("prn",  OPCODE_PRN,  LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_NONE, 1) \
+	X("jsr",  OPCODE_JSR,  LEGAL_ADDRMODE_123,  LEGAL_ADDRMODE_NONE, 1) \
+	X("rts",  OPCODE_RTS,  LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, 0) \
+	X("stop", OPCODE_STOP, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, 0)
+
+/*An instruction as recorded by the parser, before it is encoded to words.
+ * Kept small and flat so the encoder goes over an array of them in one loop*/
+typedef struct instruction {
+	unsigned char opcode;
+	unsigned char n;          /* Number of operands */
+	unsigned char type[2];    /* operand_type_t of each operand */
+	short         value[2];   /* Immediate, register id or struct field number */
+	int           symbol[2];  /* Id of the label of a direct or struct operand, or -1 */
+	int           line_number; /* Of the source, see source_line() */
+} instruction_t;
+
+/*The data words of a single data directive, as recorded for the compaction pass*/
+typedef struct data_block {
+	int  dc;
+	int  size;
+	int  is_string;
+	int  symbol;    /* Id of the label, -1 when the directive has no label */
+	int  struct_type; /* Index of the type of .struct TYPE, -1 for any other directive */
+} data_block_t;
+
+/*A struct type of .structdef - the names and the number of words of every field, in
+ * order. The name of the type is a constant, the names of the fields are only known in
+ * LABEL.field of a label of the type, see parse_structdef()*/
+typedef struct struct_type {
+	char          name[MAX_LABEL_LENGTH];
+	int           nfields;
+	int           words;
+	char          field[MAX_STRUCT_FIELDS][MAX_LABEL_LENGTH];
+	short         size[MAX_STRUCT_FIELDS];
+	unsigned char is_string[MAX_STRUCT_FIELDS]; /* Or a number of a single word */
+} struct_type_t;
+
+/*An entry, or a use of an external, as written to the outputs*/
+typedef struct object_symbol {
+	char name[MAX_LABEL_LENGTH];
+	int  address;
+} object_symbol_t;
+
+typedef struct assembler_options {
+	int jobs;      /* Number of worker threads, 1 means serial */
+	int io_depth;  /* Number of sources read ahead */
+	int use_uring; /* Batch the file I/O with io_uring when available */
+	int keep_going; /* Do not stop the run at the first failed file */
+	int watch;     /* Keep assembling the sources again when they change */
+	int serve;     /* Assemble a source edited by an editor, see incr_serve() */
+	int optimize;  /* Run the peephole pass (-O) */
+	int compact_data; /* Pool strings and drop unused data (--compact-data) */
+	int binary;    /* Write a binary object instead of the text outputs (--binary) */
+	int relocatable; /* Also write the relocation table (--relocatable) */
+	int map;       /* Also write the source map (--map) */
+	int check;     /* Only report the errors, nothing is encoded or written (--check) */
+	int deps;      /* Also write the entries and externals for a build (--deps) */
+} assembler_options_t;
+
 struct assembler_state {
 	int IC;
 	int DC;
 	int line_number;
 	symtab_t symbols;
 	const char *filename;
+	const assembler_state_t *includer; /* The source that includes this one, if any */
+	include_dep_t *includes; /* Every file included, directly or not */
+	const assembler_options_t *options;
+	FILE *errfile; /* Where diagnostics are printed */
+	io_ctx_t *io;  /* Where outputs are written */
 	short code[LENGTH_MEMORY];
 	short data[LENGTH_MEMORY];
+	int code_lines[LENGTH_MEMORY]; /* Source line of every code word, for the map */
+	int data_lines[LENGTH_MEMORY]; /* Source line of every data word */
+	instruction_t instructions[LENGTH_MEMORY]; /* Every instruction takes at least one word */
+	int ninstructions;
+	int words_saved; /* By the peephole pass */
+	data_block_t data_blocks[LENGTH_MEMORY]; /* Every data directive takes at least one word */
+	int ndata_blocks;
+	int data_words_saved; /* By the compaction pass */
+	object_symbol_t entries[2 * LENGTH_MEMORY]; /* Every entry is a label of a code or data word */
+	int nentries;
+	object_symbol_t externs[LENGTH_MEMORY]; /* Every use is a code word */
+	int nexterns;
+	short relocs[LENGTH_MEMORY]; /* Address of every code word with ARE_RELOC, ascending */
+	int nrelocs;
+	object_symbol_t labels[2 * LENGTH_MEMORY]; /* Code and data labels by address, for the map */
+	int nlabels;
+	macro_table_t macros;
+	macro_t *macro; /* Being defined, until endmcro */
+	int macro_use_line; /* Line of the use of the macro being expanded, 0 outside of one */
+	struct_type_t struct_types[MAX_STRUCT_TYPES];
+	int nstruct_types;
+	int line_struct_type; /* Of the .struct line being assembled, -1 without a type */
+	char struct_fields[LENGTH_MEMORY][MAX_LINE_LENGTH]; /* LABEL.field waiting for the type of LABEL */
+	int nstruct_fields;
+	int field_scope; /* The struct type of the fields an expression may name, or FIELDS_* */
 };
 
 struct operation_info {
@@ -45,11 +171,32 @@ struct operand_info{
 };
 
 
+int init_state(assembler_state_t *state, const char *filename, const assembler_options_t *options);
+int assemble_one_file(const char *filename, const assembler_options_t *options,
+		              io_ctx_t *io, io_request_t *source, include_dep_t **includes);
+void cleanup_state(assembler_state_t *state);
+int assemble_line(assembler_state_t *state, char *line);
+int generate_from_buffer(assembler_state_t *state, const char *buf, long len);
+int encode_instructions(assembler_state_t *state);
+int instruction_size(const instruction_t *insn);
+void optimize_instructions(assembler_state_t *state);
+void record_data_block(assembler_state_t *state, int dc, int symbol, int is_string, int struct_type);
+void compact_data(assembler_state_t *state);
+int include_file(assembler_state_t *state, const char *name);
+int struct_field_number(const assembler_state_t *state, const char *name);
+int struct_resolve(assembler_state_t *state);
+int expr_evaluate(assembler_state_t *state, const char *str, int *number);
+int expr_in_buffer(const char *buf, long len);
+int generate_code_and_data_parallel(assembler_state_t *state, const char *buf, long len);
+
 operation_info_t *find_operation(char operation[]);
 int tokenize_line(char *line, char **label, char **operation, char **operands, assembler_state_t *state);
 int check_label(const char label[], assembler_state_t *state);
 int get_next_comma(operation_info_t *info, assembler_state_t *state, char **tok1, char **tok2 ,char **operands);
 int parse_data(operation_info_t *info, assembler_state_t *state, char *operands);
+void emit_data(assembler_state_t *state, int number);
 int parse_entry(operation_info_t *info, assembler_state_t *state, char *operands);
+const struct_type_t *struct_find(const assembler_state_t *state, const char *name);
+int struct_copy(assembler_state_t *state, const assembler_state_t *src);
 
 #endif
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Times every assembler given on the corpus of this directory, copied many times over - the
+# best of the runs, in wall time and in the user time of the assembler (the writes of the
+# output files take most of the wall time). Every build must write the same files
+# usage: sh bench/bench.sh assembler... (COPIES and RUNS in the environment change the load)
+
+COPIES=${COPIES:-1500}
+RUNS=${RUNS:-3}
+CORPUS=$(dirname "$0")
+WORK=build/bench
+
+rm -rf $WORK
+mkdir -p $WORK/corpus
+i=0
+while [ $i -lt $COPIES ]; do
+	for f in $CORPUS/*.as; do
+		cp $f $WORK/corpus/$(basename $f .as)$i.as
+	done
+	i=$((i + 1))
+done
+cp $CORPUS/*.inc $WORK/corpus
+
+now() {
+	date +%s.%N
+}
+
+# The user time of the finished children, in seconds. times runs in this shell, as a
+# subshell has no children of its own
+user_time() {
+	awk 'NR == 2 { split($1, t, "[ms]"); print t[1] * 60 + t[2] }' $WORK/times
+}
+
+base=""
+for asm in "$@"; do
+	best=""
+	best_user=""
+	run=0
+	while [ $run -lt $RUNS ]; do
+		rm -f $WORK/corpus/*.ob $WORK/corpus/*.ent $WORK/corpus/*.ext
+		times > $WORK/times
+		start_user=$(user_time)
+		start=$(now)
+		$asm $WORK/corpus > /dev/null || exit 1
+		end=$(now)
+		times > $WORK/times
+		end_user=$(user_time)
+		best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 != "" && $3 < t) t = $3; printf "%.3f", t }')
+		best_user=$(echo "$start_user $end_user $best_user" | awk '{ t = $2 - $1; if ($3 != "" && $3 < t) t = $3; printf "%.3f", t }')
+		run=$((run + 1))
+	done
+
+	mkdir -p $WORK/out
+	cat $WORK/corpus/*.ob $WORK/corpus/*.ent $WORK/corpus/*.ext > $WORK/out/$(basename $asm)
+	if [ -z "$base" ]; then
+		base=$best
+		base_user=$best_user
+		reference=$WORK/out/$(basename $asm)
+	elif ! cmp -s $reference $WORK/out/$(basename $asm); then
+		echo "$asm: the output differs from $reference"
+		exit 1
+	fi
+	echo "$best $base $best_user $base_user" | awk -v asm=$asm '{
+		printf "%-24s %7.3f seconds %6.2fx   user %7.3f seconds %6.2fx\n", asm, $1, $2 / $1, $3, ($3 > 0) ? $4 / $3 : 0 }'
+done
@@ -0,0 +1,59 @@
+; calls - part of the training and benchmark corpus
+.extern PRINTF
+.extern EXIT
+.entry CAL0
+.entry DCA0
+CAL0: 	dec r0
+	cmp r4, r2
+	lea SCA1, r6
+	mov SCA0, r4
+CAL1: 	rts
+	bne RCA0.1
+	sub RCA0.1, RCA0.2
+	clr DCA1
+	jmp CAL2
+	red RCA1.1
+; loop body
+	not PRINTF
+	sub PRINTF, r0
+	mov #25, r0
+	jmp RCA0.1
+CAL2: 	sub #-86, SCA0
+	sub RCA0.1, r6
+	not RCA1.2
+; save the result
+	dec RCA0.2
+CAL3: 	inc DCA1
+; next record
+	red r0
+	mov r0, SCA0
+CAL4: 	cmp RCA0.2, #-68
+	rts
+	sub DCA1, RCA0.1
+; next record
+	not RCA0.1
+	red RCA0.2
+; advance the pointer
+	prn RCA0.2
+	cmp #88, r5
+; next record
+	sub RCA1.1, RCA1.1
+CAL5: 	sub r1, RCA1.2
+	sub RCA1.1, DCA0
+; loop body
+	add DCA0, DCA0
+	clr RCA0.1
+	add #89, RCA1.1
+	prn RCA1.1
+	mov r1, r0
+	mov DCA1, r2
+	mov RCA0.1, r6
+; loop body
+; advance the pointer
+	stop
+DCA0: .data 435, 415, 496, -193, 29
+DCA1: .data -120, -26, 225
+SCA0: .string "lo"
+SCA1: .string "quick fox"
+RCA0: .struct 5, "record"
+RCA1: .struct -38, "world"
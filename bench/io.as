@@ -0,0 +1,50 @@
+; io - part of the training and benchmark corpus
+.extern BUFFER
+.extern FLUSH
+.entry IO0
+.entry DIO0
+IO0: 	cmp r0, RIO0.1
+	red r2
+	red SIO0
+; next record
+	cmp FLUSH, RIO0.1
+; loop body
+IO1: 	jmp IO3
+	red r3
+	cmp r2, r1
+	stop
+	jsr IO0
+; compare with the limit
+	sub #84, RIO0.1
+	lea RIO0.1, r7
+	mov RIO0.1, SIO2
+; next record
+IO2: 	cmp r7, RIO0.2
+; advance the pointer
+IO3: 	sub RIO0.2, r3
+	lea RIO0.1, SIO2
+	stop
+	lea DIO0, SIO1
+	red r5
+; compare with the limit
+	mov SIO0, DIO1
+	cmp SIO1, r5
+	mov SIO0, RIO0.2
+	sub #-46, SIO1
+	cmp DIO1, r3
+	mov r6, r3
+; save the result
+IO4: 	lea RIO0.2, RIO0.2
+	sub RIO0.2, BUFFER
+	stop
+	prn DIO1
+; next record
+	mov RIO0.2, r4
+	clr r3
+	stop
+DIO0: .data -255
+DIO1: .data -269, 332, -276, -74
+SIO0: .string "hello"
+SIO1: .string "assembler"
+SIO2: .string "abcdef"
+RIO0: .struct -78, "abcdef"
@@ -0,0 +1,58 @@
+; kernel - part of the training and benchmark corpus
+.entry KER0
+.entry DKE0
+KER0: 	jsr KER2
+	cmp RKE0.1, #80
+; loop body
+	inc r0
+	red DKE0
+; loop body
+	mov DKE1, RKE0.2
+; next record
+	stop
+; save the result
+	add #6, RKE0.1
+KER1: 	inc r4
+KER2: 	sub r1, r2
+	sub #-66, DKE0
+	stop
+	not r4
+	sub #43, RKE0.1
+KER3: 	clr r5
+	cmp #-82, r0
+	add SKE0, SKE0
+	sub RKE0.1, r4
+	jsr RKE0.2
+	cmp r7, RKE0.2
+	lea DKE0, r3
+	inc r4
+	inc RKE0.1
+	lea SKE0, r5
+	lea SKE0, RKE0.1
+; loop body
+	cmp RKE0.2, #64
+	dec RKE0.2
+; next record
+	cmp r1, r7
+	mov #-62, r5
+	bne RKE0.1
+	clr RKE0.2
+	prn DKE0
+	add RKE0.1, r0
+	not r4
+	cmp r6, RKE0.1
+	lea DKE1, r5
+KER4: 	clr SKE0
+	sub RKE0.1, DKE1
+	lea RKE0.2, DKE0
+	sub RKE0.1, DKE0
+	jmp r2
+KER5: 	cmp #71, r1
+	jsr r6
+KER6: 	dec r7
+KER7: 	stop
+	stop
+DKE0: .data -211, -431, 473, 349, -100
+DKE1: .data 301, -256, -176, 444, -421
+SKE0: .string "abcdef"
+RKE0: .struct -82, "hello"
@@ -0,0 +1,22 @@
+; macros.as - macros and an include, part of the training and benchmark corpus
+.include "lib.inc"
+mcro push2
+	inc r6
+	mov r1, r5
+endmcro
+mcro cmpzero
+	cmp r1, ZERO
+	bne NEXT
+endmcro
+MAIN:	clr r1
+	mov #10, r2
+LOOP:	push2
+	jsr SWAP
+	cmpzero
+	prn r1
+NEXT:	dec r2
+	cmp r2, #0
+	bne LOOP
+	push2
+	cmpzero
+	stop
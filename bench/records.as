@@ -0,0 +1,52 @@
+; records - part of the training and benchmark corpus
+.entry REC0
+.entry DRE0
+REC0: 	rts
+	bne REC4
+	add RRE0.2, RRE1.1
+	add RRE0.2, DRE1
+	add #50, DRE1
+; loop body
+REC1: 	mov SRE0, RRE1.1
+	clr r6
+	jsr RRE1.1
+	sub #77, r2
+	dec r6
+REC2: 	red RRE3.1
+	inc RRE0.2
+; save the result
+	cmp SRE0, DRE1
+; next record
+	lea RRE3.2, RRE2.1
+	stop
+; save the result
+	bne REC2
+REC3: 	lea RRE1.1, r6
+	stop
+REC4: 	clr RRE2.2
+	rts
+	stop
+	clr DRE1
+	add RRE0.1, DRE0
+	not r7
+	inc DRE0
+	lea RRE2.2, r5
+	cmp r7, #31
+	sub RRE1.1, DRE0
+	clr DRE0
+; loop body
+	jsr REC4
+	prn DRE0
+	bne RRE2.1
+; next record
+	prn RRE2.2
+	sub DRE0, RRE0.1
+	bne r3
+	stop
+DRE0: .data 271, -280, -366
+DRE1: .data 185, 231, -425, -312
+SRE0: .string "world"
+RRE0: .struct -94, "record"
+RRE1: .struct -72, "world"
+RRE2: .struct 27, "record"
+RRE3: .struct 70, "abcdef"
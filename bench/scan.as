@@ -0,0 +1,53 @@
+; scan - part of the training and benchmark corpus
+.extern TABLE
+.entry SCA0
+.entry DSC0
+SCA0: 	mov #-21, RSC0.2
+	bne SCA0
+SCA1: 	sub #-15, r5
+	add r6, RSC1.2
+	sub TABLE, r5
+	add RSC0.1, r2
+SCA2: 	dec RSC1.1
+	prn DSC0
+	add RSC0.2, RSC1.2
+; advance the pointer
+	rts
+	jmp SCA4
+	jmp SCA1
+	inc RSC0.1
+	add RSC1.2, DSC2
+	sub #-65, r1
+	jsr RSC0.1
+; loop body
+	sub #35, RSC1.1
+; loop body
+	add RSC0.1, SSC1
+; loop body
+	mov DSC0, r7
+SCA3: 	mov RSC0.1, DSC2
+; compare with the limit
+	sub RSC0.1, RSC0.1
+	clr RSC0.2
+	inc r0
+	add r3, r5
+	not r2
+SCA4: 	not r7
+	inc RSC1.2
+	inc r1
+	mov SSC1, DSC1
+	add r0, TABLE
+; save the result
+	jmp RSC1.1
+SCA5: 	sub RSC1.1, RSC0.1
+; next record
+SCA6: 	rts
+; advance the pointer
+	stop
+DSC0: .data 360, -398, 113, -321
+DSC1: .data 76, 102, -206, -495, 69, 308
+DSC2: .data 431, 462, -226, 374, -139, 302
+SSC0: .string "record"
+SSC1: .string "quick fox"
+RSC0: .struct 63, "hello"
+RSC1: .struct 44, "hello"
@@ -0,0 +1,19 @@
+; small - part of the training and benchmark corpus
+.entry SMA0
+.entry DSM0
+SMA0: 	sub #5, r5
+; advance the pointer
+	jsr DSM0
+SMA1: 	not r1
+	lea DSM0, DSM0
+	rts
+SMA2: 	inc DSM0
+	jsr DSM0
+	mov DSM0, DSM0
+	stop
+	clr r6
+	prn #-43
+	cmp r1, DSM0
+	stop
+DSM0: .data 70, -452
+SSM0: .string "abcdef"
@@ -0,0 +1,61 @@
+; sort - part of the training and benchmark corpus
+.entry SOR0
+.entry DSO0
+SOR0: 	jmp r3
+	bne RSO0.2
+	mov SSO0, r2
+	not RSO0.2
+; advance the pointer
+	red RSO0.1
+	lea SSO0, DSO1
+; advance the pointer
+	jmp r5
+	red r1
+	dec SSO0
+	sub DSO2, RSO0.2
+	stop
+	inc RSO0.1
+; advance the pointer
+SOR1: 	cmp r3, RSO0.1
+SOR2: 	sub RSO0.2, r6
+	add RSO0.2, r1
+	red DSO1
+	not r6
+	clr DSO1
+; advance the pointer
+	rts
+	clr r2
+SOR3: 	inc DSO0
+; loop body
+	jsr r0
+	jsr r5
+; compare with the limit
+	mov #62, r3
+	prn SSO0
+	prn SSO0
+	sub DSO1, DSO2
+SOR4: 	bne RSO0.1
+	cmp r0, SSO0
+	not RSO0.1
+	jmp r2
+SOR5: 	stop
+; advance the pointer
+	add RSO0.2, DSO2
+	prn RSO0.1
+	sub DSO0, SSO0
+	jmp SOR0
+	inc DSO0
+	stop
+SOR6: 	cmp #31, #-50
+	prn DSO1
+	jmp r5
+	sub RSO0.1, DSO2
+	jmp RSO0.2
+	sub DSO2, RSO0.2
+	inc DSO1
+	stop
+DSO0: .data -197, -247, 163
+DSO1: .data -102, 256, -212, 477, -312
+DSO2: .data 326, -127, 490, -469
+SSO0: .string "quick fox"
+RSO0: .struct 65, "abcdef"
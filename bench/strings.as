@@ -0,0 +1,50 @@
+; strings - part of the training and benchmark corpus
+.entry STR0
+.entry DST0
+STR0: 	dec SST4
+	add SST4, DST0
+	jmp STR3
+; next record
+	sub #-43, r3
+	inc r6
+STR1: 	stop
+	bne r3
+; compare with the limit
+STR2: 	lea DST0, r4
+	inc r6
+STR3: 	cmp SST0, #63
+	sub r0, DST0
+	add DST1, r7
+	jmp STR3
+	bne r7
+	lea DST0, SST1
+	inc r1
+	mov #71, DST1
+	dec r5
+	prn DST0
+	jsr DST0
+	stop
+	lea DST1, DST0
+; loop body
+	bne STR1
+	jsr STR1
+; save the result
+	red SST1
+	add #15, DST1
+	lea DST1, SST3
+	jsr DST1
+STR4: 	jsr r6
+	sub DST0, r7
+	clr DST0
+	bne STR2
+	prn DST1
+	add #-96, SST4
+	red SST4
+	stop
+DST0: .data 321
+DST1: .data -224
+SST0: .string "hello"
+SST1: .string "hello"
+SST2: .string "record"
+SST3: .string "world"
+SST4: .string "world"
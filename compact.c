@@ -0,0 +1,149 @@
+#include "assembler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*A labeled data block together with the unlabeled blocks that follow it. Code may reach
+ * those through the label (e.g. the fields of a .struct), so they are moved as one*/
+typedef struct data_object {
+	int      dc;
+	int      size;
+	int      is_string; /* A single .string */
+	symbol_t *symbol;   /* NULL for data before the first label */
+	int      keep;
+	int      owner;     /* Object whose words end with this string, or -1 */
+	int      new_dc;
+} data_object_t;
+
+/*This method remembers the words of a data directive, so they can be moved later*/
+void record_data_block(assembler_state_t *state, int dc, int symbol, int is_string, int struct_type)
+{
+	data_block_t *b;
+
+	/* Past the end the block is only counted, the overflow is reported by the caller */
+	if (state->ndata_blocks < LENGTH_MEMORY) {
+		b = &state->data_blocks[state->ndata_blocks];
+		b->dc = dc;
+		b->size = state->DC - dc;
+		b->is_string = is_string;
+		b->symbol = symbol;
+		b->struct_type = struct_type;
+	}
+	state->ndata_blocks++;
+}
+
+/*This method groups the data blocks to objects
+ * returns the number of objects or -1 if the blocks do not cover the data*/
+int collect_data_objects(assembler_state_t *state, data_object_t objects[])
+{
+	data_block_t *b;
+	data_object_t *o;
+	int i, n;
+
+	n = 0;
+	o = NULL;
+	for (i = 0; i < state->ndata_blocks; i++) {
+		b = &state->data_blocks[i];
+		if (o != NULL && b->symbol < 0) {
+			o->size += b->size;
+			o->is_string = 0;
+			continue;
+		}
+
+		o = &objects[n++];
+		o->dc = b->dc;
+		o->size = b->size;
+		o->is_string = b->is_string;
+		o->symbol = (b->symbol >= 0) ? symtab_symbol(&state->symbols, b->symbol) : NULL;
+		o->keep = (o->symbol == NULL || o->symbol->relocations != NULL || o->symbol->is_entry);
+		o->owner = -1;
+		if (o->symbol != NULL && o->symbol->type != SYMBOL_TYPE_DATA) {
+			return -1;
+		}
+	}
+
+	if (n > 0 && o->dc + o->size != state->DC) {
+		return -1;
+	}
+	return n;
+}
+
+/*This method finds the strings that are the same as another string, or a suffix of it*/
+void pool_strings(assembler_state_t *state, data_object_t objects[], int n)
+{
+	int order[LENGTH_MEMORY];
+	data_object_t *s, *t;
+	int i, j, k;
+
+	/* The kept strings, longest first - a string can only end a longer one */
+	k = 0;
+	for (i = 0; i < n; i++) {
+		if (!objects[i].keep || !objects[i].is_string) {
+			continue;
+		}
+		for (j = k; j > 0 && objects[order[j - 1]].size < objects[i].size; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+		k++;
+	}
+
+	for (i = 0; i < k; i++) {
+		s = &objects[order[i]];
+		for (j = 0; j < i; j++) {
+			t = &objects[order[j]];
+			if (t->owner < 0 &&
+				memcmp(state->data + t->dc + t->size - s->size, state->data + s->dc,
+					   s->size * sizeof(state->data[0])) == 0) {
+				s->owner = order[j];
+				break;
+			}
+		}
+	}
+}
+
+/*This method shrinks the data segment - identical strings and strings that end another
+ * string share their words, and labeled data that no code uses and that is not an entry is
+ * dropped. It must run before the relocations are fixed, since it moves the data labels*/
+void compact_data(assembler_state_t *state)
+{
+	data_object_t objects[LENGTH_MEMORY];
+	data_object_t *o;
+	int n, dc, i;
+
+	/* Leave data that does not fit as it is, it is reported by the caller */
+	if (state->DC > LENGTH_MEMORY || state->ndata_blocks > LENGTH_MEMORY) {
+		return;
+	}
+
+	n = collect_data_objects(state, objects);
+	if (n <= 0) {
+		return;
+	}
+	pool_strings(state, objects, n);
+
+	/* Objects only move down, so they can be moved in place */
+	dc = 0;
+	for (i = 0; i < n; i++) {
+		o = &objects[i];
+		if (o->keep && o->owner < 0) {
+			memmove(state->data + dc, state->data + o->dc, o->size * sizeof(state->data[0]));
+			memmove(state->data_lines + dc, state->data_lines + o->dc, o->size * sizeof(state->data_lines[0]));
+			o->new_dc = dc;
+			dc += o->size;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		o = &objects[i];
+		if (o->keep && o->owner >= 0) {
+			o->new_dc = objects[o->owner].new_dc + objects[o->owner].size - o->size;
+		}
+		if (o->symbol != NULL) {
+			o->symbol->index = o->keep ? o->new_dc : -1; /* Not in the map */
+		}
+	}
+
+	state->data_words_saved = state->DC - dc;
+	state->DC = dc;
+}
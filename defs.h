@@ -13,7 +13,13 @@
 #define END_OF_TOKENS -2  /*A sign that says that there are not tokens left*/
 #define MAX_NUMBER_OF_SYMBOL 256 /*The maximum number of symbols that can be */
 #define MAX_LABEL_LENGTH  30
-#define LENGTH_OF_OPS 21 /*There are 21 operations*/
+#define LENGTH_OF_OPS 24 /*There are 24 operations*/
+#define MAX_FIELD_NUMBER 255 /*The word of a struct field number holds 8 bits*/
+#define MAX_STRUCT_TYPES 32
+#define MAX_STRUCT_FIELDS 32
+#define FIELDS_NONE -1 /*The names in an expression are constants only*/
+#define FIELDS_ANY  -2 /*Or fields of the struct types that define them*/
+#define PARALLEL_MIN_FILE_SIZE (256 * 1024) /*Smaller files are not worth splitting between threads*/
 /*ARE bits*/
 #define ARE_FIXED  0
 #define ARE_EXTERN 1
@@ -31,7 +37,9 @@ typedef struct operation_info operation_info_t;
 typedef struct operand_info operand_info_t;
 
 FILE *open_file_with_ext(const char *filename, const char *ext, const char *mode);
+int get_line(char *line, int size, const char *buf, long len, long *pos);
 void to_base32(int x, char *str);
+int from_base32(const char *str);
 int my_atoi(assembler_state_t *state, char *number_str, int *number);
 
 #endif
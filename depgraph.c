@@ -0,0 +1,216 @@
+#include "assembler.h"
+#include "object.h"
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/*An entry or an external of a module, as its .dep file lists it*/
+typedef struct dep_symbol {
+	char name[MAX_LABEL_LENGTH];
+	int  value;  /* The address of an entry, the number of uses of an external */
+	int  module;
+} dep_symbol_t;
+
+/*The symbols of all the modules, read from their .dep files*/
+typedef struct depgraph {
+	job_list_t   *modules;
+	dep_symbol_t *entries;  /* Sorted by name once all the modules are read */
+	int          nentries;
+	dep_symbol_t *externs;  /* In the order of the modules */
+	int          nexterns;
+	int          capacity;  /* Of both tables */
+} depgraph_t;
+
+/*This method reads <name>.dep of a module to the tables of the graph
+ * returns 0 in case of success and -1 otherwise*/
+int depgraph_read(depgraph_t *g, int module)
+{
+	char path[MAX_PATH], line[MAX_LINE_LENGTH];
+	char kind[MAX_LINE_LENGTH], name[MAX_LINE_LENGTH], value[MAX_LINE_LENGTH];
+	dep_symbol_t *entries, *externs, *s;
+	int error_flag;
+	FILE *f;
+
+	sprintf(path, "%s.%s", g->modules->jobs[module].name, DEPS_EXT);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open file %s for reading\n", path);
+		return -1;
+	}
+
+	error_flag = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (g->nentries == g->capacity || g->nexterns == g->capacity) {
+			g->capacity = (g->capacity == 0) ? 64 : 2 * g->capacity;
+			entries = realloc(g->entries, g->capacity * sizeof(*entries));
+			if (entries != NULL) {
+				g->entries = entries;
+			}
+			externs = realloc(g->externs, g->capacity * sizeof(*externs));
+			if (externs != NULL) {
+				g->externs = externs;
+			}
+			if (entries == NULL || externs == NULL) {
+				fprintf(stderr, "Failed to allocate symbols\n");
+				error_flag = -1;
+				break;
+			}
+		}
+
+		if (sscanf(line, "%s %s %s", kind, name, value) != 3 || strlen(name) >= MAX_LABEL_LENGTH ||
+			(strcmp(kind, "entry") != 0 && strcmp(kind, "extern") != 0)) {
+			fprintf(stderr, "Invalid line in %s: %s", path, line);
+			error_flag = -1;
+			break;
+		}
+
+		s = (kind[1] == 'n') ? &g->entries[g->nentries++] : &g->externs[g->nexterns++];
+		strcpy(s->name, name);
+		s->value = (kind[1] == 'n') ? from_base32(value) : atoi(value);
+		s->module = module;
+	}
+
+	fclose(f);
+	return error_flag;
+}
+
+/*Orders symbols by name, and symbols of the same name by module*/
+int compare_dep_symbols(const void *a, const void *b)
+{
+	const dep_symbol_t *x = a, *y = b;
+	int ret;
+
+	ret = strcmp(x->name, y->name);
+	if (ret == 0) {
+		ret = x->module - y->module;
+	}
+	return ret;
+}
+
+/*This method finds the module that exports a symbol
+ * returns the module or -1 if no module does*/
+int depgraph_exporter(const depgraph_t *g, const char *name)
+{
+	int lo, hi, mid, cmp;
+
+	lo = 0;
+	hi = g->nentries;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(g->entries[mid].name, name);
+		if (cmp == 0) {
+			return g->entries[mid].module;
+		} else if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return -1;
+}
+
+/*This method writes the graph - a line per module, in the order given, with the modules
+ * whose entries it uses:
+ *   <module>: <module> <module>...
+ * the same as a make rule, so a build relinks and retests only what a change reaches
+ * returns 0 in case of success and -1 if a symbol is exported twice or not at all*/
+int depgraph_write(depgraph_t *g, FILE *out)
+{
+	char *seen;
+	int error_flag;
+	int i, j, module, exporter;
+
+	error_flag = 0;
+	qsort(g->entries, g->nentries, sizeof(*g->entries), compare_dep_symbols);
+	for (i = 1; i < g->nentries; i++) {
+		if (strcmp(g->entries[i].name, g->entries[i - 1].name) == 0) {
+			fprintf(stderr, "Symbol %s is an entry of both %s and %s\n", g->entries[i].name,
+					g->modules->jobs[g->entries[i - 1].module].name, g->modules->jobs[g->entries[i].module].name);
+			error_flag = -1;
+		}
+	}
+
+	seen = calloc(g->modules->n + 1, 1);
+	if (seen == NULL) {
+		fprintf(stderr, "Failed to allocate graph\n");
+		return -1;
+	}
+
+	i = 0;
+	for (module = 0; module < g->modules->n; module++) {
+		fprintf(out, "%s:", g->modules->jobs[module].name);
+		for (j = i; i < g->nexterns && g->externs[i].module == module; i++) {
+			exporter = depgraph_exporter(g, g->externs[i].name);
+			if (exporter < 0) {
+				fprintf(stderr, "Symbol %s of %s is not an entry of any module\n", g->externs[i].name,
+						g->modules->jobs[module].name);
+				error_flag = -1;
+			} else if (!seen[exporter] && exporter != module) {
+				seen[exporter] = 1;
+				fprintf(out, " %s", g->modules->jobs[exporter].name);
+			}
+		}
+		fprintf(out, "\n");
+
+		/* Clear only what this module marked */
+		for (; j < i; j++) {
+			exporter = depgraph_exporter(g, g->externs[j].name);
+			if (exporter >= 0) {
+				seen[exporter] = 0;
+			}
+		}
+	}
+
+	free(seen);
+	return error_flag;
+}
+
+/*This method is the main of depgraph - reads the .dep files the assembler writes with
+ * --deps for the modules given in the command line (directly, listed in @manifest files,
+ * or every module of a directory) and writes the graph of the modules to the standard
+ * output, see depgraph_write()*/
+int main(int argc, char *argv[])
+{
+	job_list_t modules;
+	struct stat st;
+	depgraph_t g;
+	int error_flag;
+	int i;
+
+	if (argc < 2 || argv[1][0] == '-') {
+		fprintf(stderr, "Usage: %s module...\n", argv[0]);
+		return 1;
+	}
+
+	jobs_init(&modules);
+	error_flag = 0;
+	for (i = 1; i < argc; i++) {
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (jobs_add_directory(&modules, argv[i], DEPS_EXT) < 0) {
+				error_flag = 1;
+			}
+		} else if (jobs_add_argument(&modules, argv[i]) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	memset(&g, 0, sizeof(g));
+	g.modules = &modules;
+	for (i = 0; i < modules.n; i++) {
+		if (depgraph_read(&g, i) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	if (!error_flag && depgraph_write(&g, stdout) < 0) {
+		error_flag = 1;
+	}
+
+	free(g.entries);
+	free(g.externs);
+	jobs_free(&modules);
+	return error_flag;
+}
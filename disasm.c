@@ -0,0 +1,543 @@
+#include "assembler.h"
+#include "object.h"
+#include "jobs.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DISASM_EXT        "dis"
+#define DISASM_LINE_WORDS 8  /*Words of a .data line, so it fits MAX_LINE_LENGTH*/
+#define DISASM_MAX_STRING 40 /*Longer strings are written as .data, for the same reason*/
+
+/*How a first word decodes*/
+typedef struct decode {
+	const char    *name;    /* NULL when the word does not start an instruction */
+	unsigned char opcode;
+	unsigned char n;        /* Number of operands */
+	unsigned char type[2];  /* operand_type_t of each operand, as in instruction_t */
+	unsigned char size;     /* In words */
+} decode_t;
+
+/*An instruction, as listed by INSTRUCTIONS()*/
+typedef struct decode_op {
+	const char *name;
+	int        opcode;
+	int        legal_1st;
+	int        legal_2nd;
+	int        n;
+} decode_op_t;
+
+#define DECODE_OP(name, opcode, legal_1st, legal_2nd, n) {name, opcode, legal_1st, legal_2nd, n},
+
+const decode_op_t decode_ops[] = {
+	INSTRUCTIONS(DECODE_OP)
+};
+
+/*The decoding table, indexed by the whole first word - the ARE bits of a first word are 0,
+ * so only the words that start a legal instruction have a name*/
+decode_t decode_table[BIT(10)];
+
+/*A module being disassembled. Words are indexed by address - ASSEMBLY_CODE_START_ADDRESS*/
+typedef struct disasm {
+	assembler_state_t state;
+	short             words[2 * LENGTH_MEMORY]; /* The code and then the data */
+	int               nwords;
+	int               code_size;                /* Words decoded as instructions */
+	const char        *labels[2 * LENGTH_MEMORY];  /* From the .ent, or NULL */
+	const char        *externs[2 * LENGTH_MEMORY]; /* From the .ext, or NULL */
+	char              is_target[2 * LENGTH_MEMORY]; /* A code word holds its address */
+} disasm_t;
+
+/*This method fills the decoding table from INSTRUCTIONS() - every opcode with every legal
+ * pair of addressing modes*/
+void decode_init(void)
+{
+	const decode_op_t *op;
+	instruction_t insn;
+	decode_t *d;
+	int src, dst;
+	size_t i;
+
+	for (i = 0; i < sizeof(decode_ops) / sizeof(decode_ops[0]); i++) {
+		op = &decode_ops[i];
+		for (src = 0; src < 4; src++) {
+			for (dst = 0; dst < 4; dst++) {
+				if ((op->n == 2 && ((BIT(src) & op->legal_1st) == 0 || (BIT(dst) & op->legal_2nd) == 0)) ||
+					(op->n == 1 && (src != 0 || (BIT(dst) & op->legal_1st) == 0)) ||
+					(op->n == 0 && (src != 0 || dst != 0))) {
+					continue;
+				}
+
+				insn.n = op->n;
+				insn.type[0] = (op->n == 2) ? src : dst;
+				insn.type[1] = dst;
+
+				d = &decode_table[(op->opcode << 6) | (src << 4) | (dst << 2)];
+				d->name = op->name;
+				d->opcode = op->opcode;
+				d->n = insn.n;
+				d->type[0] = insn.type[0];
+				d->type[1] = insn.type[1];
+				d->size = instruction_size(&insn);
+			}
+		}
+	}
+}
+
+/*This method returns the value of an immediate operand - the signed 8 bits above the ARE bits*/
+int disasm_value(int word)
+{
+	word = (word >> 2) & 255;
+	return (word & 128) ? word - 256 : word;
+}
+
+/*This method returns the value of a data word - all its 10 bits, signed*/
+int disasm_number(int word)
+{
+	word = word & 1023;
+	return (word & 512) ? word - 1024 : word;
+}
+
+/*This method checks the word of an address operand
+ * returns the index of the word it points to, -1 for an external and -2 if it is invalid*/
+int disasm_address(const disasm_t *d, int w)
+{
+	int word, target;
+
+	word = d->words[w] & 1023;
+	if (word == ARE_EXTERN && d->externs[w] != NULL) {
+		return -1;
+	}
+	target = (word >> 2) - ASSEMBLY_CODE_START_ADDRESS;
+	if ((word & 3) != ARE_RELOC || target < 0 || target >= d->nwords) {
+		return -2;
+	}
+	return target;
+}
+
+/*This method checks the operand words of an instruction and marks the words its operands
+ * point to. When the end of the code is not known, an operand that points ahead of pos to
+ * data (a struct, or the operand of an instruction that is not a jump) moves *limit to it
+ * returns 0 in case of success and -1 if the words are not an instruction*/
+int disasm_check(disasm_t *d, int pos, const decode_t *e, int *limit, int known)
+{
+	int word, target;
+	int w, i;
+
+	if (e->name == NULL || pos + e->size > d->nwords) {
+		return -1;
+	}
+
+	if (e->n == 2 && e->type[0] == ADDR_REGISTER && e->type[1] == ADDR_REGISTER) {
+		word = d->words[pos + 1] & 1023;
+		return ((word & 3) == 0 && ((word >> 2) & 15) < 8 && (word >> 6) < 8) ? 0 : -1;
+	}
+
+	w = pos + 1;
+	for (i = 0; i < e->n; i++) {
+		word = d->words[w] & 1023;
+		switch (e->type[i]) {
+		case ADDR_IMMEDIATE:
+			if ((word & 3) != 0) {
+				return -1;
+			}
+			break;
+		case ADDR_DIRECT:
+		case ADDR_STRUCT:
+			target = disasm_address(d, w);
+			if (target == -2) {
+				return -1;
+			}
+			if (e->type[i] == ADDR_STRUCT) {
+				w++;
+				word = d->words[w] & 1023;
+				if ((word & 3) != 0 || (word >> 2) < 1) {
+					return -1;
+				}
+			}
+			if (target < 0) {
+				break;
+			}
+			d->is_target[target] = 1;
+			if (!known && target > pos && target < *limit &&
+				(e->type[i] == ADDR_STRUCT ||
+				 (e->opcode != OPCODE_JMP && e->opcode != OPCODE_BNE && e->opcode != OPCODE_JSR))) {
+				*limit = target;
+			}
+			break;
+		case ADDR_REGISTER:
+			/* The source register is in bits 6-9, the destination in bits 2-5 */
+			if ((i == 0 && e->n == 2) ? ((word & 63) != 0 || (word >> 6) >= 8) : ((word >> 2) >= 8 || (word & 3) != 0)) {
+				return -1;
+			}
+			break;
+		}
+		w++;
+	}
+	return 0;
+}
+
+/*This method decodes the instructions at the start of the module. When it has no binary
+ * object the end of the code is not known - it is the first word that does not decode, or
+ * the first word some instruction uses as data*/
+void disasm_decode(disasm_t *d, int code_size, int known)
+{
+	const decode_t *e;
+	int limit, pos;
+
+	limit = code_size;
+	pos = 0;
+	while (pos < limit) {
+		e = &decode_table[d->words[pos] & 1023];
+		if (disasm_check(d, pos, e, &limit, known) < 0) {
+			break;
+		}
+		pos += e->size;
+	}
+	d->code_size = pos;
+}
+
+/*This method writes the label of a word*/
+void disasm_label(const disasm_t *d, int w, char *label)
+{
+	if (d->labels[w] != NULL) {
+		strcpy(label, d->labels[w]);
+	} else {
+		sprintf(label, "L%d", w + ASSEMBLY_CODE_START_ADDRESS);
+	}
+}
+
+/*This method writes the label a line starts with, if its word has one*/
+void disasm_line_label(const disasm_t *d, int w, FILE *f)
+{
+	char label[MAX_LABEL_LENGTH];
+
+	if (d->labels[w] != NULL || d->is_target[w]) {
+		disasm_label(d, w, label);
+		fprintf(f, "%s: ", label);
+	} else {
+		fprintf(f, "\t");
+	}
+}
+
+/*This method writes an operand of an instruction, whose words start at w
+ * returns the number of words it takes*/
+int disasm_operand(const disasm_t *d, int w, int type, FILE *f)
+{
+	char label[MAX_LABEL_LENGTH];
+	int target;
+
+	switch (type) {
+	case ADDR_IMMEDIATE:
+		fprintf(f, "#%d", disasm_value(d->words[w]));
+		return 1;
+	case ADDR_REGISTER:
+		fprintf(f, "r%d", (d->words[w] >> 2) & 15);
+		return 1;
+	}
+
+	target = disasm_address(d, w);
+	if (target < 0) {
+		strcpy(label, d->externs[w]);
+	} else {
+		disasm_label(d, target, label);
+	}
+
+	if (type == ADDR_STRUCT) {
+		fprintf(f, "%s.%d", label, d->words[w + 1] >> 2);
+		return 2;
+	}
+	fprintf(f, "%s", label);
+	return 1;
+}
+
+/*This method writes an instruction
+ * returns the number of words it takes*/
+int disasm_instruction(const disasm_t *d, int pos, FILE *f)
+{
+	const decode_t *e;
+	int w, i;
+
+	e = &decode_table[d->words[pos] & 1023];
+	disasm_line_label(d, pos, f);
+	fprintf(f, "%s", e->name);
+
+	/* Special case - 2 registers share a single word */
+	if (e->n == 2 && e->type[0] == ADDR_REGISTER && e->type[1] == ADDR_REGISTER) {
+		fprintf(f, " r%d, r%d\n", d->words[pos + 1] >> 6, (d->words[pos + 1] >> 2) & 15);
+		return e->size;
+	}
+
+	w = pos + 1;
+	for (i = 0; i < e->n; i++) {
+		fprintf(f, (i == 0) ? " " : ", ");
+		if (i == 0 && e->n == 2 && e->type[0] == ADDR_REGISTER) {
+			fprintf(f, "r%d", (d->words[w++] >> 6) & 15); /* Source register, in bits 6-9 */
+		} else {
+			w += disasm_operand(d, w, e->type[i], f);
+		}
+	}
+	fprintf(f, "\n");
+	return e->size;
+}
+
+/*This method returns the number of words of the .string that starts at w and ends
+ * before end, or 0 if there is none*/
+int disasm_string(const disasm_t *d, int w, int end)
+{
+	int i;
+
+	for (i = w; i < end && i - w < DISASM_MAX_STRING; i++) {
+		if (d->words[i] == 0) {
+			return (i > w) ? i - w + 1 : 0;
+		}
+		if (d->words[i] < ' ' || d->words[i] > '~' || d->words[i] == '"') {
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/*This method writes the data words from w up to the next label as .string and .data lines*/
+void disasm_data(const disasm_t *d, int w, int end, FILE *f)
+{
+	int n, i;
+
+	disasm_line_label(d, w, f);
+	while (w < end) {
+		n = disasm_string(d, w, end);
+		if (n > 0) {
+			fprintf(f, ".string \"");
+			for (i = 0; i < n - 1; i++) {
+				fputc(d->words[w + i], f);
+			}
+			fprintf(f, "\"\n");
+		} else {
+			fprintf(f, ".data ");
+			for (n = 0; w + n < end && n < DISASM_LINE_WORDS && (n == 0 || disasm_string(d, w + n, end) == 0); n++) {
+				fprintf(f, (n == 0) ? "%d" : ", %d", disasm_number(d->words[w + n]));
+			}
+			fprintf(f, "\n");
+		}
+		w += n;
+		if (w < end) {
+			fprintf(f, "\t");
+		}
+	}
+}
+
+/*This method adds the labels of the .ent and the uses of the .ext of the module*/
+void disasm_symbols(disasm_t *d)
+{
+	const object_symbol_t *s;
+	int w, i;
+
+	for (i = 0; i < d->state.nentries; i++) {
+		s = &d->state.entries[i];
+		w = s->address - ASSEMBLY_CODE_START_ADDRESS;
+		if (w >= 0 && w < d->nwords && d->labels[w] == NULL) {
+			d->labels[w] = s->name;
+		}
+	}
+	for (i = 0; i < d->state.nexterns; i++) {
+		s = &d->state.externs[i];
+		w = s->address - ASSEMBLY_CODE_START_ADDRESS;
+		if (w >= 0 && w < d->nwords) {
+			d->externs[w] = s->name;
+		}
+	}
+}
+
+/*This method writes the .entry and .extern lines of the module*/
+void disasm_directives(const disasm_t *d, FILE *f)
+{
+	int i, j;
+
+	for (i = 0; i < d->nwords; i++) {
+		if (d->labels[i] != NULL) {
+			fprintf(f, ".entry %s\n", d->labels[i]);
+		}
+	}
+	for (i = 0; i < d->state.nexterns; i++) {
+		for (j = 0; j < i && strcmp(d->state.externs[j].name, d->state.externs[i].name) != 0; j++)
+			;
+		if (j == i) {
+			fprintf(f, ".extern %s\n", d->state.externs[i].name);
+		}
+	}
+}
+
+/*This method disassembles a module (<name>.obb, or <name>.ob with .ent and .ext) to
+ * <name>.dis, a source that assembles back to the same words. The labels of the entries and
+ * externals keep their names, the other labels are named after their address
+ * returns 0 in case of success and -1 otherwise*/
+int disasm_file(disasm_t *d, const char *filename, io_ctx_t *io)
+{
+	static const assembler_options_t options;
+	char path[MAX_PATH];
+	int known, end, w;
+	FILE *f;
+
+	memset(d, 0, sizeof(*d));
+	d->state.filename = filename;
+	d->state.options = &options;
+	d->state.errfile = stderr;
+	d->state.io = io;
+
+	if (read_object(&d->state) < 0) {
+		return -1;
+	}
+
+	/* The text .ob does not tell where the code ends, it is read as code */
+	sprintf(path, "%s.%s", filename, OBJECT_EXT);
+	known = (access(path, R_OK) == 0);
+
+	memcpy(d->words, d->state.code, d->state.IC * sizeof(d->words[0]));
+	memcpy(d->words + d->state.IC, d->state.data, d->state.DC * sizeof(d->words[0]));
+	d->nwords = d->state.IC + d->state.DC;
+	disasm_symbols(d);
+	disasm_decode(d, known ? d->state.IC : d->nwords, known);
+
+	f = io_open_output(io, filename, DISASM_EXT);
+	if (f == NULL) {
+		return -1;
+	}
+
+	disasm_directives(d, f);
+	for (w = 0; w < d->code_size; ) {
+		w += disasm_instruction(d, w, f);
+	}
+	for (w = d->code_size; w < d->nwords; w = end) {
+		for (end = w + 1; end < d->nwords && d->labels[end] == NULL && !d->is_target[end]; end++)
+			;
+		disasm_data(d, w, end, f);
+	}
+
+	return io_close_output(io, f);
+}
+
+/*The modules of a run, shared by all the workers*/
+typedef struct disasm_queue {
+	job_list_t      *jobs;
+	int             next;
+	int             failed;
+	pthread_mutex_t lock;
+} disasm_queue_t;
+
+/*This method is the thread function of a worker - it keeps taking modules and disassembling
+ * them until there are none left. Failures are reported through q->failed*/
+void *disasm_worker(void *arg)
+{
+	disasm_queue_t *q = arg;
+	disasm_t *d;
+	io_ctx_t io;
+	int job;
+
+	d = malloc(sizeof(*d));
+	if (d == NULL) {
+		fprintf(stderr, "Failed to allocate disassembler\n");
+		q->failed = 1;
+		return NULL;
+	}
+	io_init(&io, IO_DEFAULT_DEPTH, 1);
+
+	for (;;) {
+		pthread_mutex_lock(&q->lock);
+		job = (q->next < q->jobs->n) ? q->next++ : -1;
+		pthread_mutex_unlock(&q->lock);
+		if (job < 0) {
+			break;
+		}
+
+		if (disasm_file(d, q->jobs->jobs[job].name, &io) < 0) {
+			pthread_mutex_lock(&q->lock);
+			q->failed = 1;
+			pthread_mutex_unlock(&q->lock);
+		}
+	}
+
+	if (io_flush(&io) < 0) {
+		pthread_mutex_lock(&q->lock);
+		q->failed = 1;
+		pthread_mutex_unlock(&q->lock);
+	}
+	io_cleanup(&io);
+	free(d);
+	return NULL;
+}
+
+/*This method is the main of the disassembler - disassembles the modules given in the
+ * command line (directly, listed in @manifest files, or every module of a directory),
+ * each of them to <name>.dis, with a pool of -j worker threads*/
+int main(int argc, char *argv[])
+{
+	disasm_queue_t q;
+	pthread_t *threads;
+	job_list_t modules;
+	struct stat st;
+	int error_flag;
+	int jobs, n;
+	int i;
+
+	jobs = 1;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strncmp(argv[i], "-j", 2) == 0 && (argv[i][2] != '\0' || i + 1 < argc)) {
+			jobs = atoi((argv[i][2] != '\0') ? argv[i] + 2 : argv[++i]);
+		} else {
+			break;
+		}
+	}
+	if (i == argc || jobs < 1) {
+		fprintf(stderr, "Usage: %s [-j jobs] module...\n", argv[0]);
+		return 1;
+	}
+
+	jobs_init(&modules);
+	error_flag = 0;
+	for (; i < argc; i++) {
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			if (jobs_add_directory(&modules, argv[i], "ob") < 0 ||
+				jobs_add_directory(&modules, argv[i], OBJECT_EXT) < 0) {
+				error_flag = 1;
+			}
+		} else if (jobs_add_argument(&modules, argv[i]) < 0) {
+			error_flag = 1;
+		}
+	}
+	jobs_schedule(&modules, 1); /* A module with both a .ob and a .obb is listed once */
+
+	decode_init();
+
+	q.jobs = &modules;
+	q.next = 0;
+	q.failed = 0;
+	pthread_mutex_init(&q.lock, NULL);
+
+	if (jobs > modules.n) {
+		jobs = modules.n;
+	}
+	threads = (jobs > 1) ? malloc(jobs * sizeof(*threads)) : NULL;
+	n = 0;
+	if (threads != NULL) {
+		for (n = 0; n < jobs; n++) {
+			if (pthread_create(&threads[n], NULL, disasm_worker, &q) != 0) {
+				break;
+			}
+		}
+	}
+	if (n == 0) {
+		disasm_worker(&q);
+	}
+	for (i = 0; i < n; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	pthread_mutex_destroy(&q.lock);
+	jobs_free(&modules);
+	return (error_flag || q.failed) ? 1 : 0;
+}
@@ -0,0 +1,34 @@
+
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include "assembler.h"
+
+#define ENCODING_OPCODES        16
+#define ENCODING_MODES          4
+#define ENCODING_MAX_WORDS      5 /* The first word and two struct operands */
+#define ENCODING_NO_WORD        ENCODING_MAX_WORDS /* Where the value of a missing operand goes */
+#define ENCODING_LEGAL_1ST      BIT(0)
+#define ENCODING_LEGAL_2ND      BIT(1)
+#define ENCODING_LEGAL          (ENCODING_LEGAL_1ST | ENCODING_LEGAL_2ND)
+
+/*How an instruction of an opcode and addressing modes is encoded. The value of every
+ * operand (immediate, register or field number) is shifted into its word, the two
+ * registers of a register pair into the same one, and an address is patched into the
+ * relocated word when the label is resolved*/
+typedef struct encoding {
+	unsigned char legal;    /* ENCODING_LEGAL_* of the operands that may have these modes */
+	unsigned char size;     /* Number of words */
+	short         first;    /* The first word - opcode and addressing modes */
+	unsigned char word[2];  /* Word of the value of each operand */
+	unsigned char shift[2];
+	unsigned char reloc[2]; /* Word of the address of each direct or struct operand */
+} encoding_t;
+
+/*By opcode and the modes of the 1st and 2nd operands (0 for a missing operand). It is
+ * generated from INSTRUCTIONS by gen_encoding when the assembler is built*/
+extern const encoding_t encoding_table[ENCODING_OPCODES][ENCODING_MODES][ENCODING_MODES];
+
+#define encoding_of(insn) (&encoding_table[(insn)->opcode][(insn)->type[0]][(insn)->type[1]])
+
+#endif
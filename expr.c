@@ -0,0 +1,281 @@
+#include "assembler.h"
+#include "symtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+
+/*A constant expression being evaluated - the text is read left to right, once*/
+typedef struct expr {
+	assembler_state_t *state;
+	const char        *p;
+} expr_t;
+
+long expr_sum(expr_t *e, int *ret);
+
+/*This method applies an operation to two values, both in the range of int, and checks
+ * that the result is in the range of int too - before it is computed, so the arithmetic
+ * never overflows
+ * returns the result, *ret is set to -1 in case of failure*/
+long expr_apply(expr_t *e, char op, long a, long b, int *ret)
+{
+	int overflow;
+
+	switch (op) {
+	case '+':
+		overflow = (b > 0 && a > INT_MAX - b) || (b < 0 && a < INT_MIN - b);
+		break;
+	case '-':
+		overflow = (b < 0 && a > INT_MAX + b) || (b > 0 && a < INT_MIN + b);
+		break;
+	case '*':
+		if (a > 0) {
+			overflow = (b > 0) ? a > INT_MAX / b : b < INT_MIN / a;
+		} else {
+			overflow = (b > 0) ? a < INT_MIN / b : (a != 0 && b < INT_MAX / a);
+		}
+		break;
+	default: /* '/' and '%', the divisor is not 0 */
+		overflow = (a == INT_MIN && b == -1);
+		break;
+	}
+
+	if (overflow) {
+		fprintf(e->state->errfile, "Value out of range, line %d\n", e->state->line_number);
+		*ret = -1;
+		return 0;
+	}
+
+	switch (op) {
+	case '+':
+		return a + b;
+	case '-':
+		return a - b;
+	case '*':
+		return a * b;
+	case '/':
+		return a / b;
+	}
+	return a % b;
+}
+
+/*This method reads a name at the current place of the expression to name
+ * returns 0 in case of success and -1 if there is no name or it is too long*/
+int expr_name(expr_t *e, char *name)
+{
+	int len;
+
+	if (!isalpha(*e->p)) {
+		return -1;
+	}
+	for (len = 0; isalnum(e->p[len]); len++) {
+		if (len == MAX_LABEL_LENGTH - 1) {
+			fprintf(e->state->errfile, "The label is too long, line %d\n", e->state->line_number);
+			return -1;
+		}
+		name[len] = e->p[len];
+	}
+	name[len] = '\0';
+	e->p += len;
+	return 0;
+}
+
+/*This method finds the number of data words of the directive a label is on, not counting
+ * the '\0' that ends a .string - the length of a .string label
+ * returns 0 in case of success and -1 otherwise*/
+int expr_length(expr_t *e, const char *name, long *length)
+{
+	const data_block_t *b;
+	int id, i;
+
+	id = symtab_find(&e->state->symbols, name);
+	if (id < 0 || symtab_symbol(&e->state->symbols, id)->type != SYMBOL_TYPE_DATA) {
+		fprintf(e->state->errfile, "No data label %s before, line %d\n", name, e->state->line_number);
+		return -1;
+	}
+
+	for (i = 0; i < e->state->ndata_blocks && i < LENGTH_MEMORY; i++) {
+		b = &e->state->data_blocks[i];
+		if (b->symbol == id) {
+			*length = b->size - b->is_string;
+			return 0;
+		}
+	}
+
+	fprintf(e->state->errfile, "No data label %s before, line %d\n", name, e->state->line_number);
+	return -1;
+}
+
+/*This method evaluates a number, a constant, length(LABEL), a signed operand or an
+ * expression in parentheses
+ * returns the value, *ret is set to -1 in case of failure*/
+long expr_operand(expr_t *e, int *ret)
+{
+	char name[MAX_LABEL_LENGTH];
+	char *end;
+	long value;
+	int id;
+
+	if (*e->p == '-' || *e->p == '+') {
+		value = (*(e->p++) == '-') ? expr_apply(e, '-', 0, expr_operand(e, ret), ret) : expr_operand(e, ret);
+		return value;
+	}
+
+	if (*e->p == '(') {
+		e->p++;
+		value = expr_sum(e, ret);
+		if (*e->p != ')') {
+			fprintf(e->state->errfile, "Missing ), line %d\n", e->state->line_number);
+			*ret = -1;
+			return 0;
+		}
+		e->p++;
+		return value;
+	}
+
+	if (isdigit(*e->p)) {
+		value = strtol(e->p, &end, 10);
+		e->p = end;
+		if (value > INT_MAX) {
+			fprintf(e->state->errfile, "Value out of range, line %d\n", e->state->line_number);
+			*ret = -1;
+			return 0;
+		}
+		return value;
+	}
+
+	if (expr_name(e, name) < 0) {
+		fprintf(e->state->errfile, "Invalid numeric value, line %d\n", e->state->line_number);
+		*ret = -1;
+		return 0;
+	}
+
+	if (strcmp(name, "length") == 0 && *e->p == '(') {
+		e->p++;
+		if (expr_name(e, name) < 0 || *e->p != ')') {
+			fprintf(e->state->errfile, "Invalid length, line %d\n", e->state->line_number);
+			*ret = -1;
+			return 0;
+		}
+		e->p++;
+		if (expr_length(e, name, &value) < 0) {
+			*ret = -1;
+			return 0;
+		}
+		return value;
+	}
+
+	/* In LABEL.field the fields of the struct type come before the constants */
+	value = struct_field_number(e->state, name);
+	if (value > 0) {
+		return value;
+	}
+
+	id = symtab_find(&e->state->symbols, name);
+	if (id < 0 || symtab_symbol(&e->state->symbols, id)->type != SYMBOL_TYPE_CONSTANT) {
+		fprintf(e->state->errfile, "Undefined constant %s, line %d\n", name, e->state->line_number);
+		*ret = -1;
+		return 0;
+	}
+	return symtab_symbol(&e->state->symbols, id)->index;
+}
+
+/*This method evaluates a product - operands joined by '*', '/' and '%'
+ * returns the value, *ret is set to -1 in case of failure*/
+long expr_product(expr_t *e, int *ret)
+{
+	long value, operand;
+	char op;
+
+	value = expr_operand(e, ret);
+	while (*ret == 0 && (*e->p == '*' || *e->p == '/' || *e->p == '%')) {
+		op = *(e->p++);
+		operand = expr_operand(e, ret);
+		if (*ret < 0) {
+			break;
+		}
+		if (op != '*' && operand == 0) {
+			fprintf(e->state->errfile, "Division by zero, line %d\n", e->state->line_number);
+			*ret = -1;
+		} else {
+			value = expr_apply(e, op, value, operand, ret);
+		}
+	}
+	return value;
+}
+
+/*This method evaluates a sum - products joined by '+' and '-'
+ * returns the value, *ret is set to -1 in case of failure*/
+long expr_sum(expr_t *e, int *ret)
+{
+	long value, operand;
+	char op;
+
+	value = expr_product(e, ret);
+	while (*ret == 0 && (*e->p == '+' || *e->p == '-')) {
+		op = *(e->p++);
+		operand = expr_product(e, ret);
+		if (*ret == 0) {
+			value = expr_apply(e, op, value, operand, ret);
+		}
+	}
+	return value;
+}
+
+/*This method evaluates a constant expression, as an immediate or a number of .data takes:
+ * numbers, constants of .equ and length(LABEL) of a data label defined before, with
+ * + - * / %, signs and parentheses, and no spaces
+ * returns 0 in case of success and -1 otherwise*/
+int expr_evaluate(assembler_state_t *state, const char *str, int *number)
+{
+	expr_t e;
+	long value;
+	int ret;
+
+	e.state = state;
+	e.p = str;
+	ret = 0;
+
+	value = expr_sum(&e, &ret);
+	if (ret < 0) {
+		return ret;
+	}
+	if (*e.p != '\0') {
+		fprintf(state->errfile, "Invalid numeric value, line %d\n", state->line_number);
+		return -1;
+	}
+
+	*number = value;
+	return 0;
+}
+
+/*This method checks quickly if a source may use constants, which must be defined before
+ * they are used - of .equ, or the struct types of .structdef
+ * returns 1 if it may and 0 if it does not*/
+int expr_in_buffer(const char *buf, long len)
+{
+	const char *p, *end;
+
+	end = buf + len;
+	for (p = buf; p + 4 <= end; p++) {
+		p = memchr(p, '.', end - p - 3);
+		if (p == NULL) {
+			break;
+		}
+		if (!memcmp(p, ".equ", 4) || (p + 10 <= end && !memcmp(p, ".structdef", 10))) {
+			return 1;
+		}
+	}
+	for (p = buf; p + 7 <= end; p++) {
+		p = memchr(p, 'l', end - p - 6);
+		if (p == NULL) {
+			return 0;
+		}
+		if (!memcmp(p, "length(", 7)) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,128 @@
+#include "assembler.h"
+#include "encoding.h"
+
+#include <string.h>
+#include <stdio.h>
+
+/*An instruction of INSTRUCTIONS, as ops[] has it*/
+typedef struct gen_instruction {
+	const char *name;
+	int        opcode;
+	int        legal_1st;
+	int        legal_2nd;
+	int        n;
+} gen_instruction_t;
+
+#define GEN_INSTRUCTION(name, opcode, legal_1st, legal_2nd, n) {name, opcode, legal_1st, legal_2nd, n},
+
+gen_instruction_t gen_instructions[] = {
+	INSTRUCTIONS(GEN_INSTRUCTION)
+	{NULL, -1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, 0}
+};
+
+/*This method finds how an instruction with operands of the given modes is encoded - the
+ * same words encode_instruction() emitted operand by operand*/
+void gen_encoding(const gen_instruction_t *insn, int mode[2], encoding_t *e)
+{
+	int next, i;
+
+	memset(e, 0, sizeof(*e));
+	e->legal = ((insn->n < 1 && mode[0] == 0) || (insn->n >= 1 && (BIT(mode[0]) & insn->legal_1st)) ?
+				ENCODING_LEGAL_1ST : 0) |
+			   ((insn->n < 2 && mode[1] == 0) || (insn->n >= 2 && (BIT(mode[1]) & insn->legal_2nd)) ?
+				ENCODING_LEGAL_2ND : 0);
+
+	if (insn->n == 1) {
+		e->first = mode[0] << 2; /* A single operand is the destination */
+	} else if (insn->n == 2) {
+		e->first = (mode[0] << 4) | (mode[1] << 2);
+	}
+	e->first |= insn->opcode << 6;
+
+	next = 1;
+	for (i = 0; i < 2; i++) {
+		e->word[i] = ENCODING_NO_WORD;
+		e->reloc[i] = ENCODING_NO_WORD;
+		e->shift[i] = 2;
+		if (i >= insn->n) {
+			continue;
+		}
+		switch (mode[i]) {
+		case ADDR_IMMEDIATE:
+			e->word[i] = next++;
+			break;
+		case ADDR_DIRECT:
+			e->reloc[i] = next++;
+			break;
+		case ADDR_STRUCT:
+			e->reloc[i] = next++;
+			e->word[i] = next++; /* The field number */
+			break;
+		case ADDR_REGISTER:
+			if (insn->n == 2 && i == 1 && mode[0] == ADDR_REGISTER) {
+				e->word[i] = next - 1; /* A register pair shares a word */
+			} else {
+				e->word[i] = next++;
+			}
+			if (insn->n == 2 && i == 0) {
+				e->shift[i] = 6; /* Source register */
+			}
+			break;
+		}
+	}
+	e->size = next;
+}
+
+/*This method is the main of gen_encoding - writes encoding_table (see encoding.h) as C
+ * to the file given in the command line*/
+int main(int argc, char *argv[])
+{
+	const gen_instruction_t *insn;
+	encoding_t e;
+	int mode[2];
+	FILE *out;
+	int opcode;
+
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s output.c\n", argv[0]);
+		return 1;
+	}
+	out = fopen(argv[1], "w");
+	if (out == NULL) {
+		fprintf(stderr, "Cannot open file %s for writing\n", argv[1]);
+		return 1;
+	}
+
+	fprintf(out, "/*Generated by gen_encoding from INSTRUCTIONS in assembler.h - do not edit*/\n");
+	fprintf(out, "#include \"encoding.h\"\n\n");
+	fprintf(out, "const encoding_t encoding_table[ENCODING_OPCODES][ENCODING_MODES][ENCODING_MODES] = {\n");
+	for (opcode = 0; opcode < ENCODING_OPCODES; opcode++) {
+		for (insn = gen_instructions; insn->name != NULL && insn->opcode != opcode; insn++)
+			;
+		if (insn->name == NULL) {
+			fprintf(stderr, "No instruction of opcode %d\n", opcode);
+			fclose(out);
+			return 1;
+		}
+
+		fprintf(out, "\t{ /* %s */\n", insn->name);
+		for (mode[0] = 0; mode[0] < ENCODING_MODES; mode[0]++) {
+			fprintf(out, "\t\t{");
+			for (mode[1] = 0; mode[1] < ENCODING_MODES; mode[1]++) {
+				gen_encoding(insn, mode, &e);
+				fprintf(out, "{%d, %d, 0x%03x, {%d, %d}, {%d, %d}, {%d, %d}}%s", e.legal, e.size, e.first,
+						e.word[0], e.word[1], e.shift[0], e.shift[1], e.reloc[0], e.reloc[1],
+						(mode[1] + 1 < ENCODING_MODES) ? ", " : "");
+			}
+			fprintf(out, "}%s\n", (mode[0] + 1 < ENCODING_MODES) ? "," : "");
+		}
+		fprintf(out, "\t}%s\n", (opcode + 1 < ENCODING_OPCODES) ? "," : "");
+	}
+	fprintf(out, "};\n");
+
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Cannot write file %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,379 @@
+#include "assembler.h"
+#include "symtable.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/*An included file, parsed once on its own. Its instructions are not encoded - they are
+ * spliced into every source that includes it, and encoded there. The files it includes
+ * itself are in state->includes*/
+typedef struct include_file include_file_t;
+struct include_file {
+	char              path[MAX_PATH];
+	struct stat       st;      /* To notice when the file changes */
+	assembler_state_t *state;
+	char              *errors; /* Diagnostics of the parse */
+	size_t            errors_size;
+	int               ret;
+	include_file_t    *next;
+};
+
+/*The files included so far in this run, shared by all the threads*/
+include_file_t *include_cache = NULL;
+pthread_mutex_t include_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*This method writes the path of the source a state is assembling*/
+void include_source_path(const assembler_state_t *state, char *path)
+{
+	if (state->includer == NULL) {
+		sprintf(path, "%.*s.as", MAX_PATH - 4, state->filename);
+	} else {
+		strcpy(path, state->filename);
+	}
+}
+
+/*This method forms the path of an included file - relative to the directory of the source
+ * that includes it
+ * returns 0 in case of success and -1 if it is too long*/
+int include_resolve(const assembler_state_t *state, const char *name, char *path)
+{
+	const char *slash;
+	int dirlen;
+
+	slash = strrchr(state->filename, '/');
+	dirlen = (name[0] == '/' || slash == NULL) ? 0 : slash - state->filename + 1;
+	if (dirlen + strlen(name) >= MAX_PATH) {
+		fprintf(state->errfile, "File name %s is too long, line %d\n", name, state->line_number);
+		return -1;
+	}
+
+	sprintf(path, "%.*s%s", dirlen, state->filename, name);
+	return 0;
+}
+
+/*This method checks if a file is still the same as it was when it was stat()ed
+ * returns 1 if it is and 0 if it changed*/
+int include_same_file(const struct stat *then, const struct stat *now)
+{
+	return then->st_mtim.tv_sec == now->st_mtim.tv_sec && then->st_mtim.tv_nsec == now->st_mtim.tv_nsec &&
+		   then->st_size == now->st_size && then->st_ino == now->st_ino && then->st_dev == now->st_dev;
+}
+
+/*This method checks if a cached file, or any file it includes, changed since it was parsed
+ * returns 1 if one did and 0 otherwise*/
+int include_changed(const include_file_t *f, const struct stat *st)
+{
+	const include_dep_t *d;
+	struct stat now;
+
+	if (!include_same_file(&f->st, st)) {
+		return 1;
+	}
+	for (d = f->state->includes; d != NULL; d = d->next) {
+		if (stat(d->path, &now) < 0 || !include_same_file(&d->st, &now)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*This method adds an included file to the ones the source depends on, unless it is
+ * there already
+ * returns 0 in case of success and -1 otherwise*/
+int include_add_dep(assembler_state_t *state, const char *path, const struct stat *st)
+{
+	include_dep_t *d, **p;
+
+	for (p = &state->includes; *p != NULL; p = &(*p)->next) {
+		if (strcmp((*p)->path, path) == 0) {
+			return 0;
+		}
+	}
+
+	d = malloc(sizeof(*d));
+	if (d == NULL) {
+		fprintf(state->errfile, "Failed to allocate include %s\n", path);
+		return -1;
+	}
+	strcpy(d->path, path);
+	d->st = *st;
+	d->next = NULL;
+	*p = d;
+	return 0;
+}
+
+/*This method adds an included file and all the files it includes to the ones the
+ * source depends on
+ * returns 0 in case of success and -1 otherwise*/
+int include_add_deps(assembler_state_t *state, const include_file_t *f)
+{
+	const include_dep_t *d;
+
+	if (include_add_dep(state, f->path, &f->st) < 0) {
+		return -1;
+	}
+	for (d = f->state->includes; d != NULL; d = d->next) {
+		if (include_add_dep(state, d->path, &d->st) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*This method frees a cached file*/
+void include_free(include_file_t *f)
+{
+	if (f->state != NULL) {
+		cleanup_state(f->state);
+		free(f->state);
+	}
+	free(f->errors);
+	free(f);
+}
+
+/*This method parses an included file on its own, the same way generate_from_buffer() does
+ * but without encoding. Files it includes are spliced into it
+ * returns the parsed file or NULL in case of failure*/
+include_file_t *include_parse(const assembler_state_t *includer, const char *path, const struct stat *st)
+{
+	char line[MAX_LINE_LENGTH];
+	include_file_t *f;
+	char *buf;
+	long len, pos;
+	FILE *in;
+
+	f = calloc(1, sizeof(*f));
+	if (f == NULL || (f->state = malloc(sizeof(*f->state))) == NULL) {
+		fprintf(includer->errfile, "Failed to allocate include %s\n", path);
+		free(f);
+		return NULL;
+	}
+	strcpy(f->path, path);
+	f->st = *st;
+
+	in = fopen(path, "r");
+	buf = malloc(st->st_size + 1);
+	len = (in != NULL && buf != NULL) ? (long)fread(buf, 1, st->st_size, in) : -1;
+	if (in != NULL) {
+		fclose(in);
+	}
+	if (len < 0) {
+		fprintf(includer->errfile, "Cannot open file %s for reading\n", path);
+		free(buf);
+		free(f->state);
+		free(f);
+		return NULL;
+	}
+
+	init_state(f->state, f->path, includer->options);
+	f->state->includer = includer;
+	f->state->errfile = open_memstream(&f->errors, &f->errors_size);
+	if (f->state->errfile == NULL) {
+		f->state->errfile = stderr;
+	}
+
+	pos = 0;
+	while (get_line(line, MAX_LINE_LENGTH, buf, len, &pos)) {
+		f->state->line_number++;
+		if (assemble_line(f->state, line) < 0) {
+			f->ret = -1;
+		}
+	}
+	free(buf);
+	if (macro_finish(f->state) < 0) {
+		f->ret = -1;
+	}
+
+	if (f->state->errfile != stderr) {
+		fclose(f->state->errfile);
+	}
+	f->state->errfile = NULL;
+	f->state->includer = NULL; /* Only valid during the parse */
+	return f;
+}
+
+/*This method copies the symbols of an included file to the source, in the order they were
+ * first seen, the same as symtab_merge() does
+ * returns 0 in case of success and -1 otherwise*/
+int include_splice_symbols(assembler_state_t *state, const symtab_t *src, int ic, int dc)
+{
+	const symbol_t *s;
+	int error_flag;
+	int id, d;
+
+	error_flag = 0;
+	for (id = 0; id < src->n; id++) {
+		s = symtab_symbol(src, id);
+		if (s->type == SYMBOL_TYPE_CONSTANT &&
+			symtab_new_constant(&state->symbols, symtab_name(src, id), s->index, state) < 0) {
+			error_flag = -1;
+		} else if (s->type != SYMBOL_TYPE_UNKNOWN && s->type != SYMBOL_TYPE_CONSTANT &&
+			symtab_new_label(&state->symbols, symtab_name(src, id), s->type, s->index + ic, s->index + dc, state) < 0) {
+			error_flag = -1;
+		}
+		d = symtab_new_operand(&state->symbols, symtab_name(src, id));
+		if (d < 0) {
+			return -1;
+		}
+		symtab_symbol(&state->symbols, d)->is_entry |= s->is_entry;
+	}
+	return error_flag;
+}
+
+/*This method adds what an included file produced to the source, as if its lines were
+ * written in place of the .include line. The file is left as it is, for the next include
+ * returns 0 in case of success and -1 otherwise*/
+int include_splice(assembler_state_t *state, const include_file_t *f)
+{
+	const assembler_state_t *src = f->state;
+	instruction_t *insn, dummy;
+	data_block_t *b;
+	int ic, dc, types;
+	int error_flag;
+	int i, j;
+
+	if (f->ret < 0) {
+		fprintf(state->errfile, "In %s, included at line %d:\n", f->path, state->line_number);
+		fwrite(f->errors, 1, f->errors_size, state->errfile);
+		return -1;
+	}
+
+	ic = state->IC;
+	dc = state->DC;
+	types = state->nstruct_types;
+
+	error_flag = include_splice_symbols(state, &src->symbols, ic, dc);
+
+	for (i = 0; i < src->ninstructions && i < LENGTH_MEMORY; i++) {
+		insn = (state->ninstructions < LENGTH_MEMORY) ? &state->instructions[state->ninstructions] : &dummy;
+		*insn = src->instructions[i];
+		insn->line_number = state->line_number;
+		for (j = 0; j < insn->n; j++) {
+			if (insn->symbol[j] >= 0) {
+				insn->symbol[j] = symtab_new_operand(&state->symbols, symtab_name(&src->symbols, insn->symbol[j]));
+				if (insn->symbol[j] < 0) {
+					return -1;
+				}
+			}
+			/* A field waiting for the type of its label, see struct_resolve() */
+			if (insn->type[j] == ADDR_STRUCT && insn->value[j] < 0) {
+				if (state->nstruct_fields == LENGTH_MEMORY) {
+					fprintf(state->errfile, "Too many struct fields, line %d\n", state->line_number);
+					return -1;
+				}
+				strcpy(state->struct_fields[state->nstruct_fields++], src->struct_fields[-insn->value[j] - 1]);
+				insn->value[j] = -state->nstruct_fields;
+			}
+		}
+		state->ninstructions++;
+	}
+	state->IC += src->IC;
+
+	if (macro_copy(state, src) < 0) {
+		error_flag = -1;
+	}
+	if (struct_copy(state, src) < 0) {
+		error_flag = -1;
+	}
+
+	for (i = 0; i < src->DC && i < LENGTH_MEMORY; i++) {
+		emit_data(state, src->data[i]);
+	}
+	state->DC = dc + src->DC;
+
+	for (i = 0; i < src->ndata_blocks && i < LENGTH_MEMORY; i++) {
+		if (state->ndata_blocks < LENGTH_MEMORY) {
+			b = &state->data_blocks[state->ndata_blocks];
+			*b = src->data_blocks[i];
+			b->dc += dc;
+			if (b->struct_type >= 0) {
+				b->struct_type += types;
+			}
+			if (b->symbol >= 0) {
+				b->symbol = symtab_find(&state->symbols, symtab_name(&src->symbols, b->symbol));
+			}
+		}
+		state->ndata_blocks++;
+	}
+
+	return error_flag;
+}
+
+/*This method includes a file in the source. A file is parsed only the first time it is
+ * included in the run (or after it, or a file it includes, changes), later includes splice
+ * the parsed result
+ * returns 0 in case of success and -1 otherwise*/
+int include_file(assembler_state_t *state, const char *name)
+{
+	char path[MAX_PATH], source[MAX_PATH];
+	const assembler_state_t *s;
+	include_file_t *f, *parsed, **p;
+	struct stat st;
+	int ret;
+
+	if (include_resolve(state, name, path) < 0) {
+		return -1;
+	}
+
+	for (s = state; s != NULL; s = s->includer) {
+		include_source_path(s, source);
+		if (strcmp(source, path) == 0) {
+			fprintf(state->errfile, "Include of %s is cyclic, line %d\n", path, state->line_number);
+			return -1;
+		}
+	}
+
+	if (stat(path, &st) < 0) {
+		fprintf(state->errfile, "Cannot open file %s for reading, line %d\n", path, state->line_number);
+		return -1;
+	}
+
+	parsed = NULL;
+	for (;;) {
+		pthread_mutex_lock(&include_lock);
+		for (p = &include_cache; *p != NULL && strcmp((*p)->path, path) != 0; p = &(*p)->next)
+			;
+		f = *p;
+		if (f != NULL && include_changed(f, &st)) {
+			/* It, or a file it includes, changed since it was parsed */
+			*p = f->next;
+			include_free(f);
+			f = NULL;
+		}
+		if (f == NULL && parsed != NULL && parsed->ret < 0) {
+			/* Not cached - the errors may depend on the source that includes it (a cycle) */
+			ret = include_add_deps(state, parsed);
+			if (include_splice(state, parsed) < 0) {
+				ret = -1;
+			}
+			pthread_mutex_unlock(&include_lock);
+			include_free(parsed);
+			return ret;
+		} else if (f == NULL && parsed != NULL) {
+			parsed->next = include_cache;
+			include_cache = parsed;
+			f = parsed;
+		} else if (parsed != NULL) {
+			include_free(parsed); /* Another thread parsed it first */
+		}
+
+		if (f != NULL) {
+			/* Under the lock, so a change of the file does not free it in the middle */
+			ret = include_add_deps(state, f);
+			if (include_splice(state, f) < 0) {
+				ret = -1;
+			}
+			pthread_mutex_unlock(&include_lock);
+			return ret;
+		}
+		pthread_mutex_unlock(&include_lock);
+
+		parsed = include_parse(state, path, &st);
+		if (parsed == NULL) {
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,668 @@
+#include "incr.h"
+#include "symtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+/*A diagnostic of the whole source, printed in line order*/
+typedef struct incr_diag {
+	int        number;
+	const char *text;
+	char       *owned; /* text, when it was formatted here */
+} incr_diag_t;
+
+/*This method initializes an empty source*/
+void incr_init(incr_t *e, const assembler_options_t *options)
+{
+	int i;
+
+	e->lines = NULL;
+	e->n = 0;
+	e->capacity = 0;
+	e->IC = 0;
+	e->DC = 0;
+	e->nconstants = 0;
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		e->globals[i] = NULL;
+	}
+	e->options = options;
+}
+
+/*This method frees a line and its cached result*/
+void incr_free_line(incr_line_t *line)
+{
+	free(line->text);
+	free(line->symbols);
+	free(line->errors);
+	free(line);
+}
+
+/*This method frees the source*/
+void incr_free(incr_t *e)
+{
+	incr_global_t *g;
+	int i;
+
+	for (i = 0; i < e->n; i++) {
+		incr_free_line(e->lines[i]);
+	}
+	free(e->lines);
+
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		while (e->globals[i] != NULL) {
+			g = e->globals[i];
+			e->globals[i] = g->next;
+			free(g);
+		}
+	}
+	incr_init(e, e->options);
+}
+
+/*This method gives the state a line is assembled in the constants that the lines before
+ * it define, as the batch assembler would have them when it gets to the line. A line of
+ * .struct or LABEL.field is also given the struct types - their lines are assembled again
+ * returns 0 in case of success and -1 otherwise*/
+int incr_seed_constants(incr_t *e, incr_line_t *line, assembler_state_t *state)
+{
+	char piece[MAX_LINE_LENGTH];
+	incr_symbol_t *sym, *def;
+	incr_global_t *g;
+	long pos;
+	int i;
+
+	for (i = 0; e->nconstants > 0 && strchr(line->text, '.') != NULL && i < line->number - 1; i++) {
+		pos = 0;
+		if (!e->lines[i]->error && strstr(e->lines[i]->text, ".structdef") != NULL &&
+			get_line(piece, MAX_LINE_LENGTH, e->lines[i]->text, strlen(e->lines[i]->text), &pos) &&
+			assemble_line(state, piece) < 0) {
+			return -1;
+		}
+	}
+
+	for (i = 0; e->nconstants > 0 && i < SYMBOL_HASH_SIZE; i++) {
+		for (g = e->globals[i]; g != NULL; g = g->next) {
+			def = NULL;
+			for (sym = g->uses; sym != NULL; sym = sym->next) {
+				if (sym->type == SYMBOL_TYPE_CONSTANT && sym->line->number < line->number &&
+					(def == NULL || sym->line->number < def->line->number)) {
+					def = sym;
+				}
+			}
+			if (def != NULL && symtab_find(&state->symbols, g->name) < 0 &&
+				symtab_new_constant(&state->symbols, g->name, def->index, state) < 0) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*This method assembles a single line on its own, with local counters and symbols,
+ * and keeps everything it produced in the line. A line longer than fgets() would
+ * read is assembled in pieces, as the batch assembler does.
+ * returns 0 in case of success and -1 otherwise*/
+int incr_parse_line(incr_t *e, incr_line_t *line)
+{
+	char piece[MAX_LINE_LENGTH];
+	assembler_state_t state;
+	incr_symbol_t *sym;
+	relocation_t *r;
+	size_t errors_size;
+	symbol_t *s;
+	int id, nseeded;
+	long pos, len;
+
+	free(line->errors);
+	free(line->symbols);
+	line->errors = NULL;
+	line->symbols = NULL;
+	line->error = 0;
+
+	init_state(&state, "", e->options);
+	state.errfile = open_memstream(&line->errors, &errors_size);
+	if (state.errfile == NULL) {
+		fprintf(stderr, "Failed to allocate line diagnostics\n");
+		return -1;
+	}
+	state.line_number = line->number;
+	line->parsed_number = line->number;
+
+	if (incr_seed_constants(e, line, &state) < 0) {
+		fclose(state.errfile);
+		cleanup_state(&state);
+		return -1;
+	}
+	nseeded = state.symbols.n;
+
+	pos = 0;
+	len = strlen(line->text);
+	do {
+		if (!get_line(piece, MAX_LINE_LENGTH, line->text, len, &pos)) {
+			piece[0] = '\0'; /* An empty line */
+		}
+		if (assemble_line(&state, piece) < 0) {
+			line->error = 1;
+		}
+	} while (pos < len);
+
+	if (struct_resolve(&state) < 0 || encode_instructions(&state) < 0) {
+		line->error = 1;
+	}
+
+	fclose(state.errfile);
+	if (errors_size == 0) {
+		free(line->errors);
+		line->errors = NULL;
+	}
+
+	if (state.IC > LENGTH_MEMORY || state.DC > LENGTH_MEMORY) {
+		state.IC = 0; /* Reported for the whole source */
+		state.DC = 0;
+	}
+	line->IC = state.IC;
+	line->DC = state.DC;
+
+	line->nsymbols = state.symbols.n - nseeded;
+	for (id = 0; id < state.symbols.n; id++) {
+		s = symtab_symbol(&state.symbols, id);
+		/* A constant of a line before is only kept where the line uses it as a label */
+		if (id < nseeded && (s->relocations != NULL || s->is_entry)) {
+			line->nsymbols++;
+		}
+	}
+	line->symbols = calloc(line->nsymbols + 1, sizeof(*line->symbols));
+
+	if (line->symbols == NULL) {
+		fprintf(stderr, "Failed to allocate line\n");
+		cleanup_state(&state);
+		return -1;
+	}
+
+	sym = line->symbols;
+	for (id = 0; id < state.symbols.n; id++) {
+		s = symtab_symbol(&state.symbols, id);
+		if (id < nseeded && s->relocations == NULL && !s->is_entry) {
+			continue;
+		}
+		strcpy(sym->name, symtab_name(&state.symbols, id));
+		sym->type = (id < nseeded) ? SYMBOL_TYPE_UNKNOWN : s->type;
+		sym->index = s->index;
+		sym->is_entry = s->is_entry;
+		sym->line = line;
+		for (r = s->relocations; r != NULL; r = r->next) {
+			sym->nrefs++;
+		}
+		sym++;
+	}
+
+	cleanup_state(&state);
+	return 0;
+}
+
+/*This method finds the global of a name, creating it when it is not found
+ * returns the global or NULL in case of failure*/
+incr_global_t *incr_find_global(incr_t *e, const char *name)
+{
+	incr_global_t *g;
+	int bucket;
+
+	bucket = calc_hash(name);
+	for (g = e->globals[bucket]; g != NULL; g = g->next) {
+		if (!strcmp(g->name, name)) {
+			return g;
+		}
+	}
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL) {
+		fprintf(stderr, "Failed to allocate symbol\n");
+		return NULL;
+	}
+	strcpy(g->name, name);
+	g->next = e->globals[bucket];
+	e->globals[bucket] = g;
+	return g;
+}
+
+/*This method adds the symbols of a line to the globals
+ * returns 0 in case of success and -1 otherwise*/
+int incr_link_line(incr_t *e, incr_line_t *line)
+{
+	incr_symbol_t *sym;
+	incr_global_t *g;
+	int i;
+
+	for (i = 0; i < line->nsymbols; i++) {
+		sym = &line->symbols[i];
+		g = incr_find_global(e, sym->name);
+		if (g == NULL) {
+			return -1;
+		}
+
+		sym->global = g;
+		sym->prev = NULL;
+		sym->next = g->uses;
+		if (g->uses != NULL) {
+			g->uses->prev = sym;
+		}
+		g->uses = sym;
+
+		g->ndefs += (sym->type != SYMBOL_TYPE_UNKNOWN);
+		e->nconstants += (sym->type == SYMBOL_TYPE_CONSTANT);
+		g->nentries += sym->is_entry;
+		g->nrefs += sym->nrefs;
+	}
+	return 0;
+}
+
+/*This method removes the symbols of a line from the globals*/
+void incr_unlink_line(incr_t *e, incr_line_t *line)
+{
+	incr_symbol_t *sym;
+	incr_global_t *g;
+	int i;
+
+	for (i = 0; i < line->nsymbols; i++) {
+		sym = &line->symbols[i];
+		g = sym->global;
+		if (g == NULL) {
+			continue;
+		}
+
+		if (sym->prev != NULL) {
+			sym->prev->next = sym->next;
+		} else {
+			g->uses = sym->next;
+		}
+		if (sym->next != NULL) {
+			sym->next->prev = sym->prev;
+		}
+
+		g->ndefs -= (sym->type != SYMBOL_TYPE_UNKNOWN);
+		e->nconstants -= (sym->type == SYMBOL_TYPE_CONSTANT);
+		g->nentries -= sym->is_entry;
+		g->nrefs -= sym->nrefs;
+		sym->global = NULL;
+	}
+}
+
+/*This method numbers the lines and places their words, a prefix sum of the
+ * code and data of each line*/
+void incr_layout(incr_t *e)
+{
+	incr_line_t *line;
+	int i;
+
+	e->IC = 0;
+	e->DC = 0;
+	for (i = 0; i < e->n; i++) {
+		line = e->lines[i];
+		line->number = i + 1;
+		line->ic = e->IC;
+		line->dc = e->DC;
+		e->IC += line->IC;
+		e->DC += line->DC;
+	}
+}
+
+/*This method replaces nremove lines starting at first with ninsert new lines, and
+ * assembles only the new lines. The lines after them just move.
+ * returns 0 in case of success and -1 otherwise*/
+int incr_edit(incr_t *e, int first, int nremove, char *const lines[], int ninsert)
+{
+	incr_line_t **new_lines, *line;
+	int i, n, nconstants, nremoved;
+
+	if (first < 0 || nremove < 0 || ninsert < 0 || first + nremove > e->n) {
+		fprintf(stderr, "Invalid edit of lines %d-%d\n", first + 1, first + nremove);
+		return -1;
+	}
+
+	n = e->n - nremove + ninsert;
+	if (n > e->capacity) {
+		new_lines = realloc(e->lines, 2 * n * sizeof(*new_lines));
+		if (new_lines == NULL) {
+			fprintf(stderr, "Failed to allocate lines\n");
+			return -1;
+		}
+		e->lines = new_lines;
+		e->capacity = 2 * n;
+	}
+
+	nconstants = e->nconstants;
+	for (i = first; i < first + nremove; i++) {
+		incr_unlink_line(e, e->lines[i]);
+		incr_free_line(e->lines[i]);
+	}
+	nremoved = nconstants - e->nconstants;
+	nconstants = e->nconstants;
+
+	memmove(e->lines + first + ninsert, e->lines + first + nremove,
+			(e->n - first - nremove) * sizeof(*e->lines));
+	e->n = n;
+
+	/* Number the lines after the edit by their new places, so a new line is given the
+	 * constants of the lines before it only */
+	for (i = first + ninsert; i < e->n; i++) {
+		e->lines[i]->number = i + 1;
+	}
+
+	for (i = 0; i < ninsert; i++) {
+		line = calloc(1, sizeof(*line));
+		if (line != NULL) {
+			line->text = malloc(strlen(lines[i]) + 1);
+		}
+		if (line == NULL || line->text == NULL) {
+			fprintf(stderr, "Failed to allocate line\n");
+			free(line);
+			memmove(e->lines + first + i, e->lines + first + ninsert,
+					(e->n - first - ninsert) * sizeof(*e->lines));
+			e->n -= ninsert - i;
+			incr_layout(e);
+			return -1;
+		}
+		strcpy(line->text, lines[i]);
+		line->number = first + i + 1;
+		e->lines[first + i] = line;
+
+		if (incr_parse_line(e, line) < 0 || incr_link_line(e, line) < 0) {
+			e->lines[first + i] = NULL;
+			incr_unlink_line(e, line);
+			incr_free_line(line);
+			memmove(e->lines + first + i, e->lines + first + ninsert,
+					(e->n - first - ninsert) * sizeof(*e->lines));
+			e->n -= ninsert - i;
+			incr_layout(e);
+			return -1;
+		}
+	}
+
+	incr_layout(e);
+
+	/* Diagnostics mention line numbers - refresh the ones that moved. When the edit
+	 * defined or removed a constant, the lines after it may use it - refresh them all */
+	for (i = first + ninsert; i < e->n; i++) {
+		line = e->lines[i];
+		if (nremoved > 0 || e->nconstants > nconstants || (line->errors != NULL && line->parsed_number != line->number)) {
+			incr_unlink_line(e, line);
+			if (incr_parse_line(e, line) < 0 || incr_link_line(e, line) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*This method finds the definition of a global - the first one when it is defined
+ * more than once
+ * returns the defining symbol or NULL if the global is not defined*/
+incr_symbol_t *incr_definition(incr_global_t *g)
+{
+	incr_symbol_t *sym, *def;
+
+	def = NULL;
+	for (sym = g->uses; sym != NULL; sym = sym->next) {
+		if (sym->type != SYMBOL_TYPE_UNKNOWN && (def == NULL || sym->line->number < def->line->number)) {
+			def = sym;
+		}
+	}
+	return def;
+}
+
+/*Orders diagnostics by line*/
+int compare_diags(const void *a, const void *b)
+{
+	const incr_diag_t *da = a, *db = b;
+
+	return da->number - db->number;
+}
+
+/*This method adds a diagnostic of the whole source to the list
+ * returns 0 in case of success and -1 otherwise*/
+int incr_add_diag(incr_diag_t **diags, int *n, int *capacity, int number, const char *text, char *owned)
+{
+	incr_diag_t *d;
+
+	if (*n == *capacity) {
+		*capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+		d = realloc(*diags, *capacity * sizeof(*d));
+		if (d == NULL) {
+			free(owned);
+			return -1;
+		}
+		*diags = d;
+	}
+
+	d = &(*diags)[(*n)++];
+	d->number = number;
+	d->text = text;
+	d->owned = owned;
+	return 0;
+}
+
+/*This method formats a diagnostic about a symbol used in a line
+ * returns 0 in case of success and -1 otherwise*/
+int incr_symbol_diag(incr_diag_t **diags, int *n, int *capacity, const char *format, incr_symbol_t *sym)
+{
+	char *text;
+
+	text = malloc(strlen(format) + MAX_LABEL_LENGTH + 32);
+	if (text == NULL) {
+		return -1;
+	}
+	sprintf(text, format, sym->name, sym->line->number);
+	return incr_add_diag(diags, n, capacity, sym->line->number, text, text);
+}
+
+/*This method prints all the diagnostics of the source in line order - the ones of
+ * every line and the ones of the whole source, the same checks the batch assembler does
+ * returns the number of lines with diagnostics, or -1 in case of failure*/
+int incr_diagnostics(incr_t *e, FILE *out)
+{
+	incr_symbol_t *sym, *def;
+	incr_diag_t *diags;
+	incr_global_t *g;
+	int n, capacity, ret;
+	int i;
+
+	diags = NULL;
+	n = 0;
+	capacity = 0;
+	ret = 0;
+
+	for (i = 0; ret == 0 && i < e->n; i++) {
+		if (e->lines[i]->errors != NULL) {
+			ret = incr_add_diag(&diags, &n, &capacity, e->lines[i]->number, e->lines[i]->errors, NULL);
+		}
+	}
+
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		for (g = e->globals[i]; ret == 0 && g != NULL; g = g->next) {
+			def = incr_definition(g);
+			for (sym = g->uses; ret == 0 && sym != NULL; sym = sym->next) {
+				if (def == NULL && (sym->nrefs > 0 || sym->is_entry)) {
+					ret = incr_symbol_diag(&diags, &n, &capacity, "Unresolved symbol %s, line %d\n", sym);
+				} else if (sym->type != SYMBOL_TYPE_UNKNOWN && sym != def) {
+					ret = incr_symbol_diag(&diags, &n, &capacity, "Label %s re-defined, line %d\n", sym);
+				} else if (sym->is_entry && def != NULL && def->type == SYMBOL_TYPE_EXTERNAL) {
+					ret = incr_symbol_diag(&diags, &n, &capacity,
+							"Symbol %s cannot be both external and entry, line %d\n", sym);
+				} else if ((sym->nrefs > 0 || sym->is_entry) && def != NULL && def->type == SYMBOL_TYPE_CONSTANT) {
+					ret = incr_symbol_diag(&diags, &n, &capacity, "Constant %s is not a label, line %d\n", sym);
+				}
+			}
+		}
+	}
+
+	if (ret == 0 && (e->IC > LENGTH_MEMORY || e->DC > LENGTH_MEMORY)) {
+		ret = incr_add_diag(&diags, &n, &capacity, 0, "Program is too large\n", NULL);
+	}
+
+	qsort(diags, n, sizeof(*diags), compare_diags);
+	for (i = 0; i < n; i++) {
+		fputs(diags[i].text, out);
+		free(diags[i].owned);
+	}
+	free(diags);
+
+	return (ret < 0) ? -1 : n;
+}
+
+/*This method checks if any line of the source may define a macro
+ * returns 1 if one may and 0 otherwise*/
+int incr_has_macros(incr_t *e)
+{
+	int i;
+
+	for (i = 0; i < e->n; i++) {
+		if (macro_in_buffer(e->lines[i]->text, strlen(e->lines[i]->text))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*This method assembles the whole source again, the way --check does, and prints its
+ * diagnostics. A line of a macro use or definition cannot be assembled on its own, so
+ * this is what a source with macros is checked by
+ * returns the number of diagnostics, or -1 in case of failure*/
+int incr_reparse(incr_t *e, FILE *out)
+{
+	assembler_options_t options;
+	assembler_state_t state;
+	char *buf, *errors;
+	size_t errors_size;
+	long len;
+	int n, i;
+
+	len = 0;
+	for (i = 0; i < e->n; i++) {
+		len += strlen(e->lines[i]->text) + 1;
+	}
+	buf = malloc(len + 1);
+	if (buf == NULL) {
+		fprintf(stderr, "Failed to allocate source\n");
+		return -1;
+	}
+	len = 0;
+	for (i = 0; i < e->n; i++) {
+		strcpy(buf + len, e->lines[i]->text);
+		len += strlen(e->lines[i]->text);
+		buf[len++] = '\n';
+	}
+
+	options = *e->options;
+	options.check = 1;
+	errors = NULL;
+	init_state(&state, "", &options);
+	state.errfile = open_memstream(&errors, &errors_size);
+	if (state.errfile == NULL) {
+		fprintf(stderr, "Failed to allocate diagnostics\n");
+		cleanup_state(&state);
+		free(buf);
+		return -1;
+	}
+
+	generate_from_buffer(&state, buf, len);
+	if (state.IC > LENGTH_MEMORY || state.DC > LENGTH_MEMORY) {
+		fprintf(state.errfile, "Program is too large - %d code and %d data words\n", state.IC, state.DC);
+	} else {
+		symtab_check(&state.symbols, &state);
+	}
+	fclose(state.errfile);
+
+	n = 0;
+	for (i = 0; i < (int)errors_size; i++) {
+		n += (errors[i] == '\n');
+	}
+	fwrite(errors, 1, errors_size, out);
+
+	free(errors);
+	cleanup_state(&state);
+	free(buf);
+	return n;
+}
+
+/*This method returns the microseconds passed since start*/
+double incr_elapsed_us(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000000.0 + (end.tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+/*This method serves an editor over a simple line protocol. Every request is
+ *   E <first> <nremove> <ninsert>
+ * followed by ninsert lines of text, and replaces lines first..first+nremove-1
+ * (0 based) with them. The reply is the diagnostics of the whole source - of a source
+ * with macros, the ones of assembling it again, see incr_reparse() - followed by
+ *   . <number of diagnostics> <microseconds>
+ * Q ends the session.
+ * returns 0 in case of success and -1 otherwise*/
+int incr_serve(FILE *in, FILE *out, const assembler_options_t *options)
+{
+	struct timespec start;
+	char **lines;
+	char *request;
+	size_t size;
+	ssize_t len;
+	int first, nremove, ninsert;
+	int ndiags;
+	int ret;
+	int i;
+	incr_t e;
+
+	incr_init(&e, options);
+	request = NULL;
+	size = 0;
+	ret = 0;
+
+	while (getline(&request, &size, in) > 0 && request[0] != 'Q') {
+		if (sscanf(request, "E %d %d %d", &first, &nremove, &ninsert) != 3 || ninsert < 0) {
+			fprintf(out, "? Invalid request\n");
+			fflush(out);
+			continue;
+		}
+
+		lines = calloc(ninsert + 1, sizeof(*lines));
+		if (lines == NULL) {
+			fprintf(stderr, "Failed to allocate lines\n");
+			ret = -1;
+			break;
+		}
+		for (i = 0; i < ninsert; i++) {
+			size = 0;
+			len = getline(&lines[i], &size, in);
+			if (len < 0) {
+				break;
+			}
+			if (len > 0 && lines[i][len - 1] == '\n') {
+				lines[i][len - 1] = '\0';
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		ndiags = -1;
+		if (i == ninsert && incr_edit(&e, first, nremove, lines, ninsert) == 0) {
+			ndiags = incr_has_macros(&e) ? incr_reparse(&e, out) : incr_diagnostics(&e, out);
+		}
+		fprintf(out, ". %d %.1f\n", ndiags, incr_elapsed_us(&start));
+		fflush(out);
+
+		for (i = 0; i < ninsert; i++) {
+			free(lines[i]);
+		}
+		free(lines);
+		size = 0;
+		free(request);
+		request = NULL;
+	}
+
+	free(request);
+	incr_free(&e);
+	return ret;
+}
@@ -0,0 +1,64 @@
+
+#ifndef INCR_H
+#define INCR_H
+
+#include "assembler.h"
+
+typedef struct incr_global incr_global_t;
+typedef struct incr_symbol incr_symbol_t;
+typedef struct incr_line incr_line_t;
+
+/*A symbol a line defines, declares or references - linked to all the other lines
+ * that use the same name*/
+struct incr_symbol {
+	char          name[MAX_LABEL_LENGTH];
+	symbol_type_t type;     /* SYMBOL_TYPE_UNKNOWN if the line does not define it */
+	int           index;    /* ic or dc inside the line */
+	int           is_entry;
+	int           nrefs;    /* Uses as an operand */
+	incr_line_t   *line;
+	incr_global_t *global;
+	incr_symbol_t *prev, *next; /* Other lines of the same global */
+};
+
+/*The cached result of assembling a single line on its own*/
+struct incr_line {
+	char          *text;
+	int           IC, DC;   /* Number of code and data words of the line */
+	incr_symbol_t *symbols;
+	int           nsymbols;
+	char          *errors;  /* Diagnostics of the line itself */
+	int           error;
+	int           parsed_number; /* The line number the diagnostics mention */
+	int           number;   /* 1 based */
+	int           ic, dc;   /* Address of the words of the line */
+};
+
+/*A name used anywhere in the source*/
+struct incr_global {
+	char          name[MAX_LABEL_LENGTH];
+	int           ndefs;
+	int           nentries;
+	int           nrefs;
+	incr_symbol_t *uses;
+	incr_global_t *next; /* Next in hash */
+};
+
+/*A source that is assembled again line by line as it is edited*/
+typedef struct incr {
+	incr_line_t               **lines;
+	int                       n;
+	int                       capacity;
+	int                       IC, DC; /* Of the whole source */
+	int                       nconstants; /* Definitions of .equ constants in the lines */
+	incr_global_t             *globals[SYMBOL_HASH_SIZE];
+	const assembler_options_t *options;
+} incr_t;
+
+void incr_init(incr_t *e, const assembler_options_t *options);
+void incr_free(incr_t *e);
+int incr_edit(incr_t *e, int first, int nremove, char *const lines[], int ninsert);
+int incr_diagnostics(incr_t *e, FILE *out);
+int incr_serve(FILE *in, FILE *out, const assembler_options_t *options);
+
+#endif
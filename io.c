@@ -0,0 +1,454 @@
+#define _GNU_SOURCE /* syscall(), MAP_POPULATE */
+
+#include "io.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IO_USE_URING
+#endif
+#endif
+
+#ifdef IO_USE_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/*This method ends a request - closes its file and releases what is not needed anymore*/
+void finish_request(io_request_t *req, int status)
+{
+	if (req->fd >= 0) {
+		close(req->fd);
+		req->fd = -1;
+	}
+
+	if (req->is_write) {
+		if (status < 0) {
+			fprintf(stderr, "Cannot write file %s\n", req->path);
+		}
+		free(req->buf);
+		req->buf = NULL;
+	} else {
+		req->buf[req->done] = '\0';
+		req->len = req->done;
+	}
+
+	req->status = status;
+}
+
+/*This method transfers what is left of a request with blocking read()/write() calls*/
+void blocking_transfer(io_request_t *req)
+{
+	ssize_t n;
+
+	while (req->done < req->len) {
+		if (req->is_write) {
+			n = write(req->fd, req->buf + req->done, req->len - req->done);
+		} else {
+			n = read(req->fd, req->buf + req->done, req->len - req->done);
+		}
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			finish_request(req, -1);
+			return;
+		}
+		if (n == 0) {
+			break; /* The file got shorter since it was opened */
+		}
+		req->done += n;
+	}
+
+	finish_request(req, 0);
+}
+
+#ifdef IO_USE_URING
+
+/*This method maps the rings of a new io_uring instance
+ * returns 0 in case of success and -1 otherwise*/
+int uring_setup(io_ctx_t *io, unsigned entries)
+{
+	struct io_uring_params p;
+	char *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	io->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (io->ring_fd < 0) {
+		io->ring_fd = -1;
+		return -1;
+	}
+
+	io->entries = p.sq_entries;
+	io->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	io->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (io->cq_ring_size > io->sq_ring_size) {
+			io->sq_ring_size = io->cq_ring_size;
+		}
+		io->cq_ring_size = io->sq_ring_size;
+	}
+
+	io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			           io->ring_fd, IORING_OFF_SQ_RING);
+	if (io->sq_ring == MAP_FAILED) {
+		io->sq_ring = NULL;
+		return -1;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		io->cq_ring = io->sq_ring;
+	} else {
+		io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				           io->ring_fd, IORING_OFF_CQ_RING);
+		if (io->cq_ring == MAP_FAILED) {
+			io->cq_ring = NULL;
+			return -1;
+		}
+	}
+
+	io->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			        io->ring_fd, IORING_OFF_SQES);
+	if (io->sqes == MAP_FAILED) {
+		io->sqes = NULL;
+		return -1;
+	}
+
+	sq = io->sq_ring;
+	io->sq_head  = (unsigned *)(sq + p.sq_off.head);
+	io->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+	io->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+	io->sq_array = (unsigned *)(sq + p.sq_off.array);
+
+	cq = io->cq_ring;
+	io->cq_head = (unsigned *)(cq + p.cq_off.head);
+	io->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	io->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	io->cqes    = cq + p.cq_off.cqes;
+
+	return 0;
+}
+
+/*This method submits the queued requests and waits for min_complete completions
+ * returns 0 in case of success and -1 otherwise*/
+int uring_enter(io_ctx_t *io, unsigned min_complete)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, io->ring_fd, io->queued, min_complete,
+				      min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		return -1;
+	}
+	io->queued -= ret;
+	return 0;
+}
+
+void uring_complete(io_ctx_t *io, io_request_t *req, int res);
+
+/*This method handles all the completions the kernel has posted*/
+void uring_reap(io_ctx_t *io)
+{
+	struct io_uring_cqe *cqe;
+	io_request_t *req;
+	unsigned head, tail;
+	int res;
+
+	head = *io->cq_head;
+	tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		cqe = (struct io_uring_cqe *)io->cqes + (head & *io->cq_mask);
+		req = (io_request_t *)(unsigned long)cqe->user_data;
+		res = cqe->res;
+
+		/* Give the entry back before handling it, handling may queue more */
+		head++;
+		__atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+		io->inflight--;
+
+		uring_complete(io, req, res);
+		tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+	}
+}
+
+/*This method queues the transfer of what is left of a request. It is only submitted
+ * to the kernel by the next uring_enter()*/
+void uring_queue(io_ctx_t *io, io_request_t *req)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, index;
+
+	/* Never have more requests than the completion ring can hold */
+	while (io->inflight >= io->entries) {
+		if (uring_enter(io, 1) < 0) {
+			blocking_transfer(req);
+			return;
+		}
+		uring_reap(io);
+	}
+
+	tail = *io->sq_tail;
+	index = tail & *io->sq_mask;
+	sqe = (struct io_uring_sqe *)io->sqes + index;
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode    = req->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd        = req->fd;
+	sqe->addr      = (unsigned long)(req->buf + req->done);
+	sqe->len       = req->len - req->done;
+	sqe->off       = req->done;
+	sqe->user_data = (unsigned long)req;
+
+	io->sq_array[index] = index;
+	__atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	io->queued++;
+	io->inflight++;
+}
+
+/*This method handles the completion of a single transfer*/
+void uring_complete(io_ctx_t *io, io_request_t *req, int res)
+{
+	if (res == -EINTR || res == -EAGAIN) {
+		uring_queue(io, req);
+	} else if (res == -EINVAL || res == -EOPNOTSUPP) {
+		blocking_transfer(req); /* Old kernel without read/write operations */
+	} else if (res < 0) {
+		finish_request(req, -1);
+	} else if (res == 0) {
+		finish_request(req, req->done < req->len && req->is_write ? -1 : 0);
+	} else {
+		req->done += res;
+		if (req->done < req->len) {
+			uring_queue(io, req); /* Short transfer */
+		} else {
+			finish_request(req, 0);
+		}
+	}
+}
+
+#endif /* IO_USE_URING */
+
+/*This method starts the transfer of an opened request, in the background when possible*/
+void start_request(io_ctx_t *io, io_request_t *req)
+{
+	req->done = 0;
+	req->status = IO_PENDING;
+
+#ifdef IO_USE_URING
+	if (io->ring_fd >= 0 && req->len > 0) {
+		uring_queue(io, req);
+		return;
+	}
+#endif
+
+	blocking_transfer(req);
+}
+
+/*This method initializes the I/O context. io_uring is used when use_uring is set and the
+ * kernel supports it, otherwise all transfers are blocking
+ * returns 0 in case of success and -1 otherwise*/
+int io_init(io_ctx_t *io, unsigned entries, int use_uring)
+{
+	memset(io, 0, sizeof(*io));
+	io->ring_fd = -1;
+	io->outputs = NULL;
+
+#ifdef IO_USE_URING
+	if (use_uring && uring_setup(io, entries) < 0) {
+		io_cleanup(io); /* Not available - fall back to blocking I/O */
+		memset(io, 0, sizeof(*io));
+		io->ring_fd = -1;
+	}
+#endif
+
+	return 0;
+}
+
+/*This method releases the rings of the context. All requests must be completed*/
+void io_cleanup(io_ctx_t *io)
+{
+#ifdef IO_USE_URING
+	if (io->sqes != NULL) {
+		munmap(io->sqes, io->sqes_size);
+	}
+	if (io->cq_ring != NULL && io->cq_ring != io->sq_ring) {
+		munmap(io->cq_ring, io->cq_ring_size);
+	}
+	if (io->sq_ring != NULL) {
+		munmap(io->sq_ring, io->sq_ring_size);
+	}
+#endif
+	if (io->ring_fd >= 0) {
+		close(io->ring_fd);
+		io->ring_fd = -1;
+	}
+}
+
+/*This method submits everything that was queued without waiting for it*/
+void io_kick(io_ctx_t *io)
+{
+#ifdef IO_USE_URING
+	if (io->ring_fd >= 0 && io->queued > 0) {
+		if (uring_enter(io, 0) == 0) {
+			uring_reap(io);
+		}
+	}
+#endif
+}
+
+/*This method starts reading <filename>.<ext> into req. A failure to open the file is
+ * reported only by io_wait(), when the file is actually needed.
+ * returns 0 in case of success and -1 otherwise*/
+int io_submit_read(io_ctx_t *io, const char *filename, const char *ext, io_request_t *req)
+{
+	struct stat st;
+
+	memset(req, 0, sizeof(*req));
+	sprintf(req->path, "%s.%s", filename, ext);
+	req->is_write = 0;
+
+	req->fd = open(req->path, O_RDONLY);
+	if (req->fd < 0 || fstat(req->fd, &st) < 0) {
+		req->status = -1;
+		return -1;
+	}
+
+	req->len = st.st_size;
+	req->buf = malloc(req->len + 1);
+	if (req->buf == NULL) {
+		close(req->fd);
+		req->fd = -1;
+		req->status = -1;
+		return -1;
+	}
+
+	start_request(io, req);
+	return 0;
+}
+
+/*This method waits until the request completes
+ * returns 0 in case of success and -1 otherwise*/
+int io_wait(io_ctx_t *io, io_request_t *req)
+{
+#ifdef IO_USE_URING
+	while (req->status == IO_PENDING) {
+		if (uring_enter(io, 1) < 0) {
+			break;
+		}
+		uring_reap(io);
+	}
+#endif
+
+	if (req->status != 0 && !req->is_write) {
+		fprintf(stderr, "Cannot open file %s for reading\n", req->path);
+		return -1;
+	}
+	return req->status;
+}
+
+/*This method frees the buffer of a read request, waiting for it to complete first*/
+void io_release(io_ctx_t *io, io_request_t *req)
+{
+	if (req->status == IO_PENDING) {
+		io_wait(io, req);
+	}
+	free(req->buf);
+	req->buf = NULL;
+}
+
+/*This method creates an output <filename>.<ext> that is printed to memory.
+ * It is written to the disk by io_close_output(), or dropped if never closed.
+ * returns the stream to print to, or NULL in case of failure*/
+FILE *io_open_output(io_ctx_t *io, const char *filename, const char *ext)
+{
+	io_request_t *req;
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL) {
+		fprintf(stderr, "Failed to allocate output %s.%s\n", filename, ext);
+		return NULL;
+	}
+
+	sprintf(req->path, "%s.%s", filename, ext);
+	req->is_write = 1;
+	req->fd = -1;
+	req->status = IO_PENDING;
+
+	req->file = open_memstream(&req->buf, &req->len);
+	if (req->file == NULL) {
+		fprintf(stderr, "Failed to allocate output %s\n", req->path);
+		free(req);
+		return NULL;
+	}
+
+	req->next = io->outputs;
+	io->outputs = req;
+	return req->file;
+}
+
+/*This method finishes an output and starts writing it to the disk
+ * returns 0 in case of success and -1 otherwise*/
+int io_close_output(io_ctx_t *io, FILE *f)
+{
+	io_request_t *req;
+
+	for (req = io->outputs; req != NULL && req->file != f; req = req->next)
+		;
+	if (req == NULL) {
+		return -1;
+	}
+
+	fclose(req->file);
+	req->file = NULL;
+
+	req->fd = open(req->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (req->fd < 0) {
+		fprintf(stderr, "Cannot open file %s for writing\n", req->path);
+		finish_request(req, -1);
+		return -1;
+	}
+
+	start_request(io, req);
+	return (req->status < 0) ? -1 : 0;
+}
+
+/*This method waits for all the outputs to be written and frees them.
+ * Outputs that were never closed (their file failed to assemble) are dropped.
+ * returns 0 in case of success and -1 otherwise*/
+int io_flush(io_ctx_t *io)
+{
+	io_request_t *req;
+	int error_flag;
+
+	io_kick(io);
+
+	error_flag = 0;
+	while (io->outputs != NULL) {
+		req = io->outputs;
+		io->outputs = req->next;
+
+		if (req->file != NULL) {
+			fclose(req->file);
+			free(req->buf);
+		} else if (io_wait(io, req) < 0) {
+			error_flag = -1;
+		}
+
+		free(req);
+	}
+
+	return error_flag;
+}
@@ -0,0 +1,54 @@
+
+#ifndef IO_H
+#define IO_H
+
+#include "defs.h"
+
+#include <stddef.h>
+
+#define IO_DEFAULT_DEPTH 16 /*How many sources are read ahead of the one being assembled*/
+
+#define IO_PENDING 1 /*Status of a request that did not complete yet*/
+
+typedef struct io_request io_request_t;
+struct io_request {
+	char         path[MAX_PATH];
+	int          fd;
+	int          is_write;
+	char         *buf;
+	size_t       len;    /* Bytes to transfer */
+	size_t       done;   /* Bytes transferred so far */
+	int          status; /* IO_PENDING, 0 for success or -1 */
+	FILE         *file;  /* An output that is still being printed to memory */
+	io_request_t *next;  /* Next output of the context */
+};
+
+/*Batched file I/O - reads of sources and writes of outputs are queued and submitted
+ * together to io_uring, so they overlap with the parsing. When io_uring is not
+ * available the same calls do plain blocking I/O.*/
+typedef struct io_ctx {
+	int          ring_fd; /* -1 for blocking I/O */
+	unsigned     entries; /* Size of the submission ring */
+	unsigned     inflight;
+	unsigned     queued;  /* Queued, not yet submitted to the kernel */
+	void         *sq_ring, *cq_ring, *sqes;
+	size_t       sq_ring_size, cq_ring_size, sqes_size;
+	unsigned     *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned     *cq_head, *cq_tail, *cq_mask;
+	void         *cqes;
+	io_request_t *outputs;
+} io_ctx_t;
+
+int io_init(io_ctx_t *io, unsigned entries, int use_uring);
+void io_cleanup(io_ctx_t *io);
+
+int io_submit_read(io_ctx_t *io, const char *filename, const char *ext, io_request_t *req);
+int io_wait(io_ctx_t *io, io_request_t *req);
+void io_release(io_ctx_t *io, io_request_t *req);
+void io_kick(io_ctx_t *io);
+
+FILE *io_open_output(io_ctx_t *io, const char *filename, const char *ext);
+int io_close_output(io_ctx_t *io, FILE *f);
+int io_flush(io_ctx_t *io);
+
+#endif
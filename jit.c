@@ -0,0 +1,535 @@
+#define _GNU_SOURCE /* MAP_ANONYMOUS */
+
+#include "jit.h"
+
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+/*Offsets from the base of the jit, which rdi holds in native code*/
+#define JIT_SIM(field)  ((int)offsetof(sim_t, field))
+#define JIT_FIELD(field) ((int)offsetof(jit_t, field))
+#define JIT_MEM(address) (JIT_SIM(mem) + 2 * (address))
+#define JIT_TABLE(pc)    (JIT_FIELD(table) + (int)sizeof(void *) * (pc))
+
+/*Where an operand of a decoded instruction is*/
+#define JIT_OPERAND_REG 0 /* In a guest register, r8-r15 */
+#define JIT_OPERAND_MEM 1
+#define JIT_OPERAND_IMM 2
+
+/*This method adds bytes to the native code*/
+void jit_bytes(jit_t *jit, const char *bytes, int n)
+{
+	memcpy(jit->buffer + jit->used, bytes, n);
+	jit->used += n;
+}
+
+void jit_byte(jit_t *jit, int b)
+{
+	jit->buffer[jit->used++] = (unsigned char)b;
+}
+
+void jit_u32(jit_t *jit, long v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		jit_byte(jit, (v >> (8 * i)) & 0xFF);
+	}
+}
+
+/*This method adds the 32 bit displacement of a jump to the native code
+ * returns where it is, to point it with jit_patch() once the target is known*/
+size_t jit_rel32(jit_t *jit)
+{
+	jit_u32(jit, 0);
+	return jit->used - 4;
+}
+
+/*This method points a jump at the end of the native code so far*/
+void jit_patch(jit_t *jit, size_t at)
+{
+	long rel;
+	int i;
+
+	rel = (long)jit->used - (long)(at + 4);
+	for (i = 0; i < 4; i++) {
+		jit->buffer[at + i] = (rel >> (8 * i)) & 0xFF;
+	}
+}
+
+/*This method adds a jmp rel32 to a stub*/
+void jit_jmp(jit_t *jit, const unsigned char *target)
+{
+	jit_byte(jit, 0xE9);
+	jit_u32(jit, (long)(target - (jit->buffer + jit->used + 4)));
+}
+
+/*This method adds a jump to the native code of the address in eax - jmp [rdi+rax*8+table]*/
+void jit_exit_eax(jit_t *jit)
+{
+	jit_bytes(jit, "\xFF\xA4\xC7", 3);
+	jit_u32(jit, JIT_TABLE(0));
+}
+
+/*This method adds a jump to the native code of a known address - mov eax, pc and
+ * jmp [rdi+table+pc*8]. eax tells the miss stub which address it was*/
+void jit_exit(jit_t *jit, int pc)
+{
+	jit_byte(jit, 0xB8);
+	jit_u32(jit, pc);
+	jit_bytes(jit, "\xFF\xA7", 2);
+	jit_u32(jit, JIT_TABLE(pc));
+}
+
+/*This method adds a return to jit_run() with a status, for the instruction at pc*/
+void jit_exit_status(jit_t *jit, int pc, int status)
+{
+	if (status == JIT_EXIT_INTERPRET) {
+		jit_bytes(jit, "\x48\xFF\xCD", 3); /* dec rbp - the interpreter counts it */
+	}
+	jit_byte(jit, 0xBA); /* mov edx, status */
+	jit_u32(jit, status);
+	jit_byte(jit, 0xB8); /* mov eax, pc */
+	jit_u32(jit, pc);
+	jit_jmp(jit, jit->exit);
+}
+
+/*This method writes the stubs - enter(jit) saves the host registers, loads the guest state
+ * and jumps to the native code of sim.pc; exit saves the guest state and returns; miss is
+ * where the table points until an address has native code*/
+void jit_emit_stubs(jit_t *jit)
+{
+	int i;
+
+	jit->enter = jit->buffer + jit->used;
+	jit_bytes(jit, "\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57", 10); /* push rbx, rbp, r12-r15 */
+	for (i = 0; i < 8; i++) {
+		jit_bytes(jit, "\x44\x0F\xB7", 3); /* movzx r8d+i, word [rdi+reg+2i] */
+		jit_byte(jit, 0x87 | (i << 3));
+		jit_u32(jit, JIT_SIM(reg) + 2 * i);
+	}
+	jit_bytes(jit, "\x8B\xB7", 2); /* mov esi, [rdi+zero] */
+	jit_u32(jit, JIT_SIM(zero));
+	jit_bytes(jit, "\x48\x8B\xAF", 3); /* mov rbp, [rdi+steps] */
+	jit_u32(jit, JIT_SIM(steps));
+	jit_bytes(jit, "\x8B\x87", 2); /* mov eax, [rdi+pc] */
+	jit_u32(jit, JIT_SIM(pc));
+	jit_exit_eax(jit);
+
+	jit->exit = jit->buffer + jit->used;
+	jit_bytes(jit, "\x89\x87", 2); /* mov [rdi+pc], eax */
+	jit_u32(jit, JIT_SIM(pc));
+	jit_bytes(jit, "\x89\x97", 2); /* mov [rdi+status], edx */
+	jit_u32(jit, JIT_FIELD(status));
+	for (i = 0; i < 8; i++) {
+		jit_bytes(jit, "\x66\x44\x89", 3); /* mov [rdi+reg+2i], r8w+i */
+		jit_byte(jit, 0x87 | (i << 3));
+		jit_u32(jit, JIT_SIM(reg) + 2 * i);
+	}
+	jit_bytes(jit, "\x89\xB7", 2); /* mov [rdi+zero], esi */
+	jit_u32(jit, JIT_SIM(zero));
+	jit_bytes(jit, "\x48\x89\xAF", 3); /* mov [rdi+steps], rbp */
+	jit_u32(jit, JIT_SIM(steps));
+	jit_bytes(jit, "\x41\x5F\x41\x5E\x41\x5D\x41\x5C\x5D\x5B\xC3", 11); /* pop, ret */
+
+	jit->miss = jit->buffer + jit->used;
+	jit_bytes(jit, "\x31\xD2", 2); /* xor edx, edx - JIT_EXIT_MISS */
+	jit_jmp(jit, jit->exit);
+}
+
+/*This method makes the buffer of the native code writable, to add code to it, or
+ * executable, to run it - it is never both
+ * returns 0 in case of success and -1 otherwise*/
+int jit_protect(jit_t *jit, int writable)
+{
+	return mprotect(jit->buffer, JIT_BUFFER_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+}
+
+/*This method maps the buffer for the native code and writes the stubs to it
+ * returns 0 in case of success and -1 if there is no JIT for this host*/
+int jit_init(jit_t *jit)
+{
+#if defined(__x86_64__)
+	jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->buffer == MAP_FAILED) {
+		jit->buffer = NULL;
+		return -1;
+	}
+	jit->used = 0;
+	jit_emit_stubs(jit);
+	jit->stubs = jit->used;
+	if (jit_protect(jit, 0) < 0) {
+		jit_cleanup(jit);
+		return -1;
+	}
+	return 0;
+#else
+	jit->buffer = NULL;
+	return -1;
+#endif
+}
+
+/*This method unmaps the buffer of the native code*/
+void jit_cleanup(jit_t *jit)
+{
+	if (jit->buffer != NULL) {
+		munmap(jit->buffer, JIT_BUFFER_SIZE);
+		jit->buffer = NULL;
+	}
+}
+
+/*This method loads a program to run, dropping the native code of the one before
+ * returns 0 in case of success and -1 otherwise*/
+int jit_load(jit_t *jit, const assembler_state_t *state, FILE *in, FILE *out)
+{
+	int i;
+
+	if (sim_load(&jit->sim, state, in, out) < 0) {
+		return -1;
+	}
+	for (i = 0; i < SIM_CODE_SIZE; i++) {
+		jit->table[i] = jit->miss;
+	}
+	memset(jit->code_map, 0, sizeof(jit->code_map));
+	memset(jit->store_map, 0, sizeof(jit->store_map));
+	jit->used = jit->stubs;
+	jit->interpret = 0;
+	return 0;
+}
+
+/*This method finds where an operand of a decoded instruction is
+ * returns JIT_OPERAND_* and its register, address or value in *value*/
+int jit_operand(jit_t *jit, const sim_insn_t *insn, const short *ref, int *value)
+{
+	if (ref >= jit->sim.reg && ref < jit->sim.reg + 8) {
+		*value = ref - jit->sim.reg;
+		return JIT_OPERAND_REG;
+	}
+	if (ref >= jit->sim.mem && ref < jit->sim.mem + LENGTH_MEMORY) {
+		*value = ref - jit->sim.mem;
+		return JIT_OPERAND_MEM;
+	}
+	*value = *ref; /* insn->imm */
+	return JIT_OPERAND_IMM;
+}
+
+/*This method adds a load of an operand to eax (r = 0) or ecx (r = 1)*/
+void jit_load_operand(jit_t *jit, const sim_insn_t *insn, const short *ref, int r)
+{
+	int value;
+
+	switch (jit_operand(jit, insn, ref, &value)) {
+	case JIT_OPERAND_REG:
+		jit_bytes(jit, "\x44\x89", 2); /* mov eax/ecx, r8d+i */
+		jit_byte(jit, 0xC0 | (value << 3) | r);
+		break;
+	case JIT_OPERAND_MEM:
+		jit_bytes(jit, "\x0F\xB7", 2); /* movzx eax/ecx, word [rdi+mem+2a] */
+		jit_byte(jit, 0x87 | (r << 3));
+		jit_u32(jit, JIT_MEM(value));
+		break;
+	default:
+		jit_byte(jit, 0xB8 + r); /* mov eax/ecx, imm */
+		jit_u32(jit, value);
+		break;
+	}
+}
+
+/*This method adds a store of eax to the destination, kept to 10 bits when mask is set*/
+void jit_store(jit_t *jit, const sim_insn_t *insn, int mask)
+{
+	int value;
+
+	if (mask) {
+		jit_bytes(jit, "\x25\xFF\x03\x00\x00", 5); /* and eax, 1023 */
+	}
+	if (jit_operand(jit, insn, insn->dst, &value) == JIT_OPERAND_REG) {
+		jit_bytes(jit, "\x41\x89", 2); /* mov r8d+i, eax */
+		jit_byte(jit, 0xC0 | value);
+	} else {
+		jit_bytes(jit, "\x66\x89\x87", 3); /* mov [rdi+mem+2a], ax */
+		jit_u32(jit, JIT_MEM(value));
+	}
+}
+
+/*This method adds a jump to the target of jmp, bne or jsr*/
+void jit_exit_target(jit_t *jit, const sim_insn_t *insn)
+{
+	int value;
+
+	if (jit_operand(jit, insn, insn->dst, &value) == JIT_OPERAND_REG) {
+		jit_bytes(jit, "\x44\x89", 2); /* mov eax, r8d+i */
+		jit_byte(jit, 0xC0 | (value << 3));
+		jit_exit_eax(jit);
+	} else {
+		jit_exit(jit, value);
+	}
+}
+
+/*This method translates a single instruction at pc. jmp, bne, jsr and rts end the block,
+ * leaving to the native code of their target*/
+void jit_emit_instruction(jit_t *jit, const sim_insn_t *insn, int pc)
+{
+	size_t at;
+
+	switch (insn->op) {
+	case OPCODE_MOV:
+	case OPCODE_LEA:
+		jit_load_operand(jit, insn, insn->src, 0);
+		jit_store(jit, insn, 0);
+		break;
+	case OPCODE_CMP:
+		jit_load_operand(jit, insn, insn->src, 0);
+		jit_load_operand(jit, insn, insn->dst, 1);
+		jit_bytes(jit, "\x31\xF6\x39\xC8\x40\x0F\x94\xC6", 8); /* xor esi, esi; cmp eax, ecx; sete sil */
+		break;
+	case OPCODE_ADD:
+	case OPCODE_SUB:
+		jit_load_operand(jit, insn, insn->dst, 0);
+		jit_load_operand(jit, insn, insn->src, 1);
+		jit_bytes(jit, (insn->op == OPCODE_ADD) ? "\x01\xC8" : "\x29\xC8", 2); /* add/sub eax, ecx */
+		jit_store(jit, insn, 1);
+		break;
+	case OPCODE_NOT:
+		jit_load_operand(jit, insn, insn->dst, 0);
+		jit_bytes(jit, "\xF7\xD0", 2); /* not eax */
+		jit_store(jit, insn, 1);
+		break;
+	case OPCODE_CLR:
+		jit_bytes(jit, "\x31\xC0", 2); /* xor eax, eax */
+		jit_store(jit, insn, 0);
+		break;
+	case OPCODE_INC:
+	case OPCODE_DEC:
+		jit_load_operand(jit, insn, insn->dst, 0);
+		jit_bytes(jit, (insn->op == OPCODE_INC) ? "\x83\xC0\x01" : "\x83\xE8\x01", 3); /* add/sub eax, 1 */
+		jit_store(jit, insn, 1);
+		break;
+	case OPCODE_JMP:
+		jit_exit_target(jit, insn);
+		break;
+	case OPCODE_BNE:
+		jit_bytes(jit, "\x85\xF6\x0F\x85", 4); /* test esi, esi; jnz (equal) fall through */
+		at = jit_rel32(jit);
+		jit_exit_target(jit, insn);
+		jit_patch(jit, at);
+		jit_exit(jit, pc + insn->size);
+		break;
+	case OPCODE_JSR:
+		jit_bytes(jit, "\x8B\x87", 2); /* mov eax, [rdi+sp] */
+		jit_u32(jit, JIT_SIM(sp));
+		jit_byte(jit, 0x3D); /* cmp eax, SIM_STACK_SIZE */
+		jit_u32(jit, SIM_STACK_SIZE);
+		jit_bytes(jit, "\x0F\x82", 2); /* jb push */
+		at = jit_rel32(jit);
+		jit_exit_status(jit, pc, JIT_EXIT_INTERPRET);
+		jit_patch(jit, at);
+		jit_bytes(jit, "\x66\xC7\x84\x47", 4); /* mov word [rdi+stack+rax*2], return address */
+		jit_u32(jit, JIT_SIM(stack));
+		jit_byte(jit, (pc + insn->size) & 0xFF);
+		jit_byte(jit, (pc + insn->size) >> 8);
+		jit_bytes(jit, "\xFF\x87", 2); /* inc dword [rdi+sp] */
+		jit_u32(jit, JIT_SIM(sp));
+		jit_exit_target(jit, insn);
+		break;
+	case OPCODE_RTS:
+		jit_bytes(jit, "\x8B\x87", 2); /* mov eax, [rdi+sp] */
+		jit_u32(jit, JIT_SIM(sp));
+		jit_bytes(jit, "\x85\xC0\x0F\x85", 4); /* test eax, eax; jnz pop */
+		at = jit_rel32(jit);
+		jit_exit_status(jit, pc, JIT_EXIT_INTERPRET);
+		jit_patch(jit, at);
+		jit_bytes(jit, "\xFF\xC8\x89\x87", 4); /* dec eax; mov [rdi+sp], eax */
+		jit_u32(jit, JIT_SIM(sp));
+		jit_bytes(jit, "\x0F\xB7\x84\x47", 4); /* movzx eax, word [rdi+stack+rax*2] */
+		jit_u32(jit, JIT_SIM(stack));
+		jit_exit_eax(jit);
+		break;
+	}
+}
+
+/*This method checks if an instruction writes its destination*/
+int jit_writes(int op)
+{
+	return op != OPCODE_CMP && op != OPCODE_JMP && op != OPCODE_BNE && op != OPCODE_JSR &&
+		   op != OPCODE_RTS && op != OPCODE_PRN && op != OPCODE_STOP;
+}
+
+/*This method translates the basic block at pc. red, prn and stop are left to the
+ * interpreter, so a block ends before them. A block that writes its own code, or
+ * code translated before, makes the rest of the run interpreted
+ * returns 0 when the block was translated and -1 otherwise*/
+int jit_compile(jit_t *jit, int pc)
+{
+	sim_t *sim = &jit->sim;
+	sim_insn_t insns[JIT_MAX_BLOCK];
+	int addresses[JIT_MAX_BLOCK];
+	const sim_insn_t *insn;
+	size_t start, at;
+	int n, i, p, a, end;
+
+	/* The instructions of the block */
+	n = 0;
+	p = pc;
+	while (n < JIT_MAX_BLOCK && p >= ASSEMBLY_CODE_START_ADDRESS && p < sim->end && sim_decode(sim, p) == 0) {
+		insn = &sim->code[p];
+		if (insn->op == OPCODE_RED || insn->op == OPCODE_PRN || insn->op == OPCODE_STOP) {
+			break;
+		}
+		for (a = p; a < p + insn->size; a++) {
+			if (jit->store_map[a]) {
+				jit->interpret = 1; /* The code was written */
+				return -1;
+			}
+		}
+		insns[n] = *insn;
+		addresses[n++] = p;
+		p += insn->size;
+		if (insn->op == OPCODE_JMP || insn->op == OPCODE_BNE || insn->op == OPCODE_JSR || insn->op == OPCODE_RTS) {
+			break;
+		}
+	}
+	end = p;
+	sim->fault = NULL;
+
+	for (i = 0; i < n; i++) {
+		if (insns[i].dst_mem && jit_writes(insns[i].op)) {
+			a = insns[i].dst - sim->mem;
+			if (jit->code_map[a] || (a >= pc && a < end)) {
+				jit->interpret = 1; /* The code writes code */
+				return -1;
+			}
+		}
+	}
+	if (n == 0) {
+		return -1;
+	}
+	if (jit->used + 128 * (n + 1) > JIT_BUFFER_SIZE) {
+		jit->interpret = 1; /* Out of room */
+		return -1;
+	}
+
+	if (jit_protect(jit, 1) < 0) {
+		jit->interpret = 1;
+		return -1;
+	}
+
+	/* Count the steps up front, leaving to the interpreter a block that passes the limit */
+	start = jit->used;
+	jit_bytes(jit, "\x48\x81\xC5", 3); /* add rbp, n */
+	jit_u32(jit, n);
+	jit_bytes(jit, "\x48\x3B\xAF", 3); /* cmp rbp, [rdi+limit] */
+	jit_u32(jit, JIT_FIELD(limit));
+	jit_bytes(jit, "\x0F\x87", 2); /* ja over the limit */
+	at = jit_rel32(jit);
+
+	for (i = 0; i < n; i++) {
+		if (insns[i].dst_mem && jit_writes(insns[i].op)) {
+			jit->store_map[insns[i].dst - sim->mem] = 1;
+		}
+		for (a = addresses[i]; a < addresses[i] + insns[i].size; a++) {
+			jit->code_map[a] = 1;
+		}
+		jit_emit_instruction(jit, &insns[i], addresses[i]);
+	}
+	if (!(insns[n - 1].op == OPCODE_JMP || insns[n - 1].op == OPCODE_BNE ||
+		  insns[n - 1].op == OPCODE_JSR || insns[n - 1].op == OPCODE_RTS)) {
+		jit_exit(jit, end);
+	}
+
+	jit_patch(jit, at);
+	jit_bytes(jit, "\x48\x81\xED", 3); /* sub rbp, n */
+	jit_u32(jit, n);
+	jit_exit_status(jit, pc, JIT_EXIT_LIMIT);
+
+	if (jit_protect(jit, 0) < 0) {
+		jit->interpret = 1; /* The block is not run */
+		return -1;
+	}
+	jit->table[pc] = jit->buffer + start;
+	return 0;
+}
+
+/*This method runs a single instruction at sim.pc in the interpreter
+ * returns 1 when it ran, 0 when the program stopped and -1 in case of fault*/
+int jit_step(jit_t *jit)
+{
+	sim_t *sim = &jit->sim;
+	const sim_insn_t *insn;
+	int pc, ret;
+
+	pc = sim->pc;
+	if (pc >= ASSEMBLY_CODE_START_ADDRESS && pc < sim->end) {
+		sim->code[pc].op = SIM_DECODE; /* Native code may have written it */
+	}
+	ret = sim_run(sim, 1);
+	if (ret == 0) {
+		return 0;
+	}
+	if (sim->fault != sim_limit_reached) {
+		return -1;
+	}
+	sim->fault = NULL;
+
+	insn = &sim->code[pc];
+	if (insn->op == OPCODE_RED && insn->dst_mem) {
+		if (jit->code_map[insn->dst - sim->mem]) {
+			jit->interpret = 1;
+		}
+		jit->store_map[insn->dst - sim->mem] = 1;
+	}
+	return 1;
+}
+
+/*This method runs the loaded program until stop, a fault, or max_steps instructions
+ * (0 for no limit), the same as sim_run() does but in native code
+ * returns 0 when the program stopped and -1 otherwise, with the reason in sim.fault*/
+int jit_run(jit_t *jit, unsigned long max_steps)
+{
+	sim_t *sim = &jit->sim;
+	void (*enter)(jit_t *);
+	int i, ret;
+
+	jit->limit = (max_steps != 0) ? max_steps : ULONG_MAX;
+	memcpy(&enter, &jit->enter, sizeof(enter));
+
+	while (!jit->interpret) {
+		if (sim->steps >= jit->limit) {
+			sim->fault = sim_limit_reached;
+			return -1;
+		}
+
+		enter(jit);
+
+		if (jit->status == JIT_EXIT_LIMIT) {
+			break;
+		}
+		if (jit->status == JIT_EXIT_MISS && jit_compile(jit, sim->pc) == 0) {
+			continue;
+		}
+		if (jit->interpret) {
+			break;
+		}
+		/* The block stopped before an instruction that is run here - it counts too */
+		if (sim->steps >= jit->limit) {
+			sim->fault = sim_limit_reached;
+			return -1;
+		}
+		ret = jit_step(jit);
+		if (ret <= 0) {
+			return ret;
+		}
+	}
+
+	/* The rest in the interpreter, with every address decoded again */
+	for (i = ASSEMBLY_CODE_START_ADDRESS; i < sim->end; i++) {
+		sim->code[i].op = SIM_DECODE;
+	}
+	if (max_steps != 0 && sim->steps >= max_steps) {
+		sim->fault = sim_limit_reached;
+		return -1;
+	}
+	return sim_run(sim, (max_steps != 0) ? max_steps - sim->steps : 0);
+}
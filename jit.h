@@ -0,0 +1,41 @@
+
+#ifndef JIT_H
+#define JIT_H
+
+#include "sim.h"
+
+#include <stddef.h>
+
+#define JIT_BUFFER_SIZE (2 * 1024 * 1024)
+#define JIT_MAX_BLOCK   64 /* Instructions of a basic block */
+
+/*Why the generated code returned to jit_run()*/
+#define JIT_EXIT_MISS      0 /* No native code for sim.pc yet */
+#define JIT_EXIT_LIMIT     1 /* The next block would pass the step limit */
+#define JIT_EXIT_INTERPRET 2 /* The instruction at sim.pc faults - the interpreter reports it */
+
+/*The x86-64 translation of a loaded program. The basic blocks are translated when they
+ * are first reached, and jump to each other through table. The guest registers live in
+ * r8-r15 while native code runs, the zero flag in esi and the step count in rbp*/
+typedef struct jit {
+	sim_t         sim;   /* First - the native code addresses both from the same base */
+	void          *table[SIM_CODE_SIZE]; /* Native code of every address, or the miss stub */
+	unsigned long limit; /* Of sim.steps */
+	int           status; /* JIT_EXIT_* */
+	unsigned char *buffer;
+	size_t        used;
+	size_t        stubs; /* Size of the stubs at the start of buffer */
+	unsigned char *enter; /* Loads the guest state and jumps to table[sim.pc] */
+	unsigned char *exit;  /* Saves the guest state and returns */
+	unsigned char *miss;
+	unsigned char code_map[LENGTH_MEMORY];  /* Words of translated instructions */
+	unsigned char store_map[LENGTH_MEMORY]; /* Words written by translated code or red */
+	int           interpret; /* The program modifies its code - the rest is interpreted */
+} jit_t;
+
+int jit_init(jit_t *jit);
+void jit_cleanup(jit_t *jit);
+int jit_load(jit_t *jit, const assembler_state_t *state, FILE *in, FILE *out);
+int jit_run(jit_t *jit, unsigned long max_steps);
+
+#endif
@@ -0,0 +1,295 @@
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/*This method initializes an empty job list*/
+void jobs_init(job_list_t *l)
+{
+	l->jobs = NULL;
+	l->n = 0;
+	l->capacity = 0;
+	l->dirs = NULL;
+	l->ndirs = 0;
+}
+
+/*This method frees the job list contents*/
+void jobs_free(job_list_t *l)
+{
+	int i;
+
+	for (i = 0; i < l->n; i++) {
+		if (l->jobs[i].outname != l->jobs[i].name) {
+			free(l->jobs[i].outname);
+		}
+		free(l->jobs[i].name);
+		include_deps_free(l->jobs[i].includes);
+	}
+	for (i = 0; i < l->ndirs; i++) {
+		free(l->dirs[i]);
+	}
+	free(l->jobs);
+	free(l->dirs);
+	jobs_init(l);
+}
+
+/*This method adds a source to the list. When outdir is not NULL the outputs are
+ * written to that directory instead of next to the source
+ * returns 0 in case of success and -1 otherwise*/
+int jobs_add(job_list_t *l, const char *name, const char *outdir)
+{
+	job_t *jobs, *job;
+	const char *base;
+
+	/* Leave room for the longest extension */
+	if (strlen(name) + 5 > MAX_PATH || (outdir != NULL && strlen(outdir) + strlen(name) + 6 > MAX_PATH)) {
+		fprintf(stderr, "File name %s is too long\n", name);
+		return -1;
+	}
+
+	if (l->n == l->capacity) {
+		l->capacity = (l->capacity == 0) ? 64 : 2 * l->capacity;
+		jobs = realloc(l->jobs, l->capacity * sizeof(*jobs));
+		if (jobs == NULL) {
+			fprintf(stderr, "Failed to allocate job list\n");
+			return -1;
+		}
+		l->jobs = jobs;
+	}
+
+	job = &l->jobs[l->n];
+	job->name = malloc(strlen(name) + 1);
+	if (job->name == NULL) {
+		fprintf(stderr, "Failed to allocate job list\n");
+		return -1;
+	}
+	strcpy(job->name, name);
+
+	if (outdir == NULL) {
+		job->outname = job->name;
+	} else {
+		base = strrchr(name, '/');
+		base = (base == NULL) ? name : base + 1;
+
+		job->outname = malloc(strlen(outdir) + strlen(base) + 2);
+		if (job->outname == NULL) {
+			free(job->name);
+			fprintf(stderr, "Failed to allocate job list\n");
+			return -1;
+		}
+		sprintf(job->outname, "%s/%s", outdir, base);
+	}
+
+	job->size = -1;
+	job->order = l->n;
+	job->includes = NULL;
+	l->n++;
+	return 0;
+}
+
+/*This method adds all the sources listed in a manifest file - one base name per line,
+ * optionally followed by an output directory. Empty lines and lines starting with '#'
+ * are ignored.
+ * returns 0 in case of success and -1 otherwise*/
+int jobs_add_manifest(job_list_t *l, const char *path)
+{
+	char line[2 * MAX_PATH + 2];
+	char *name, *outdir, *p;
+	int line_number;
+	int ret;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open file %s for reading\n", path);
+		return -1;
+	}
+
+	ret = 0;
+	line_number = 0;
+	while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+		line_number++;
+
+		for (name = line; isspace(*name); name++)
+			;
+		if (*name == '\0' || *name == '#') {
+			continue;
+		}
+
+		for (p = name; *p != '\0' && !isspace(*p); p++)
+			;
+		outdir = NULL;
+		if (*p != '\0') {
+			*(p++) = '\0';
+			while (isspace(*p)) {
+				p++;
+			}
+			if (*p != '\0') {
+				outdir = p;
+				while (*p != '\0' && !isspace(*p)) {
+					p++;
+				}
+				*p = '\0';
+			}
+		}
+
+		ret = jobs_add(l, name, outdir);
+		if (ret < 0) {
+			fprintf(stderr, "In %s, line %d\n", path, line_number);
+		}
+	}
+
+	fclose(f);
+	return ret;
+}
+
+/*This method adds all the files of a directory that end with .<ext> (the sources, or the
+ * objects for the tools that read them), and remembers the directory
+ * returns 0 in case of success and -1 otherwise*/
+int jobs_add_directory(job_list_t *l, const char *path, const char *ext)
+{
+	char name[MAX_PATH];
+	struct dirent *entry;
+	char **dirs;
+	size_t len, extlen;
+	int ret;
+	DIR *d;
+
+	d = opendir(path);
+	if (d == NULL) {
+		fprintf(stderr, "Cannot open directory %s\n", path);
+		return -1;
+	}
+
+	dirs = realloc(l->dirs, (l->ndirs + 1) * sizeof(*dirs));
+	if (dirs == NULL || (dirs[l->ndirs] = malloc(strlen(path) + 1)) == NULL) {
+		fprintf(stderr, "Failed to allocate job list\n");
+		if (dirs != NULL) {
+			l->dirs = dirs;
+		}
+		closedir(d);
+		return -1;
+	}
+	l->dirs = dirs;
+	strcpy(l->dirs[l->ndirs++], path);
+
+	ret = 0;
+	extlen = strlen(ext) + 1;
+	while (ret == 0 && (entry = readdir(d)) != NULL) {
+		len = strlen(entry->d_name);
+		if (len <= extlen || entry->d_name[len - extlen] != '.' ||
+			strcmp(entry->d_name + len - extlen + 1, ext) != 0) {
+			continue;
+		}
+		if (strlen(path) + len + 1 >= MAX_PATH) {
+			fprintf(stderr, "File name %s/%s is too long\n", path, entry->d_name);
+			ret = -1;
+			break;
+		}
+
+		sprintf(name, "%s/", path);
+		strncat(name, entry->d_name, len - extlen);
+		ret = jobs_add(l, name, NULL);
+	}
+
+	closedir(d);
+	return ret;
+}
+
+/*This method adds a command line argument - a source base name, a directory of
+ * sources or @manifest
+ * returns 0 in case of success and -1 otherwise*/
+int jobs_add_argument(job_list_t *l, const char *arg)
+{
+	struct stat st;
+
+	if (arg[0] == MANIFEST_PREFIX) {
+		return jobs_add_manifest(l, arg + 1);
+	}
+	if (stat(arg, &st) == 0 && S_ISDIR(st.st_mode)) {
+		return jobs_add_directory(l, arg, "as");
+	}
+	return jobs_add(l, arg, NULL);
+}
+
+/*Orders jobs by name, the first given first*/
+int compare_job_names(const void *a, const void *b)
+{
+	const job_t *ja = a, *jb = b;
+	int ret;
+
+	ret = strcmp(ja->name, jb->name);
+	if (ret == 0) {
+		ret = ja->order - jb->order;
+	}
+	return ret;
+}
+
+/*Orders jobs as they were given on the command line*/
+int compare_job_orders(const void *a, const void *b)
+{
+	const job_t *ja = a, *jb = b;
+
+	return ja->order - jb->order;
+}
+
+/*Orders jobs by size, the largest first. Equal sizes keep the command line order*/
+int compare_job_sizes(const void *a, const void *b)
+{
+	const job_t *ja = a, *jb = b;
+
+	if (ja->size != jb->size) {
+		return (ja->size > jb->size) ? -1 : 1;
+	}
+	return ja->order - jb->order;
+}
+
+/*This method prepares the list for running - drops sources that are given more than
+ * once (the first one wins), keeping the command line order. A parallel run (more than
+ * one worker) takes the largest first, so the big sources do not end up alone at its tail*/
+void jobs_schedule(job_list_t *l, int workers)
+{
+	char path[MAX_PATH];
+	struct stat st;
+	int i, n;
+
+	qsort(l->jobs, l->n, sizeof(*l->jobs), compare_job_names);
+
+	n = 0;
+	for (i = 0; i < l->n; i++) {
+		if (n > 0 && strcmp(l->jobs[n - 1].name, l->jobs[i].name) == 0) {
+			if (l->jobs[i].outname != l->jobs[i].name) {
+				free(l->jobs[i].outname);
+			}
+			free(l->jobs[i].name);
+			continue;
+		}
+		l->jobs[n++] = l->jobs[i];
+	}
+	l->n = n;
+	qsort(l->jobs, l->n, sizeof(*l->jobs), compare_job_orders);
+
+	if (workers <= 1) {
+		return;
+	}
+	for (i = 0; i < l->n; i++) {
+		sprintf(path, "%s.as", l->jobs[i].name);
+		l->jobs[i].size = (stat(path, &st) == 0) ? (long)st.st_size : -1;
+	}
+
+	qsort(l->jobs, l->n, sizeof(*l->jobs), compare_job_sizes);
+}
+
+/*This method frees a list of included files*/
+void include_deps_free(include_dep_t *d)
+{
+	include_dep_t *next;
+
+	for (; d != NULL; d = next) {
+		next = d->next;
+		free(d);
+	}
+}
@@ -0,0 +1,44 @@
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "defs.h"
+
+#include <sys/stat.h>
+
+#define MANIFEST_PREFIX '@' /*An argument starting with it names a manifest file*/
+
+/*A file a source included, directly or through another included file*/
+typedef struct include_dep {
+	char               path[MAX_PATH];
+	struct stat        st;   /* As it was when it was included */
+	struct include_dep *next;
+} include_dep_t;
+
+/*A single source file to assemble*/
+typedef struct job {
+	char *name;    /* Base name of the .as file */
+	char *outname; /* Base name of the outputs - name, or name inside the output directory */
+	long size;     /* Size of the .as file, -1 if it does not exist */
+	int  order;    /* Position on the command line */
+	include_dep_t *includes; /* When it was last assembled, kept for --watch */
+} job_t;
+
+typedef struct job_list {
+	job_t *jobs;
+	int   n;
+	int   capacity;
+	char  **dirs; /* Directories given instead of files */
+	int   ndirs;
+} job_list_t;
+
+void jobs_init(job_list_t *l);
+void jobs_free(job_list_t *l);
+int jobs_add(job_list_t *l, const char *name, const char *outdir);
+int jobs_add_manifest(job_list_t *l, const char *path);
+int jobs_add_directory(job_list_t *l, const char *path, const char *ext);
+int jobs_add_argument(job_list_t *l, const char *arg);
+void jobs_schedule(job_list_t *l, int workers);
+void include_deps_free(include_dep_t *d);
+
+#endif
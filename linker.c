@@ -0,0 +1,426 @@
+#include "assembler.h"
+#include "object.h"
+#include "archive.h"
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*An entry of one of the modules, in the index of all the entries. Also used for a use of
+ * an external - the image word at address gets the address of the entry with this name*/
+typedef struct link_symbol {
+	char name[MAX_LABEL_LENGTH];
+	int  address; /* In the image */
+	int  module;
+} link_symbol_t;
+
+/*The modules being linked, laid out one after the other in a single image*/
+typedef struct linker {
+	job_list_t    *modules;
+	short         *image;
+	int           size;
+	int           image_capacity;
+	short         *relocs; /* Words of the image that hold an address of the image */
+	int           nrelocs;
+	int           relocs_capacity;
+	link_symbol_t *entries;
+	int           nentries;
+	int           entries_capacity;
+	int           *index;  /* Open addressing hash of the entries, -1 for empty */
+	int           index_size;
+	link_symbol_t *uses;
+	int           nuses;
+	int           uses_capacity;
+} linker_t;
+
+/*This method makes room for n elements in a growing array
+ * returns 0 in case of success and -1 otherwise*/
+int link_grow(void *array, int *capacity, int n, size_t size)
+{
+	void *p;
+	int new_capacity;
+
+	if (n <= *capacity) {
+		return 0;
+	}
+
+	new_capacity = (*capacity == 0) ? 256 : *capacity;
+	while (new_capacity < n) {
+		new_capacity *= 2;
+	}
+
+	p = realloc(*(void **)array, new_capacity * size);
+	if (p == NULL) {
+		fprintf(stderr, "Failed to allocate linker tables\n");
+		return -1;
+	}
+	*(void **)array = p;
+	*capacity = new_capacity;
+	return 0;
+}
+
+/*This method forms the hash value of a symbol name, same as calc_hash()*/
+unsigned link_hash(const char *name)
+{
+	unsigned hashval;
+
+	for (hashval = 0; *name != '\0'; name++) {
+		hashval = *name + 31 * hashval;
+	}
+	return hashval;
+}
+
+/*This method finds the slot of a name in the index - the slot holding it, or the empty
+ * slot where it belongs*/
+int *link_slot(linker_t *l, const char *name)
+{
+	unsigned i;
+
+	for (i = link_hash(name) & (l->index_size - 1); ; i = (i + 1) & (l->index_size - 1)) {
+		if (l->index[i] < 0 || strcmp(l->entries[l->index[i]].name, name) == 0) {
+			return &l->index[i];
+		}
+	}
+}
+
+/*This method adds the last entry to the index, growing the index when it gets half full
+ * returns 0 in case of success and -1 otherwise*/
+int link_index_entry(linker_t *l)
+{
+	int *slot;
+	int i;
+
+	if (2 * l->nentries > l->index_size) {
+		free(l->index);
+		l->index_size = (l->index_size == 0) ? 1024 : 2 * l->index_size;
+		l->index = malloc(l->index_size * sizeof(*l->index));
+		if (l->index == NULL) {
+			fprintf(stderr, "Failed to allocate linker tables\n");
+			return -1;
+		}
+		for (i = 0; i < l->index_size; i++) {
+			l->index[i] = -1;
+		}
+		for (i = 0; i < l->nentries - 1; i++) {
+			*link_slot(l, l->entries[i].name) = i;
+		}
+	}
+
+	slot = link_slot(l, l->entries[l->nentries - 1].name);
+	if (*slot >= 0) {
+		fprintf(stderr, "Entry %s of %s is already defined in %s\n", l->entries[l->nentries - 1].name,
+				l->modules->jobs[l->entries[l->nentries - 1].module].name,
+				l->modules->jobs[l->entries[*slot].module].name);
+		l->nentries--;
+		return -1;
+	}
+	*slot = l->nentries - 1;
+	return 0;
+}
+
+/*This method adds a symbol of a module to a table, moved to the address of the module
+ * returns 0 in case of success and -1 otherwise*/
+int link_add_symbol(link_symbol_t **table, int *n, int *capacity, const object_symbol_t *s,
+					int module, int offset)
+{
+	if (link_grow(table, capacity, *n + 1, sizeof(**table)) < 0) {
+		return -1;
+	}
+
+	strcpy((*table)[*n].name, s->name);
+	(*table)[*n].address = s->address + offset;
+	(*table)[*n].module = module;
+	(*n)++;
+	return 0;
+}
+
+/*This method appends a module read to state to the image - its words are moved to the end
+ * of the image, and its entries and uses of externals are added to the tables
+ * returns 0 in case of success and -1 otherwise*/
+int link_module(linker_t *l, int module, assembler_state_t *state, int relocatable)
+{
+	int offset;
+	int i, word;
+	int ret;
+
+	offset = l->size;
+	if (!relocatable && offset > 0) {
+		fprintf(stderr, "Module %s cannot be moved, assemble it with --relocatable\n", state->filename);
+		return -1;
+	}
+
+	if (link_grow(&l->image, &l->image_capacity, l->size + state->IC + state->DC, sizeof(*l->image)) < 0 ||
+		link_grow(&l->relocs, &l->relocs_capacity, l->nrelocs + state->nrelocs, sizeof(*l->relocs)) < 0) {
+		return -1;
+	}
+	memcpy(l->image + l->size, state->code, state->IC * sizeof(*l->image));
+	memcpy(l->image + l->size + state->IC, state->data, state->DC * sizeof(*l->image));
+	l->size += state->IC + state->DC;
+
+	for (i = 0; i < state->nrelocs; i++) {
+		word = l->image[state->relocs[i] - ASSEMBLY_CODE_START_ADDRESS + offset];
+		word += offset << 2;
+		l->image[state->relocs[i] - ASSEMBLY_CODE_START_ADDRESS + offset] = word;
+		l->relocs[l->nrelocs++] = state->relocs[i] + offset;
+	}
+
+	ret = 0;
+	for (i = 0; i < state->nentries; i++) {
+		if (link_add_symbol(&l->entries, &l->nentries, &l->entries_capacity, &state->entries[i],
+							module, offset) < 0 ||
+			link_index_entry(l) < 0) {
+			ret = -1;
+		}
+	}
+	for (i = 0; i < state->nexterns; i++) {
+		if (link_add_symbol(&l->uses, &l->nuses, &l->uses_capacity, &state->externs[i],
+							module, offset) < 0) {
+			return -1;
+		}
+	}
+	return ret;
+}
+
+/*This method reads a module given in the command line and appends it to the image
+ * returns 0 in case of success and -1 otherwise*/
+int link_file(linker_t *l, int module, assembler_state_t *state)
+{
+	int relocatable;
+
+	memset(state, 0, sizeof(*state));
+	state->filename = l->modules->jobs[module].name;
+	state->errfile = stderr;
+
+	relocatable = read_object(state);
+	if (relocatable < 0) {
+		return -1;
+	}
+	return link_module(l, module, state, relocatable);
+}
+
+/*This method appends the archive members that define the externals no module defines,
+ * and then the members that those need, until no archive defines any of the rest.
+ * Each lookup is a single probe of the index of an archive, the members are used right
+ * from the mapping
+ * returns 0 in case of success and -1 otherwise*/
+int link_archives(linker_t *l, const archive_t archives[], int n, assembler_state_t *state)
+{
+	char name[2 * MAX_PATH];
+	object_file_t obj;
+	char **linked;
+	const char *symbol;
+	int error_flag;
+	int i, a, member;
+
+	linked = calloc(n + 1, sizeof(*linked));
+	error_flag = (linked == NULL) ? -1 : 0;
+	for (a = 0; error_flag == 0 && a < n; a++) {
+		linked[a] = calloc(archives[a].header->nmembers + 1, 1);
+		if (linked[a] == NULL) {
+			error_flag = -1;
+		}
+	}
+	if (error_flag < 0) {
+		fprintf(stderr, "Failed to allocate linker tables\n");
+	}
+
+	/* The uses grow as members are appended */
+	for (i = 0; error_flag == 0 && i < l->nuses; i++) {
+		symbol = l->uses[i].name;
+		if (l->index_size > 0 && *link_slot(l, symbol) >= 0) {
+			continue;
+		}
+
+		member = -1;
+		for (a = 0; a < n; a++) {
+			member = archive_find(&archives[a], symbol);
+			if (member >= 0 && !linked[a][member]) {
+				break;
+			}
+		}
+		if (a == n) {
+			continue; /* Reported by link_resolve() */
+		}
+		linked[a][member] = 1;
+
+		sprintf(name, "%.*s(%.*s)", MAX_PATH - 2, archives[a].path,
+				MAX_PATH - 2, archive_member_name(&archives[a], member));
+		memset(state, 0, sizeof(*state));
+		state->filename = name;
+		state->errfile = stderr;
+		if (jobs_add(l->modules, name, NULL) < 0 ||
+			archive_member(&archives[a], member, &obj) < 0 ||
+			object_to_state(&obj, state) < 0 ||
+			link_module(l, l->modules->n - 1, state, 1) < 0) { /* Members are made relocatable */
+			error_flag = -1;
+		}
+	}
+
+	for (a = 0; linked != NULL && a < n; a++) {
+		free(linked[a]);
+	}
+	free(linked);
+	return error_flag;
+}
+
+/*This method patches every use of an external with the address of its entry
+ * returns 0 in case of success and -1 if a symbol is not defined*/
+int link_resolve(linker_t *l)
+{
+	link_symbol_t *use;
+	int error_flag;
+	int entry;
+	int i;
+
+	if (link_grow(&l->relocs, &l->relocs_capacity, l->nrelocs + l->nuses, sizeof(*l->relocs)) < 0) {
+		return -1;
+	}
+
+	error_flag = 0;
+	for (i = 0; i < l->nuses; i++) {
+		use = &l->uses[i];
+		entry = (l->index_size > 0) ? *link_slot(l, use->name) : -1;
+		if (entry < 0) {
+			fprintf(stderr, "Unresolved symbol %s in %s\n", use->name, l->modules->jobs[use->module].name);
+			error_flag = -1;
+			continue;
+		}
+		l->image[use->address - ASSEMBLY_CODE_START_ADDRESS] = (l->entries[entry].address << 2) | ARE_RELOC;
+		l->relocs[l->nrelocs++] = use->address;
+	}
+	return error_flag;
+}
+
+/*Orders relocations by address*/
+int compare_image_relocs(const void *a, const void *b)
+{
+	return *(const short *)a - *(const short *)b;
+}
+
+/*This method writes the linked image, in the same formats the assembler writes
+ * returns 0 in case of success and -1 otherwise*/
+int link_write(linker_t *l, const char *output, const assembler_options_t *options,
+			   assembler_state_t *state)
+{
+	io_ctx_t io;
+	int ret;
+
+	/* Every address must fit the 8 bits of a word */
+	if (ASSEMBLY_CODE_START_ADDRESS + l->size > BIT(8)) {
+		fprintf(stderr, "Linked image is too large - %d words\n", l->size);
+		return -1;
+	}
+
+	qsort(l->relocs, l->nrelocs, sizeof(*l->relocs), compare_image_relocs);
+
+	memset(state, 0, sizeof(*state));
+	state->filename = output;
+	state->options = options;
+	state->errfile = stderr;
+	memcpy(state->code, l->image, l->size * sizeof(*l->image));
+	state->IC = l->size;
+	memcpy(state->relocs, l->relocs, l->nrelocs * sizeof(*l->relocs));
+	state->nrelocs = l->nrelocs;
+
+	io_init(&io, 1, 0);
+	state->io = &io;
+	ret = options->binary ? write_binary_object(state) : write_text_object(state);
+	if (io_flush(&io) < 0) {
+		ret = -1;
+	}
+	io_cleanup(&io);
+	return ret;
+}
+
+/*This method is the main of the linker - lays out the modules given in the command line
+ * (directly or listed in @manifest files) one after the other, in the order given, then
+ * the members of the archives (.oba) they need, and writes them as a single image with
+ * every external resolved*/
+int main(int argc, char *argv[])
+{
+	static assembler_state_t state;
+	assembler_options_t options;
+	const char *output;
+	job_list_t modules;
+	archive_t *archives;
+	int narchives;
+	size_t len;
+	linker_t l;
+	int error_flag;
+	int i;
+
+	memset(&options, 0, sizeof(options));
+	output = "a";
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		} else if (strcmp(argv[i], "--binary") == 0) {
+			options.binary = 1;
+		} else if (strcmp(argv[i], "--relocatable") == 0) {
+			options.relocatable = 1;
+		} else {
+			fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+			return 1;
+		}
+	}
+	if (i == argc || strlen(output) + 5 > MAX_PATH) {
+		fprintf(stderr, "Usage: %s [-o output] [--binary] [--relocatable] module...\n", argv[0]);
+		return 1;
+	}
+
+	archives = malloc(argc * sizeof(*archives));
+	if (archives == NULL) {
+		fprintf(stderr, "Failed to allocate linker tables\n");
+		return 1;
+	}
+
+	jobs_init(&modules);
+	error_flag = 0;
+	narchives = 0;
+	for (; i < argc; i++) {
+		len = strlen(argv[i]);
+		if (len > 4 && argv[i][len - 4] == '.' && strcmp(argv[i] + len - 3, ARCHIVE_EXT) == 0) {
+			if (archive_map(&archives[narchives], argv[i]) < 0) {
+				error_flag = 1;
+			} else {
+				narchives++;
+			}
+		} else if (jobs_add_argument(&modules, argv[i]) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	memset(&l, 0, sizeof(l));
+	l.modules = &modules;
+	for (i = 0; i < modules.n; i++) {
+		/* Keep going after a failure, to report all the symbols defined twice */
+		if (link_file(&l, i, &state) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	if (!error_flag && link_archives(&l, archives, narchives, &state) < 0) {
+		error_flag = 1;
+	}
+
+	if (!error_flag && link_resolve(&l) < 0) {
+		error_flag = 1;
+	}
+	if (!error_flag && link_write(&l, output, &options, &state) < 0) {
+		error_flag = 1;
+	}
+
+	free(l.image);
+	free(l.relocs);
+	free(l.entries);
+	free(l.index);
+	free(l.uses);
+	for (i = 0; i < narchives; i++) {
+		archive_unmap(&archives[i]);
+	}
+	free(archives);
+	jobs_free(&modules);
+	return error_flag;
+}
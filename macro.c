@@ -0,0 +1,349 @@
+#include "assembler.h"
+#include "macro.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*This method initializes an empty macro table*/
+void macro_init(macro_table_t *t)
+{
+	int i;
+
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		(*t)[i] = NULL;
+	}
+}
+
+/*This method frees a macro*/
+void macro_delete(macro_t *m)
+{
+	free(m->body);
+	free(m);
+}
+
+/*This method frees all the macros of a table*/
+void macro_free(macro_table_t *t)
+{
+	macro_t *m, *next;
+	int i;
+
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		for (m = (*t)[i]; m != NULL; m = next) {
+			next = m->next;
+			macro_delete(m);
+		}
+		(*t)[i] = NULL;
+	}
+}
+
+/*This method finds a macro by its name
+ * returns the macro or NULL if there is no such macro*/
+macro_t *macro_find(macro_table_t *t, const char *name)
+{
+	macro_t *m;
+
+	for (m = (*t)[calc_hash(name)]; m != NULL; m = m->next) {
+		if (!strcmp(name, m->name)) {
+			return m;
+		}
+	}
+	return NULL;
+}
+
+/*This method allocates a macro without a body
+ * returns the macro or NULL in case of failure*/
+macro_t *macro_new(const char *name, int line_number)
+{
+	macro_t *m;
+
+	m = malloc(sizeof(*m));
+	if (m == NULL) {
+		fprintf(stderr, "Failed to allocate macro\n");
+		return NULL;
+	}
+	strcpy(m->name, name);
+	m->body = NULL;
+	m->size = 0;
+	m->capacity = 0;
+	m->line_number = line_number;
+	m->expanding = 0;
+	m->next = NULL;
+	return m;
+}
+
+/*This method adds a macro to a table*/
+void macro_add(macro_table_t *t, macro_t *m)
+{
+	int bucket;
+
+	bucket = calc_hash(m->name);
+	m->next = (*t)[bucket];
+	(*t)[bucket] = m;
+}
+
+/*This method adds a line to the body of a macro
+ * returns 0 in case of success and -1 otherwise*/
+int macro_append(macro_t *m, const char *line)
+{
+	long len;
+	char *body;
+
+	len = strlen(line);
+	if (m->size + len + 1 > m->capacity) {
+		m->capacity = (m->capacity == 0) ? MAX_LINE_LENGTH : m->capacity;
+		while (m->size + len + 1 > m->capacity) {
+			m->capacity *= 2;
+		}
+		body = realloc(m->body, m->capacity);
+		if (body == NULL) {
+			fprintf(stderr, "Failed to allocate macro\n");
+			return -1;
+		}
+		m->body = body;
+	}
+
+	memcpy(m->body + m->size, line, len);
+	m->size += len;
+	if (len == 0 || line[len - 1] != '\n') {
+		m->body[m->size++] = '\n';
+	}
+	return 0;
+}
+
+/*This method copies the first word of a line, up to a space or ';'
+ * returns the rest of the line*/
+const char *macro_word(const char *p, char *word)
+{
+	while (isspace((unsigned char)*p)) {
+		p++;
+	}
+	while (*p != '\0' && *p != ';' && !isspace((unsigned char)*p)) {
+		*(word++) = *(p++);
+	}
+	*word = '\0';
+	return p;
+}
+
+/*This method checks if nothing but spaces or a comment is left in a line
+ * returns 1 if so and 0 otherwise*/
+int macro_blank(const char *p)
+{
+	while (isspace((unsigned char)*p)) {
+		p++;
+	}
+	return *p == '\0' || *p == ';';
+}
+
+/*This method starts the definition of a macro, from the rest of a mcro line. The lines
+ * up to endmcro are added to the macro by macro_line()
+ * returns 0 in case of success and -1 otherwise*/
+int macro_define(assembler_state_t *state, const char *rest)
+{
+	char name[MAX_LINE_LENGTH];
+	int error_flag;
+
+	rest = macro_word(rest, name);
+
+	error_flag = 0;
+	if (!strcmp(name, "mcro") || !strcmp(name, "endmcro")) {
+		fprintf(state->errfile, "The name of the macro matches a macro directive, line %d\n", state->line_number);
+		error_flag = -1;
+	} else if (check_label(name, state) < 0) { /*The method "check_label" already gives error prints*/
+		error_flag = -1;
+	} else if (!macro_blank(rest)) {
+		fprintf(state->errfile, "Too many tokens for macro definition, line %d\n", state->line_number);
+		error_flag = -1;
+	} else if (macro_find(&state->macros, name) != NULL) {
+		fprintf(state->errfile, "Macro %s re-defined, line %d\n", name, state->line_number);
+		error_flag = -1;
+	}
+	if (error_flag < 0) {
+		name[0] = '\0'; /* Still take the body, so it is not assembled */
+	}
+
+	state->macro = macro_new(name, state->line_number);
+	if (state->macro == NULL) {
+		return -1;
+	}
+	if (error_flag == 0) {
+		macro_add(&state->macros, state->macro);
+	}
+	return error_flag;
+}
+
+/*This method ends the definition of a macro*/
+void macro_end(assembler_state_t *state)
+{
+	if (state->macro->name[0] == '\0') {
+		macro_delete(state->macro); /* Not in the table */
+	}
+	state->macro = NULL;
+}
+
+/*This method assembles the lines of a macro in place of a line that uses it. The label of
+ * that line, if any, is put on the first line of the macro. The lines are numbered as
+ * where the macro is defined, and their words are mapped to the line that uses it
+ * returns 0 in case of success and -1 otherwise*/
+int macro_expand(assembler_state_t *state, macro_t *m, const char *label)
+{
+	char line[MAX_LINE_LENGTH];
+	int n;
+	int line_number;
+	int error_flag;
+	long pos;
+
+	if (m->expanding) {
+		fprintf(state->errfile, "Macro %s uses itself, line %d\n", m->name, state->line_number);
+		return -1;
+	}
+
+	line_number = state->line_number;
+	state->line_number = m->line_number;
+	if (state->macro_use_line == 0) {
+		state->macro_use_line = line_number; /* Of the outer use, for a macro in a macro */
+	}
+	m->expanding = 1;
+
+	error_flag = 0;
+	pos = 0;
+	n = (label != NULL) ? strlen(label) + 1 : 0;
+	if (n > 0) {
+		sprintf(line, "%s ", label);
+	}
+	while (get_line(line + n, MAX_LINE_LENGTH - n, m->body, m->size, &pos)) {
+		n = 0;
+		state->line_number++;
+		if (assemble_line(state, line) < 0) {
+			error_flag = -1;
+		}
+	}
+
+	m->expanding = 0;
+	state->line_number = line_number;
+	if (state->macro_use_line == line_number) {
+		state->macro_use_line = 0;
+	}
+	if (error_flag < 0) {
+		fprintf(state->errfile, "In macro %s, used at line %d\n", m->name, line_number);
+	}
+	return error_flag;
+}
+
+/*This method is the macro stage, in front of the tokenizer. It takes the lines of a
+ * macro definition and expands the uses of macros
+ * returns 1 if the line was taken, 0 if it should be assembled and -1 in case of error*/
+int macro_line(assembler_state_t *state, const char *line)
+{
+	char word[MAX_LINE_LENGTH], label[MAX_LINE_LENGTH];
+	const char *rest;
+	macro_t *m;
+	int len;
+
+	rest = macro_word(line, word);
+
+	if (state->macro != NULL) {
+		if (strcmp(word, "endmcro") != 0) {
+			return (macro_append(state->macro, line) < 0) ? -1 : 1;
+		}
+		macro_end(state);
+		if (!macro_blank(rest)) {
+			fprintf(state->errfile, "Too many tokens for endmcro, line %d\n", state->line_number);
+			return -1;
+		}
+		return 1;
+	}
+
+	if (!strcmp(word, "mcro")) {
+		return (macro_define(state, rest) < 0) ? -1 : 1;
+	}
+	if (!strcmp(word, "endmcro")) {
+		fprintf(state->errfile, "endmcro without mcro, line %d\n", state->line_number);
+		return -1;
+	}
+
+	/* A use may have a label */
+	len = strlen(word);
+	label[0] = '\0';
+	if (len > 0 && len <= MAX_LABEL_LENGTH && word[len - 1] == ':') {
+		strcpy(label, word);
+		rest = macro_word(rest, word);
+	}
+
+	m = (word[0] != '\0') ? macro_find(&state->macros, word) : NULL;
+	if (m == NULL) {
+		return 0;
+	}
+	if (!macro_blank(rest)) {
+		fprintf(state->errfile, "Too many tokens for macro %s, line %d\n", word, state->line_number);
+		return -1;
+	}
+	return (macro_expand(state, m, (label[0] != '\0') ? label : NULL) < 0) ? -1 : 1;
+}
+
+/*This method checks that the source did not end in the middle of a macro definition
+ * returns 0 in case of success and -1 otherwise*/
+int macro_finish(assembler_state_t *state)
+{
+	if (state->macro == NULL) {
+		return 0;
+	}
+	fprintf(state->errfile, "Missing endmcro for the macro defined in line %d\n", state->macro->line_number);
+	macro_end(state);
+	return -1;
+}
+
+/*This method defines the macros of another table (of an included file) in the source
+ * returns 0 in case of success and -1 otherwise*/
+int macro_copy(assembler_state_t *state, const assembler_state_t *src)
+{
+	macro_t *m, *copy;
+	int error_flag;
+	int i;
+
+	error_flag = 0;
+	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
+		for (m = src->macros[i]; m != NULL; m = m->next) {
+			if (macro_find(&state->macros, m->name) != NULL) {
+				fprintf(state->errfile, "Macro %s re-defined, line %d\n", m->name, state->line_number);
+				error_flag = -1;
+				continue;
+			}
+			copy = macro_new(m->name, m->line_number);
+			if (copy == NULL) {
+				return -1;
+			}
+			copy->body = malloc(m->size + 1);
+			if (copy->body == NULL) {
+				fprintf(stderr, "Failed to allocate macro\n");
+				free(copy);
+				return -1;
+			}
+			memcpy(copy->body, m->body, m->size);
+			copy->size = m->size;
+			copy->capacity = m->size + 1;
+			macro_add(&state->macros, copy);
+		}
+	}
+	return error_flag;
+}
+
+/*This method checks quickly if a source may define macros
+ * returns 1 if it may and 0 if it does not*/
+int macro_in_buffer(const char *buf, long len)
+{
+	const char *p, *end;
+
+	end = buf + len;
+	for (p = buf; p + 4 <= end; p++) {
+		p = memchr(p, 'm', end - p - 3);
+		if (p == NULL) {
+			return 0;
+		}
+		if (!memcmp(p, "mcro", 4)) {
+			return 1;
+		}
+	}
+	return 0;
+}
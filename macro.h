@@ -0,0 +1,31 @@
+
+#ifndef MACRO_H
+#define MACRO_H
+
+#include "defs.h"
+#include "symtable.h"
+
+/*A macro defined by mcro <name> ... endmcro. Its lines are kept as they were written,
+ * one after the other, and assembled again at every use*/
+typedef struct macro macro_t;
+struct macro {
+	char    name[MAX_LABEL_LENGTH];
+	char    *body;       /* The lines, each ends with '\n' */
+	long    size;
+	long    capacity;
+	int     line_number; /* Of the mcro line, the body follows it */
+	int     expanding;   /* To refuse a macro that uses itself */
+	macro_t *next;       /* Next in hash */
+};
+
+typedef macro_t *macro_table_t[SYMBOL_HASH_SIZE];
+
+void macro_init(macro_table_t *t);
+void macro_free(macro_table_t *t);
+macro_t *macro_find(macro_table_t *t, const char *name);
+int macro_line(assembler_state_t *state, const char *line);
+int macro_finish(assembler_state_t *state);
+int macro_copy(assembler_state_t *state, const assembler_state_t *src);
+int macro_in_buffer(const char *buf, long len);
+
+#endif
@@ -0,0 +1,318 @@
+#include "map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*Orders labels by address, and labels of the same address by name*/
+int compare_labels(const void *a, const void *b)
+{
+	const object_symbol_t *x = a, *y = b;
+
+	if (x->address != y->address) {
+		return x->address - y->address;
+	}
+	return strcmp(x->name, y->name);
+}
+
+/*This method collects the code and data labels with their final addresses, for the map.
+ * It must run after the data is placed*/
+void map_collect_labels(assembler_state_t *state)
+{
+	const symbol_t *s;
+	int id;
+
+	state->nlabels = 0;
+	for (id = 0; id < state->symbols.n; id++) {
+		s = symtab_symbol(&state->symbols, id);
+		/* Data dropped by the compaction pass has no address */
+		if ((s->type != SYMBOL_TYPE_CODE && s->type != SYMBOL_TYPE_DATA) || s->index < 0 ||
+			state->nlabels == 2 * LENGTH_MEMORY) {
+			continue;
+		}
+		strcpy(state->labels[state->nlabels].name, symtab_name(&state->symbols, id));
+		state->labels[state->nlabels].address = ASSEMBLY_CODE_START_ADDRESS + s->index +
+			((s->type == SYMBOL_TYPE_DATA) ? state->IC : 0);
+		state->nlabels++;
+	}
+
+	qsort(state->labels, state->nlabels, sizeof(state->labels[0]), compare_labels);
+}
+
+/*This method finds the label every word is under - the last label at or before the word,
+ * in the same segment. labels[w] is -1 for a word before the first label of its segment*/
+void map_word_labels(const assembler_state_t *state, int labels[])
+{
+	int address, label;
+	int i, w;
+
+	i = 0;
+	label = -1;
+	for (w = 0; w < state->IC + state->DC; w++) {
+		address = ASSEMBLY_CODE_START_ADDRESS + w;
+		if (w == state->IC) {
+			label = -1; /* The data is not under the last code label */
+		}
+		while (i < state->nlabels && state->labels[i].address <= address) {
+			label = i++;
+		}
+		labels[w] = label;
+	}
+}
+
+/*This method returns the source line of a word*/
+int map_word_line(const assembler_state_t *state, int w)
+{
+	return (w < state->IC) ? state->code_lines[w] : state->data_lines[w - state->IC];
+}
+
+/*This method writes the map file - a line per code and data word with its address, the
+ * source line it came from and the label it is under, then every label with its segment
+ * and address
+ * returns 0 in case of success and -1 otherwise */
+int write_map(assembler_state_t *state)
+{
+	int labels[2 * LENGTH_MEMORY];
+	char base32[3];
+	const object_symbol_t *l;
+	FILE *mapfile;
+	int w;
+
+	mapfile = io_open_output(state->io, state->filename, "map");
+	if (mapfile == NULL) {
+		return -1;
+	}
+
+	map_word_labels(state, labels);
+	for (w = 0; w < state->IC + state->DC; w++) {
+		to_base32(ASSEMBLY_CODE_START_ADDRESS + w, base32);
+		fprintf(mapfile, "%s %d ", base32, map_word_line(state, w));
+		if (labels[w] < 0) {
+			fprintf(mapfile, "-\n");
+			continue;
+		}
+		l = &state->labels[labels[w]];
+		if (l->address == ASSEMBLY_CODE_START_ADDRESS + w) {
+			fprintf(mapfile, "%s\n", l->name);
+		} else {
+			fprintf(mapfile, "%s+%d\n", l->name, ASSEMBLY_CODE_START_ADDRESS + w - l->address);
+		}
+	}
+
+	fprintf(mapfile, "\n");
+	for (w = 0; w < state->nlabels; w++) {
+		l = &state->labels[w];
+		to_base32(l->address, base32);
+		fprintf(mapfile, "%s %s %s\n", l->name,
+				(l->address < ASSEMBLY_CODE_START_ADDRESS + state->IC) ? "code" : "data", base32);
+	}
+
+	return io_close_output(state->io, mapfile);
+}
+
+/*This method builds a binary map in memory - the same as the map file, in the layout of
+ * map.h. The caller frees *map
+ * returns 0 in case of success and -1 otherwise */
+int map_build(assembler_state_t *state, unsigned char **map, size_t *map_size)
+{
+	int labels[2 * LENGTH_MEMORY];
+	uint32_t names_offsets[2 * LENGTH_MEMORY];
+	map_header_t *h;
+	map_word_t *words;
+	object_record_t *symbols;
+	size_t symbols_offset, names, names_len, size;
+	unsigned char *buf;
+	int n, w;
+
+	n = state->IC + state->DC;
+	symbols_offset = ALIGN4(sizeof(*h) + n * sizeof(*words));
+	names = symbols_offset + state->nlabels * sizeof(*symbols);
+	size = names + state->nlabels * MAX_LABEL_LENGTH;
+
+	buf = calloc(1, size);
+	if (buf == NULL) {
+		fprintf(stderr, "Failed to allocate map %s.%s\n", state->filename, MAP_EXT);
+		return -1;
+	}
+
+	names_len = 0;
+	symbols = (object_record_t *)(buf + symbols_offset);
+	for (w = 0; w < state->nlabels; w++) {
+		names_offsets[w] = object_add_name((char *)buf + names, &names_len, state->labels[w].name);
+		symbols[w].address = state->labels[w].address;
+		symbols[w].reserved = 0;
+		symbols[w].name = names_offsets[w];
+	}
+	size = names + names_len;
+
+	map_word_labels(state, labels);
+	words = (map_word_t *)(buf + sizeof(*h));
+	for (w = 0; w < n; w++) {
+		words[w].address = ASSEMBLY_CODE_START_ADDRESS + w;
+		words[w].line = map_word_line(state, w);
+		if (labels[w] < 0) {
+			words[w].label = MAP_NO_LABEL;
+			words[w].offset = 0;
+		} else {
+			words[w].label = names_offsets[labels[w]];
+			words[w].offset = words[w].address - state->labels[labels[w]].address;
+		}
+	}
+
+	h = (map_header_t *)buf;
+	memcpy(h->magic, MAP_MAGIC, sizeof(h->magic));
+	h->version = MAP_VERSION;
+	h->byte_order = OBJECT_BYTE_ORDER;
+	h->base = ASSEMBLY_CODE_START_ADDRESS;
+	h->code_size = state->IC;
+	h->data_size = state->DC;
+	h->nsymbols = state->nlabels;
+	h->words = sizeof(*h);
+	h->symbols = symbols_offset;
+	h->names = names;
+	h->size = size;
+
+	*map = buf;
+	*map_size = size;
+	return 0;
+}
+
+/*This method writes the mpb file - the binary map built by map_build()
+ * returns 0 in case of success and -1 otherwise */
+int write_binary_map(assembler_state_t *state)
+{
+	unsigned char *buf;
+	size_t size;
+	FILE *f;
+
+	if (map_build(state, &buf, &size) < 0) {
+		return -1;
+	}
+
+	f = io_open_output(state->io, state->filename, MAP_EXT);
+	if (f == NULL) {
+		free(buf);
+		return -1;
+	}
+	fwrite(buf, 1, size, f);
+	free(buf);
+
+	return io_close_output(state->io, f);
+}
+
+/*This method checks a mapped binary map, and points the tables of map into it
+ * returns 0 in case of success and -1 otherwise */
+int map_check(map_file_t *map, const char *path)
+{
+	const map_header_t *h;
+	size_t names_size;
+	int n, i;
+
+	h = map->header = map->map;
+	if (memcmp(h->magic, MAP_MAGIC, sizeof(h->magic)) != 0 || h->version != MAP_VERSION) {
+		fprintf(stderr, "%s is not a map file\n", path);
+		return -1;
+	}
+	if (h->byte_order != OBJECT_BYTE_ORDER) {
+		fprintf(stderr, "Map file %s was written by a host of another byte order\n", path);
+		return -1;
+	}
+
+	n = h->code_size + h->data_size;
+	if (h->size != map->size || h->words % 4 != 0 || h->symbols % 4 != 0 || h->names > map->size ||
+		h->words > h->symbols || (h->symbols - h->words) / sizeof(*map->words) < (size_t)n ||
+		h->symbols > h->names || (h->names - h->symbols) / sizeof(*map->symbols) < h->nsymbols ||
+		(h->names < map->size && ((const char *)map->map)[map->size - 1] != '\0')) {
+		fprintf(stderr, "Invalid map file %s\n", path);
+		return -1;
+	}
+
+	map->words = (const map_word_t *)((const char *)map->map + h->words);
+	map->symbols = (const object_record_t *)((const char *)map->map + h->symbols);
+	map->names = (const char *)map->map + h->names;
+
+	names_size = map->size - h->names;
+	for (i = 0; i < n; i++) {
+		if (map->words[i].label != MAP_NO_LABEL && map->words[i].label >= names_size) {
+			fprintf(stderr, "Invalid map file %s\n", path);
+			return -1;
+		}
+	}
+	for (i = 0; i < h->nsymbols; i++) {
+		if (map->symbols[i].name >= names_size) {
+			fprintf(stderr, "Invalid map file %s\n", path);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*This method maps <filename>.mpb to memory and checks it, the same way object_map() does
+ * returns 0 in case of success and -1 otherwise */
+int map_map(map_file_t *map, const char *filename)
+{
+	char path[MAX_PATH];
+	struct stat st;
+	int fd;
+
+	sprintf(path, "%s.%s", filename, MAP_EXT);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open file %s for reading\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(map_header_t)) {
+		fprintf(stderr, "Invalid map file %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	map->size = st.st_size;
+	map->map = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map->map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map file %s\n", path);
+		return -1;
+	}
+
+	if (map_check(map, path) == 0) {
+		return 0;
+	}
+
+	map_unmap(map);
+	return -1;
+}
+
+/*This method unmaps a map mapped by map_map()*/
+void map_unmap(map_file_t *map)
+{
+	munmap(map->map, map->size);
+	map->map = NULL;
+}
+
+/*This method finds the word of an address, by a binary search of the word table
+ * returns the word or NULL if the address is not in the map*/
+const map_word_t *map_find(const map_file_t *map, int address)
+{
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = map->header->code_size + map->header->data_size;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (map->words[mid].address < address) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo < map->header->code_size + map->header->data_size && map->words[lo].address == address) {
+		return &map->words[lo];
+	}
+	return NULL;
+}
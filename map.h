@@ -0,0 +1,59 @@
+
+#ifndef MAP_H
+#define MAP_H
+
+#include "assembler.h"
+#include "object.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAP_EXT        "mpb"
+#define MAP_MAGIC      "AS1M"
+#define MAP_VERSION    1
+#define MAP_NO_LABEL   0xffffffffu /*A word before the first label of its segment*/
+
+/*The header of a binary source map. Like a binary object, it is in the byte order of the
+ * host that wrote it and every table is 4 byte aligned, so a mapped file is used as it is*/
+typedef struct map_header {
+	char     magic[4];
+	uint16_t version;
+	uint16_t byte_order;
+	uint16_t base;       /* Address of the first code word */
+	uint16_t code_size;  /* In words - the data words follow the code words */
+	uint16_t data_size;
+	uint16_t nsymbols;
+	uint32_t words;      /* Offset of the word table, one per word, ascending by address */
+	uint32_t symbols;    /* Offset of the code and data labels, ascending by address */
+	uint32_t names;      /* Offset of the names, each ends with '\0' */
+	uint32_t size;       /* Of the whole map */
+} map_header_t;
+
+/*Where a code or data word came from*/
+typedef struct map_word {
+	uint16_t address;
+	uint16_t offset;     /* Of the word from its label */
+	uint32_t line;       /* Of the source, or of the .include line for included words */
+	uint32_t label;      /* Offset in the names of the label the word is under, or MAP_NO_LABEL */
+} map_word_t;
+
+/*A binary source map mapped to memory*/
+typedef struct map_file {
+	const map_header_t    *header;
+	const map_word_t      *words;
+	const object_record_t *symbols; /* Code and data labels, as the entries of an object */
+	const char            *names;
+	void                  *map;
+	size_t                size;
+} map_file_t;
+
+void map_collect_labels(assembler_state_t *state);
+int write_map(assembler_state_t *state);
+int map_build(assembler_state_t *state, unsigned char **map, size_t *map_size);
+int write_binary_map(assembler_state_t *state);
+
+int map_map(map_file_t *map, const char *filename);
+void map_unmap(map_file_t *map);
+const map_word_t *map_find(const map_file_t *map, int address);
+
+#endif
@@ -0,0 +1,85 @@
+#include "assembler.h"
+#include "object.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*This method converts one object between the formats
+ * returns 0 in case of success and -1 otherwise*/
+int convert(const char *filename, int to_text, io_ctx_t *io)
+{
+	static assembler_state_t state;
+	assembler_options_t options;
+	object_file_t obj;
+	int ret;
+
+	memset(&options, 0, sizeof(options));
+	memset(&state, 0, sizeof(state));
+	state.filename = filename;
+	state.options = &options;
+	state.errfile = stderr;
+	state.io = io;
+
+	if (to_text) {
+		ret = object_map(&obj, filename);
+		if (ret < 0) {
+			return ret;
+		}
+		ret = object_to_state(&obj, &state);
+		object_unmap(&obj);
+		if (ret == 0) {
+			options.relocatable = (state.nrelocs > 0);
+			ret = write_text_object(&state);
+		}
+	} else {
+		ret = read_text_object(&state);
+		if (ret == 0) {
+			options.relocatable = (state.nrelocs > 0);
+			ret = write_binary_object(&state);
+		}
+	}
+
+	return ret;
+}
+
+/*This method converts the objects given in the command line - the text outputs of the
+ * assembler (.ob, .ent, .ext and .rel) to a binary .obb, or back with -t*/
+int main(int argc, char *argv[])
+{
+	io_ctx_t io;
+	int to_text;
+	int error_flag;
+	int i;
+
+	to_text = 0;
+	i = 1;
+	if (i < argc && strcmp(argv[i], "-t") == 0) {
+		to_text = 1;
+		i++;
+	}
+	if (i == argc) {
+		fprintf(stderr, "Usage: %s [-t] file...\n", argv[0]);
+		return 1;
+	}
+
+	io_init(&io, IO_DEFAULT_DEPTH, 0);
+
+	error_flag = 0;
+	for (; i < argc; i++) {
+		if (strlen(argv[i]) + 5 > MAX_PATH) {
+			fprintf(stderr, "File name %s is too long\n", argv[i]);
+			error_flag = 1;
+			continue;
+		}
+		if (convert(argv[i], to_text, &io) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	if (io_flush(&io) < 0) {
+		error_flag = 1;
+	}
+	io_cleanup(&io);
+	return error_flag;
+}
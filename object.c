@@ -0,0 +1,677 @@
+#include "object.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*This method write the obj file of the assembler
+ * returns 0 in case of success and -1 otherwise */
+int write_object(assembler_state_t *state)
+{
+	char addr_base32[3], word_base32[3];
+	int i, address, word;
+	FILE *obfile;
+
+	/* open .ob file */
+	obfile = io_open_output(state->io, state->filename, "ob");
+	if (obfile == NULL) {
+		return -1;
+	}
+
+	address = ASSEMBLY_CODE_START_ADDRESS;
+
+	for (i = 0; i < state->IC; i++) {
+		word = state->code[i];
+		to_base32(address, addr_base32);
+		to_base32(word, word_base32);
+		fprintf(obfile, "%s %s\n", addr_base32, word_base32);
+		address++;
+	}
+
+	for (i = 0; i < state->DC; i++) {
+		word = state->data[i];
+		to_base32(address, addr_base32);
+		to_base32(word, word_base32);
+		fprintf(obfile, "%s %s\n", addr_base32, word_base32);
+		address++;
+	}
+
+	return io_close_output(state->io, obfile);
+}
+
+/*This method writes a list of symbols and addresses to a text output, which is created
+ * only when the list is not empty
+ * returns 0 in case of success and -1 otherwise */
+int write_symbols(assembler_state_t *state, const char *ext, const object_symbol_t symbols[], int n)
+{
+	char base32[3];
+	FILE *f;
+	int i;
+
+	if (n == 0) {
+		return 0;
+	}
+
+	f = io_open_output(state->io, state->filename, ext);
+	if (f == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		to_base32(symbols[i].address, base32);
+		fprintf(f, "%s %s\n", symbols[i].name, base32);
+	}
+
+	return io_close_output(state->io, f);
+}
+
+/*This method writes the ent file of the assembler
+ * returns 0 in case of success and -1 otherwise */
+int write_entries(assembler_state_t *state)
+{
+	return write_symbols(state, "ent", state->entries, state->nentries);
+}
+
+/*This method writes the ext file of the assembler
+ * returns 0 in case of success and -1 otherwise */
+int write_externals(assembler_state_t *state)
+{
+	return write_symbols(state, "ext", state->externs, state->nexterns);
+}
+
+/*This method writes the rel file of the assembler - the address of every word that holds
+ * an address in the object, one per line
+ * returns 0 in case of success and -1 otherwise */
+int write_relocations(assembler_state_t *state)
+{
+	char base32[3];
+	FILE *relfile;
+	int i;
+
+	relfile = io_open_output(state->io, state->filename, "rel");
+	if (relfile == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < state->nrelocs; i++) {
+		to_base32(state->relocs[i], base32);
+		fprintf(relfile, "%s\n", base32);
+	}
+
+	return io_close_output(state->io, relfile);
+}
+
+/*This method writes the dep file of the assembler - what the module exports and imports,
+ * for a build to find the modules that depend on each other (see depgraph.c). A line
+ *   entry <name> <address>
+ * for every entry, then a line
+ *   extern <name> <number of uses>
+ * for every external the code uses. It is written even when both are empty
+ * returns 0 in case of success and -1 otherwise */
+int write_dependencies(assembler_state_t *state)
+{
+	char base32[3];
+	FILE *depfile;
+	int i, uses;
+
+	depfile = io_open_output(state->io, state->filename, DEPS_EXT);
+	if (depfile == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < state->nentries; i++) {
+		to_base32(state->entries[i].address, base32);
+		fprintf(depfile, "entry %s %s\n", state->entries[i].name, base32);
+	}
+
+	/* The uses of an external follow each other, see symtab_update_relocations() */
+	for (i = 0; i < state->nexterns; i += uses) {
+		for (uses = 1; i + uses < state->nexterns &&
+			 strcmp(state->externs[i + uses].name, state->externs[i].name) == 0; uses++)
+			;
+		fprintf(depfile, "extern %s %d\n", state->externs[i].name, uses);
+	}
+
+	return io_close_output(state->io, depfile);
+}
+
+/*This method writes all the text outputs - ob, ext, ent and with --relocatable rel.
+ * The linker takes a module with a rel as one that can be moved, so without
+ * --relocatable the rel of an earlier run is removed
+ * returns 0 in case of success and -1 otherwise */
+int write_text_object(assembler_state_t *state)
+{
+	char path[MAX_PATH];
+
+	if (write_externals(state) < 0 || write_entries(state) < 0) {
+		return -1;
+	}
+	if (state->options->relocatable) {
+		if (write_relocations(state) < 0) {
+			return -1;
+		}
+	} else {
+		sprintf(path, "%.*s.rel", MAX_PATH - 5, state->filename);
+		if (remove(path) < 0 && errno != ENOENT) {
+			fprintf(stderr, "Cannot remove file %s\n", path);
+			return -1;
+		}
+	}
+	return write_object(state);
+}
+
+/*This method reads a text symbol list (.ent or .ext). A missing file is an empty list
+ * returns the number of symbols or -1 in case of failure*/
+int read_text_symbols(const char *filename, const char *ext, object_symbol_t symbols[], int size)
+{
+	char path[MAX_PATH], line[MAX_LINE_LENGTH];
+	char name[MAX_LINE_LENGTH], address[MAX_LINE_LENGTH];
+	int n;
+	FILE *f;
+
+	sprintf(path, "%s.%s", filename, ext);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return 0;
+	}
+
+	n = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%s %s", name, address) != 2) {
+			continue;
+		}
+		if (n == size || strlen(name) >= MAX_LABEL_LENGTH || strlen(address) != 2 ||
+			from_base32(address) < 0) {
+			fprintf(stderr, "Invalid line in %s: %s", path, line);
+			fclose(f);
+			return -1;
+		}
+		strcpy(symbols[n].name, name);
+		symbols[n].address = from_base32(address);
+		n++;
+	}
+
+	fclose(f);
+	return n;
+}
+
+/*This method reads a text relocation table (.rel). A missing file is an empty table
+ * returns the number of relocations or -1 in case of failure*/
+int read_text_relocations(assembler_state_t *state)
+{
+	char path[MAX_PATH], line[MAX_LINE_LENGTH], address[MAX_LINE_LENGTH];
+	int n;
+	FILE *f;
+
+	sprintf(path, "%s.rel", state->filename);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return 0;
+	}
+
+	n = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%s", address) != 1) {
+			continue;
+		}
+		if (n == LENGTH_MEMORY || strlen(address) != 2 ||
+			from_base32(address) < ASSEMBLY_CODE_START_ADDRESS ||
+			from_base32(address) >= ASSEMBLY_CODE_START_ADDRESS + state->IC) {
+			fprintf(stderr, "Invalid line in %s: %s", path, line);
+			fclose(f);
+			return -1;
+		}
+		state->relocs[n++] = from_base32(address);
+	}
+
+	fclose(f);
+	return n;
+}
+
+/*This method reads the text outputs of the assembler to state. The .ob does not tell
+ * where the code ends, so the words are all taken as code, up to the size of the memory
+ * returns 0 in case of success and -1 otherwise*/
+int read_text_object(assembler_state_t *state)
+{
+	char line[MAX_LINE_LENGTH], address[MAX_LINE_LENGTH], word[MAX_LINE_LENGTH];
+	int expected, ret;
+	FILE *f;
+
+	f = open_file_with_ext(state->filename, "ob", "r");
+	if (f == NULL) {
+		return -1;
+	}
+
+	ret = 0;
+	expected = ASSEMBLY_CODE_START_ADDRESS;
+	while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%s %s", address, word) != 2) {
+			continue;
+		}
+		if (strlen(address) != 2 || strlen(word) != 2 ||
+			from_base32(address) != expected || from_base32(word) < 0 ||
+			state->IC + state->DC == 2 * LENGTH_MEMORY) {
+			fprintf(stderr, "Invalid line in %s.ob: %s", state->filename, line);
+			ret = -1;
+			break;
+		}
+		if (state->IC < LENGTH_MEMORY) {
+			state->code[state->IC++] = from_base32(word);
+		} else {
+			state->data[state->DC++] = from_base32(word);
+		}
+		expected++;
+	}
+	fclose(f);
+	if (ret < 0) {
+		return ret;
+	}
+
+	state->nentries = read_text_symbols(state->filename, "ent", state->entries, 2 * LENGTH_MEMORY);
+	state->nexterns = read_text_symbols(state->filename, "ext", state->externs, LENGTH_MEMORY);
+	state->nrelocs = read_text_relocations(state);
+	return (state->nentries < 0 || state->nexterns < 0 || state->nrelocs < 0) ? -1 : 0;
+}
+
+/*This method checks if the text outputs of a module were written after its binary object
+ * returns 1 if they were and 0 otherwise*/
+int text_object_newer(const char *filename, const struct stat *binary)
+{
+	char path[MAX_PATH];
+	struct stat st;
+
+	sprintf(path, "%.*s.ob", MAX_PATH - 4, filename);
+	if (stat(path, &st) < 0) {
+		return 0;
+	}
+	return st.st_mtim.tv_sec > binary->st_mtim.tv_sec ||
+		   (st.st_mtim.tv_sec == binary->st_mtim.tv_sec && st.st_mtim.tv_nsec > binary->st_mtim.tv_nsec);
+}
+
+/*This method reads an assembled module to state - <name>.obb when there is one, or else
+ * the text outputs. When both are there, the ones written last are read, as a module
+ * assembled again to the other format leaves the outputs of the run before
+ * returns 1 if it can be moved, 0 if it cannot and -1 in case of failure*/
+int read_object(assembler_state_t *state)
+{
+	char path[MAX_PATH];
+	object_file_t obj;
+	struct stat st;
+	int i, ret;
+
+	sprintf(path, "%s.%s", state->filename, OBJECT_EXT);
+	if (stat(path, &st) < 0 || text_object_newer(state->filename, &st)) {
+		if (read_text_object(state) < 0) {
+			return -1;
+		}
+		sprintf(path, "%s.rel", state->filename);
+		return access(path, R_OK) == 0;
+	}
+
+	if (object_map(&obj, state->filename) < 0) {
+		return -1;
+	}
+	ret = object_to_state(&obj, state);
+	object_unmap(&obj);
+	if (ret < 0) {
+		return -1;
+	}
+
+	/* Without a relocation table it still moves if it has no address to fix */
+	if (state->nrelocs == 0) {
+		for (i = 0; i < state->IC; i++) {
+			if ((state->code[i] & 3) == ARE_RELOC) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+/*This method computes the checksum of a binary object (32 bit FNV-1a)*/
+uint32_t object_checksum(const unsigned char *p, size_t len)
+{
+	uint32_t hash;
+	size_t i;
+
+	hash = 2166136261u;
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ p[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/*This method adds a name to the names of a binary object, unless it is already there
+ * returns the offset of the name*/
+uint32_t object_add_name(char *names, size_t *len, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < *len; i += strlen(names + i) + 1) {
+		if (strcmp(names + i, name) == 0) {
+			return i;
+		}
+	}
+
+	strcpy(names + *len, name);
+	*len += strlen(name) + 1;
+	return i;
+}
+
+/*This method fills a table of a binary object*/
+void object_fill_records(object_record_t *records, const object_symbol_t symbols[], int n,
+						 char *names, size_t *names_len)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		records[i].address = symbols[i].address;
+		records[i].reserved = 0;
+		records[i].name = object_add_name(names, names_len, symbols[i].name);
+	}
+}
+
+/*This method builds a binary object in memory - the ob, ext, ent and rel outputs together.
+ * The caller frees *object
+ * returns 0 in case of success and -1 otherwise */
+int object_build(assembler_state_t *state, unsigned char **object, size_t *object_size)
+{
+	object_header_t *h;
+	uint16_t *words;
+	size_t entries, externs, relocs, names, names_len, size;
+	unsigned char *buf;
+	int nrelocs;
+	int i;
+
+	nrelocs = state->options->relocatable ? state->nrelocs : 0;
+
+	entries = ALIGN4(sizeof(*h) + (state->IC + state->DC) * sizeof(*words));
+	externs = entries + state->nentries * sizeof(object_record_t);
+	relocs = externs + state->nexterns * sizeof(object_record_t);
+	names = ALIGN4(relocs + nrelocs * sizeof(*words));
+	size = names + (state->nentries + state->nexterns) * MAX_LABEL_LENGTH;
+
+	buf = calloc(1, size);
+	if (buf == NULL) {
+		fprintf(stderr, "Failed to allocate object %s.%s\n", state->filename, OBJECT_EXT);
+		return -1;
+	}
+
+	words = (uint16_t *)(buf + sizeof(*h));
+	for (i = 0; i < state->IC; i++) {
+		*(words++) = state->code[i];
+	}
+	for (i = 0; i < state->DC; i++) {
+		*(words++) = state->data[i];
+	}
+
+	words = (uint16_t *)(buf + relocs);
+	for (i = 0; i < nrelocs; i++) {
+		words[i] = state->relocs[i];
+	}
+
+	names_len = 0;
+	object_fill_records((object_record_t *)(buf + entries), state->entries, state->nentries,
+						(char *)buf + names, &names_len);
+	object_fill_records((object_record_t *)(buf + externs), state->externs, state->nexterns,
+						(char *)buf + names, &names_len);
+	size = names + names_len;
+
+	h = (object_header_t *)buf;
+	memcpy(h->magic, OBJECT_MAGIC, sizeof(h->magic));
+	h->version = OBJECT_VERSION;
+	h->byte_order = OBJECT_BYTE_ORDER;
+	h->base = ASSEMBLY_CODE_START_ADDRESS;
+	h->code_size = state->IC;
+	h->data_size = state->DC;
+	h->nentries = state->nentries;
+	h->nexterns = state->nexterns;
+	h->nrelocs = nrelocs;
+	h->entries = entries;
+	h->externs = externs;
+	h->relocs = relocs;
+	h->names = names;
+	h->size = size;
+	h->checksum = object_checksum(buf + sizeof(*h), size - sizeof(*h));
+
+	*object = buf;
+	*object_size = size;
+	return 0;
+}
+
+/*This method writes the obb file - the binary object built by object_build()
+ * returns 0 in case of success and -1 otherwise */
+int write_binary_object(assembler_state_t *state)
+{
+	unsigned char *buf;
+	size_t size;
+	FILE *f;
+
+	if (object_build(state, &buf, &size) < 0) {
+		return -1;
+	}
+
+	f = io_open_output(state->io, state->filename, OBJECT_EXT);
+	if (f == NULL) {
+		free(buf);
+		return -1;
+	}
+	fwrite(buf, 1, size, f);
+	free(buf);
+
+	return io_close_output(state->io, f);
+}
+
+/*This method checks that a table of a binary object is inside it, and that its names are
+ * returns 0 in case of success and -1 otherwise */
+int object_check_records(const object_file_t *obj, uint32_t offset, int n)
+{
+	const object_record_t *records;
+	size_t names_size;
+	int i;
+
+	if (offset % 4 != 0 || offset > obj->size || (obj->size - offset) / sizeof(*records) < (size_t)n) {
+		return -1;
+	}
+
+	records = (const object_record_t *)((const char *)obj->map + offset);
+	names_size = obj->size - obj->header->names;
+	for (i = 0; i < n; i++) {
+		if (records[i].name >= names_size) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*This method checks that the relocation table of a binary object is inside it, and that it
+ * only points to code words, in order
+ * returns 0 in case of success and -1 otherwise */
+int object_check_relocs(const object_file_t *obj)
+{
+	const object_header_t *h = obj->header;
+	int i;
+
+	if (h->relocs % 2 != 0 || h->relocs > obj->size ||
+		(obj->size - h->relocs) / sizeof(*obj->relocs) < h->nrelocs) {
+		return -1;
+	}
+
+	for (i = 0; i < h->nrelocs; i++) {
+		if (obj->relocs[i] < h->base || obj->relocs[i] >= h->base + h->code_size ||
+			(i > 0 && obj->relocs[i] <= obj->relocs[i - 1])) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*This method checks a binary object already in memory at obj->map, and points the tables
+ * of obj into it. path is only used for the diagnostics
+ * returns 0 in case of success and -1 otherwise */
+int object_check(object_file_t *obj, const char *path)
+{
+	const object_header_t *h;
+
+	if (obj->size < sizeof(*h) || (size_t)obj->map % 4 != 0) {
+		fprintf(stderr, "Invalid object file %s\n", path);
+		return -1;
+	}
+
+	h = obj->header = obj->map;
+	obj->code = (const uint16_t *)(h + 1);
+	obj->data = obj->code + h->code_size;
+	obj->entries = (const object_record_t *)((const char *)obj->map + h->entries);
+	obj->externs = (const object_record_t *)((const char *)obj->map + h->externs);
+	obj->relocs = (const uint16_t *)((const char *)obj->map + h->relocs);
+	obj->names = (const char *)obj->map + h->names;
+
+	if (memcmp(h->magic, OBJECT_MAGIC, sizeof(h->magic)) != 0 || h->version != OBJECT_VERSION) {
+		fprintf(stderr, "%s is not an object file\n", path);
+	} else if (h->byte_order != OBJECT_BYTE_ORDER) {
+		fprintf(stderr, "Object file %s was written by a host of another byte order\n", path);
+	} else if (h->size != obj->size || h->names > obj->size ||
+			   sizeof(*h) + (h->code_size + h->data_size) * sizeof(*obj->code) > h->entries ||
+			   object_check_records(obj, h->entries, h->nentries) < 0 ||
+			   object_check_records(obj, h->externs, h->nexterns) < 0 ||
+			   object_check_relocs(obj) < 0 ||
+			   (h->names < obj->size && ((const char *)obj->map)[obj->size - 1] != '\0')) {
+		fprintf(stderr, "Invalid object file %s\n", path);
+	} else if (object_checksum((const unsigned char *)(h + 1), obj->size - sizeof(*h)) != h->checksum) {
+		fprintf(stderr, "Object file %s is corrupted\n", path);
+	} else {
+		return 0;
+	}
+	return -1;
+}
+
+/*This method maps <filename>.obb to memory and checks it. Nothing is parsed, the tables
+ * of the object point right into the mapping
+ * returns 0 in case of success and -1 otherwise */
+int object_map(object_file_t *obj, const char *filename)
+{
+	char path[MAX_PATH];
+	struct stat st;
+	int fd;
+
+	sprintf(path, "%s.%s", filename, OBJECT_EXT);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open file %s for reading\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(object_header_t)) {
+		fprintf(stderr, "Invalid object file %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	obj->size = st.st_size;
+	obj->map = mmap(NULL, obj->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (obj->map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map file %s\n", path);
+		return -1;
+	}
+
+	if (object_check(obj, path) == 0) {
+		return 0;
+	}
+
+	object_unmap(obj);
+	return -1;
+}
+
+/*This method unmaps an object mapped by object_map()*/
+void object_unmap(object_file_t *obj)
+{
+	munmap(obj->map, obj->size);
+	obj->map = NULL;
+}
+
+/*This method copies the code and data of a mapped object to image, as if they were loaded
+ * at base instead of at the address they were assembled for. Only the words listed in the
+ * relocation table are changed, in a single pass
+ * returns 0 in case of success and -1 if an address does not fit in its word*/
+int object_rebase(const object_file_t *obj, int base, uint16_t image[])
+{
+	const object_header_t *h = obj->header;
+	int size, address;
+	uint16_t *word;
+	int i;
+
+	size = h->code_size + h->data_size;
+	memcpy(image, obj->code, size * sizeof(image[0]));
+	if (base + size > BIT(8)) {
+		return -1;
+	}
+
+	for (i = 0; i < h->nrelocs; i++) {
+		word = &image[obj->relocs[i] - h->base];
+		address = (*word >> 2) - h->base + base;
+		*word = (address << 2) | (*word & 3);
+	}
+	return 0;
+}
+
+/*This method copies the records of a mapped object to a symbol list
+ * returns the number of symbols or -1 if they do not fit*/
+int object_copy_records(const object_file_t *obj, const object_record_t *records, int n,
+						object_symbol_t symbols[], int size)
+{
+	int i;
+
+	if (n > size) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (strlen(obj->names + records[i].name) >= MAX_LABEL_LENGTH) {
+			return -1;
+		}
+		strcpy(symbols[i].name, obj->names + records[i].name);
+		symbols[i].address = records[i].address;
+	}
+	return n;
+}
+
+/*This method copies a mapped object to the code, data, entries and externals of state,
+ * so the text outputs can be written from it
+ * returns 0 in case of success and -1 otherwise */
+int object_to_state(const object_file_t *obj, assembler_state_t *state)
+{
+	const object_header_t *h = obj->header;
+	int i;
+
+	if (h->base != ASSEMBLY_CODE_START_ADDRESS || h->code_size > LENGTH_MEMORY || h->data_size > LENGTH_MEMORY) {
+		fprintf(stderr, "Object %s does not fit the memory\n", state->filename);
+		return -1;
+	}
+
+	for (i = 0; i < h->code_size; i++) {
+		state->code[i] = obj->code[i];
+	}
+	for (i = 0; i < h->data_size; i++) {
+		state->data[i] = obj->data[i];
+	}
+	state->IC = h->code_size;
+	state->DC = h->data_size;
+
+	for (i = 0; i < h->nrelocs; i++) {
+		state->relocs[i] = obj->relocs[i];
+	}
+	state->nrelocs = h->nrelocs;
+
+	state->nentries = object_copy_records(obj, obj->entries, h->nentries, state->entries, 2 * LENGTH_MEMORY);
+	state->nexterns = object_copy_records(obj, obj->externs, h->nexterns, state->externs, LENGTH_MEMORY);
+	if (state->nentries < 0 || state->nexterns < 0) {
+		fprintf(stderr, "Object %s has too many symbols\n", state->filename);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "assembler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OBJECT_EXT        "obb"
+#define OBJECT_MAGIC      "AS10"
+#define OBJECT_VERSION    2
+#define OBJECT_BYTE_ORDER 0x0102 /*Reads differently on a host of the other byte order*/
+#define ALIGN4(n) (((n) + 3) & ~(size_t)3)
+#define DEPS_EXT          "dep"
+
+/*The header of a binary object. Every field is in the byte order of the host that wrote
+ * it, and every table starts at a 4 byte aligned offset, so a mapped object is used
+ * as it is. The code words come right after the header, followed by the data words*/
+typedef struct object_header {
+	char     magic[4];
+	uint16_t version;
+	uint16_t byte_order;
+	uint16_t base;       /* Address of the first code word */
+	uint16_t code_size;  /* In words */
+	uint16_t data_size;
+	uint16_t nentries;
+	uint16_t nexterns;
+	uint16_t nrelocs;    /* 0 unless written with --relocatable */
+	uint32_t entries;    /* Offset of the entry table */
+	uint32_t externs;    /* Offset of the extern table */
+	uint32_t relocs;     /* Offset of the relocation table - the address of every word
+	                      * that holds an address in this object, ascending */
+	uint32_t names;      /* Offset of the names, each ends with '\0' */
+	uint32_t size;       /* Of the whole object */
+	uint32_t checksum;   /* Of everything after the header */
+} object_header_t;
+
+/*An entry, or a code word that uses an external*/
+typedef struct object_record {
+	uint16_t address;
+	uint16_t reserved;
+	uint32_t name;       /* Offset in the names */
+} object_record_t;
+
+/*A binary object mapped to memory*/
+typedef struct object_file {
+	const object_header_t *header;
+	const uint16_t        *code;
+	const uint16_t        *data;
+	const object_record_t *entries;
+	const object_record_t *externs;
+	const uint16_t        *relocs;
+	const char            *names;
+	void                  *map;
+	size_t                size;
+} object_file_t;
+
+int write_object(assembler_state_t *state);
+int write_entries(assembler_state_t *state);
+int write_externals(assembler_state_t *state);
+int write_relocations(assembler_state_t *state);
+int write_dependencies(assembler_state_t *state);
+int write_text_object(assembler_state_t *state);
+int write_binary_object(assembler_state_t *state);
+
+int read_text_symbols(const char *filename, const char *ext, object_symbol_t symbols[], int size);
+int read_text_relocations(assembler_state_t *state);
+int read_text_object(assembler_state_t *state);
+int read_object(assembler_state_t *state);
+
+uint32_t object_add_name(char *names, size_t *len, const char *name);
+int object_build(assembler_state_t *state, unsigned char **object, size_t *object_size);
+int object_check(object_file_t *obj, const char *path);
+int object_map(object_file_t *obj, const char *filename);
+void object_unmap(object_file_t *obj);
+int object_rebase(const object_file_t *obj, int base, uint16_t image[]);
+int object_to_state(const object_file_t *obj, assembler_state_t *state);
+
+#endif
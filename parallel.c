@@ -0,0 +1,164 @@
+#include "assembler.h"
+#include "symtable.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*A part of the source file that is assembled by its own thread, into its own state*/
+typedef struct chunk {
+	assembler_state_t state;
+	const char        *buf;
+	long              len;
+	int               first_line; /* Lines before this chunk */
+	char              *errors;    /* Diagnostics of this chunk, printed after the join */
+	size_t            errors_size;
+	int               ret;
+	pthread_t         thread;
+	int               started;
+} chunk_t;
+
+/*This method splits the source to at most n chunks of about the same size, at line boundaries.
+ * The lines are counted the same way fgets() splits them, so each chunk knows its first line number.
+ * returns the number of chunks*/
+int split_to_chunks(const char *buf, long len, chunk_t *chunks, int n)
+{
+	const char *nl;
+	long pos, next;
+	int lines;
+	int k;
+
+	k = 0;
+	lines = 0;
+	chunks[0].buf = buf;
+	chunks[0].first_line = 0;
+
+	for (pos = 0; pos < len; pos = next) {
+		nl = memchr(buf + pos, '\n', len - pos);
+		next = (nl != NULL) ? (nl - buf + 1) : len;
+
+		/* fgets() returns a long line in pieces of MAX_LINE_LENGTH-1 characters */
+		lines += (next - pos + MAX_LINE_LENGTH - 2) / (MAX_LINE_LENGTH - 1);
+
+		if (k + 1 < n && next < len && next >= len / n * (k + 1)) {
+			chunks[k].len = buf + next - chunks[k].buf;
+			k++;
+			chunks[k].buf = buf + next;
+			chunks[k].first_line = lines;
+		}
+	}
+	chunks[k].len = buf + len - chunks[k].buf;
+
+	return k + 1;
+}
+
+/*This method is the thread function that assembles one chunk*/
+void *chunk_worker(void *arg)
+{
+	chunk_t *c = arg;
+
+	c->state.errfile = open_memstream(&c->errors, &c->errors_size);
+	if (c->state.errfile == NULL) {
+		c->state.errfile = stderr;
+	}
+
+	c->state.line_number = c->first_line;
+	c->ret = generate_from_buffer(&c->state, c->buf, c->len);
+
+	if (c->state.errfile != stderr) {
+		fclose(c->state.errfile);
+	}
+	return NULL;
+}
+
+/*This method appends the code, data and symbols of an assembled chunk to the state.
+ * The chunk counters are local, so its symbols and relocations are shifted by the
+ * code and data already in the state.
+ * returns 0 in case of success and -1 otherwise*/
+int merge_chunk(assembler_state_t *state, chunk_t *c)
+{
+	data_block_t *b;
+	int ret;
+	int i;
+
+	if (c->errors != NULL) {
+		fwrite(c->errors, 1, c->errors_size, state->errfile);
+	}
+
+	if (state->IC + c->state.IC <= LENGTH_MEMORY) {
+		memcpy(state->code + state->IC, c->state.code, c->state.IC * sizeof(state->code[0]));
+		memcpy(state->code_lines + state->IC, c->state.code_lines, c->state.IC * sizeof(state->code_lines[0]));
+	}
+	if (state->DC + c->state.DC <= LENGTH_MEMORY) {
+		memcpy(state->data + state->DC, c->state.data, c->state.DC * sizeof(state->data[0]));
+		memcpy(state->data_lines + state->DC, c->state.data_lines, c->state.DC * sizeof(state->data_lines[0]));
+	}
+
+	ret = symtab_merge(&state->symbols, &c->state.symbols, state->IC, state->DC, state);
+
+	/* The ids of the chunk are its own, the labels are found again by name */
+	for (i = 0; i < c->state.ndata_blocks; i++) {
+		if (state->ndata_blocks < LENGTH_MEMORY && i < LENGTH_MEMORY) {
+			b = &state->data_blocks[state->ndata_blocks];
+			*b = c->state.data_blocks[i];
+			b->dc += state->DC;
+			if (b->symbol >= 0) {
+				b->symbol = symtab_find(&state->symbols, symtab_name(&c->state.symbols, b->symbol));
+			}
+		}
+		state->ndata_blocks++;
+	}
+
+	state->IC += c->state.IC;
+	state->DC += c->state.DC;
+	state->line_number += c->state.line_number - c->first_line;
+
+	return (c->ret < 0) ? c->ret : ret;
+}
+
+/*This method assembles a big source by splitting it to chunks that are parsed in parallel,
+ * one thread per job, and merging their results in source order.
+ * The result is identical to assembling the whole buffer with generate_from_buffer().
+ * returns 0 in case of success and -1 otherwise */
+int generate_code_and_data_parallel(assembler_state_t *state, const char *buf, long len)
+{
+	chunk_t *chunks;
+	int n, i;
+	int ret;
+	int error_flag;
+
+	chunks = calloc(state->options->jobs, sizeof(*chunks));
+	if (chunks == NULL) {
+		fprintf(stderr, "Failed to allocate chunks\n");
+		return -1;
+	}
+
+	n = split_to_chunks(buf, len, chunks, state->options->jobs);
+
+	for (i = 0; i < n; i++) {
+		init_state(&chunks[i].state, state->filename, state->options);
+		chunks[i].started = (pthread_create(&chunks[i].thread, NULL, chunk_worker, &chunks[i]) == 0);
+		if (!chunks[i].started) {
+			chunk_worker(&chunks[i]); /* No more threads, assemble it here */
+		}
+	}
+
+	error_flag = 0;
+	for (i = 0; i < n; i++) {
+		if (chunks[i].started) {
+			pthread_join(chunks[i].thread, NULL);
+		}
+
+		ret = merge_chunk(state, &chunks[i]);
+		if (ret < 0) {
+			error_flag = ret;
+		}
+
+		free(chunks[i].errors);
+		cleanup_state(&chunks[i].state);
+	}
+
+	free(chunks);
+	return error_flag;
+}
@@ -1,6 +1,7 @@
 
 #include "assembler.h"
 #include "symtable.h"
+#include "encoding.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -19,7 +20,7 @@ int get_next_token(assembler_state_t *state, char **tok, char **operands)
 		p++;
 	}
 	if (*p == ',') {
-		fprintf(stderr, "Invalid comma, line %d\n", state->line_number);
+		fprintf(state->errfile, "Invalid comma, line %d\n", state->line_number);
 		return -1;
 	}
 
@@ -35,7 +36,7 @@ int get_next_token(assembler_state_t *state, char **tok, char **operands)
 		do {
 			p++;
 			if (*p == '\0') {
-				fprintf(stderr, "Missing \", line %d\n", state->line_number);
+				fprintf(state->errfile, "Missing \", line %d\n", state->line_number);
 				return -1;
 			}
 		} while (*p != '"');
@@ -59,12 +60,12 @@ int get_next_token(assembler_state_t *state, char **tok, char **operands)
 			p++;
 		}
 		if (*p == '\0') {
-			fprintf(stderr, "Invalid comma in line end, line %d\n", state->line_number);
+			fprintf(state->errfile, "Invalid comma in line end, line %d\n", state->line_number);
 			return -1;
 		}
 	} else if (*p != '\0') {
 		/* Not end and not a comma - error */
-		fprintf(stderr, "Unexpected token, line %d\n", state->line_number);
+		fprintf(state->errfile, "Unexpected token, line %d\n", state->line_number);
 		return -1;
 	}
 
@@ -74,7 +75,8 @@ int get_next_token(assembler_state_t *state, char **tok, char **operands)
 	return 0;
 }
 
-/*This method gets the next number and checks if a number is valid returns 0 for valid and -1 otherwise*/
+/*This method gets the next number, a constant expression (see expr_evaluate()),
+ * and checks if it is valid returns 0 for valid and -1 otherwise*/
 int get_next_number(assembler_state_t *state, int *number, char **operands) {
 	char *number_str;
 	int ret;
@@ -84,42 +86,43 @@ int get_next_number(assembler_state_t *state, int *number, char **operands) {
 		return ret;
 	}
 
-	return my_atoi(state, number_str, number);
+	return expr_evaluate(state, number_str, number);
 }
 
-/*This method adds a word to code array and increment the ic value*/
-void emit_code(assembler_state_t *state, int word) {
-	word = word & 1023;
-	state->code[state->IC++] = word;
+/*This method returns the line of the source the words being parsed come from, for the
+ * map - the line of the use of a macro for the lines of the macro*/
+int source_line(const assembler_state_t *state)
+{
+	return (state->macro_use_line != 0) ? state->macro_use_line : state->line_number;
 }
 
-/*This method adds a symbol to code array and increment the ic value
- returns 0 in case of emit success and -1 otherwise*/
-int emit_relocation(assembler_state_t *state, const char *symbol_name) {
-	int ret;
-
-	ret = symtab_new_operand(&state->symbols, symbol_name, state->IC);
-	if (ret < 0) {
-		return ret;
+/*This method adds a word to code array and increment the ic value
+ * words beyond LENGTH_MEMORY are only counted, the overflow is reported by the caller*/
+void emit_code(assembler_state_t *state, int word) {
+	word = word & 1023;
+	if (state->IC < LENGTH_MEMORY) {
+		state->code[state->IC] = word;
 	}
-
-	emit_code(state, 0);
-	return 0;
+	state->IC++;
 }
 
 /*This method adds a number to data array and increment the dc value*/
 void emit_data(assembler_state_t *state, int number)
 {
 	number = number & 1023; /*Use of '&' to mask off all the other bits except the 10 first ones*/
-	state->data[state->DC++] = number;
+	if (state->DC < LENGTH_MEMORY) {
+		state->data[state->DC] = number;
+		state->data_lines[state->DC] = source_line(state);
+	}
+	state->DC++;
 }
 
 /*This method adds a string to data array and increment the dc value*/
 void emit_data_string(assembler_state_t *state, const char *string)
 {
-	do {
+	while (*string != '\0') {
 		emit_data(state, *(string++));
-	} while (*string != '\0');
+	}
 	emit_data(state, 0);
 }
 
@@ -164,7 +167,7 @@ int get_next_and_last_string(assembler_state_t *state, char **string, char **ope
 	if (*s == '"') {
 		++s;
 	} else {
-		fprintf(stderr, "String must begin with apostrophes, line %d\n", state->line_number);
+		fprintf(state->errfile, "String must begin with apostrophes, line %d\n", state->line_number);
 		return -1;
 	}
 
@@ -172,7 +175,7 @@ int get_next_and_last_string(assembler_state_t *state, char **string, char **ope
 	if (len > 0 && s[len - 1] == '"') {
 		s[len - 1] = '\0';
 	} else {
-		fprintf(stderr, "String must end with apostrophes, line %d\n", state->line_number);
+		fprintf(state->errfile, "String must end with apostrophes, line %d\n", state->line_number);
 		return -1;
 	}
 
@@ -181,7 +184,7 @@ int get_next_and_last_string(assembler_state_t *state, char **string, char **ope
 	/* Make sure no more tokens */
 	ret = get_next_token(state, &s, operands);
 	if (ret == 0) {
-		fprintf(stderr, "Too many tokens for string, line %d\n", state->line_number);
+		fprintf(state->errfile, "Too many tokens for string, line %d\n", state->line_number);
 		return -1;
 	}
 
@@ -204,25 +207,404 @@ int parse_string(operation_info_t *info, assembler_state_t *state, char *operand
 	return 0;
 }
 
-/*This method parse a .struct operation, checks for mistakes afterwards adds the struct operands to data array
+/*This method parse an .include operation - the lines of the given file are assembled
+ * in place of it, see include_file()
  * returns 0 in case of parse success and -1 otherwise*/
-int parse_struct(operation_info_t *info, assembler_state_t *state, char *operands)
+int parse_include(operation_info_t *info, assembler_state_t *state, char *operands)
 {
-	int number, ret;
-	char *string;
+	char *name;
+	int ret;
 
-	/* The first operand is a number*/
-	ret = get_next_number(state, &number, &operands);
-	if (ret < 0) /*The method "get_next_token" already gives error prints*/
+	ret = get_next_and_last_string(state, &name, &operands);
+	if (ret < 0) { /*The method "get_next_and_last_string" already gives error prints*/
 		return ret;
+	}
 
-	emit_data(state, number);
+	return include_file(state, name);
+}
 
-	ret = get_next_and_last_string(state, &string, &operands);
-	if (ret < 0) /*The method "get_next_and_last_string" already gives error prints*/
+/*This method finds a struct type of .structdef by its name
+ * returns the type or NULL if there is no such type*/
+const struct_type_t *struct_find(const assembler_state_t *state, const char *name)
+{
+	int i;
+
+	for (i = 0; i < state->nstruct_types; i++) {
+		if (!strcmp(state->struct_types[i].name, name)) {
+			return &state->struct_types[i];
+		}
+	}
+	return NULL;
+}
+
+/*This method adds the struct types of an included file to the source, the same way
+ * macro_copy() adds its macros. Their names were spliced as constants already
+ * returns 0 in case of success and -1 otherwise*/
+int struct_copy(assembler_state_t *state, const assembler_state_t *src)
+{
+	int i;
+
+	for (i = 0; i < src->nstruct_types; i++) {
+		if (state->nstruct_types == MAX_STRUCT_TYPES) {
+			fprintf(state->errfile, "Too many struct types, line %d\n", state->line_number);
+			return -1;
+		}
+		state->struct_types[state->nstruct_types++] = src->struct_types[i];
+	}
+	return 0;
+}
+
+/*This method finds a field of a struct type by its name
+ * returns the word of the field in a struct of the type (1 based), or -1 if the type has
+ * no such field*/
+int struct_field_of(const struct_type_t *type, const char *name)
+{
+	int offset, i;
+
+	offset = 0;
+	for (i = 0; i < type->nfields; i++) {
+		if (!strcmp(type->field[i], name)) {
+			return offset + 1;
+		}
+		offset += type->size[i];
+	}
+	return -1;
+}
+
+/*This method finds the word of a field named in an expression, in the scope the
+ * expression is evaluated in (see state->field_scope)
+ * returns the word of the field or -1 if the name is not a field there*/
+int struct_field_number(const assembler_state_t *state, const char *name)
+{
+	int number, i;
+
+	if (state->field_scope >= 0) {
+		return struct_field_of(&state->struct_types[state->field_scope], name);
+	}
+	for (i = 0; state->field_scope == FIELDS_ANY && i < state->nstruct_types; i++) {
+		number = struct_field_of(&state->struct_types[i], name);
+		if (number > 0) {
+			return number;
+		}
+	}
+	return -1;
+}
+
+/*This method finds the next name in an expression that is a field of any struct type.
+ * The label of length(LABEL) is not a field
+ * returns the place after the name, or NULL if there are no more*/
+const char *struct_next_field(const assembler_state_t *state, const char *p, char *name)
+{
+	int len, i;
+
+	while (*p != '\0') {
+		if (!isalpha(*p)) {
+			p++;
+			continue;
+		}
+		for (len = 0; isalnum(p[len]); len++)
+			;
+		if (len == 6 && !strncmp(p, "length", 6) && p[len] == '(') {
+			for (p += len; *p != '\0' && *p != ')'; p++)
+				;
+			continue;
+		}
+		if (len < MAX_LABEL_LENGTH) {
+			sprintf(name, "%.*s", len, p);
+			for (i = 0; i < state->nstruct_types; i++) {
+				if (struct_field_of(&state->struct_types[i], name) > 0) {
+					return p + len;
+				}
+			}
+		}
+		p += len;
+	}
+	return NULL;
+}
+
+/*This method finds the struct type a label was defined with - LABEL: .struct TYPE
+ * returns the type or -1 if the label is not of a struct type in this source*/
+int struct_of_label(const assembler_state_t *state, int symbol)
+{
+	int i;
+
+	for (i = 0; i < state->ndata_blocks && i < LENGTH_MEMORY; i++) {
+		if (state->data_blocks[i].symbol == symbol) {
+			return state->data_blocks[i].struct_type;
+		}
+	}
+	return -1;
+}
+
+/*This method evaluates the field of LABEL.field that names fields, in the struct type of
+ * LABEL. When the type of the label is not known here (an external) every field named must
+ * be the same word in all the struct types that define it
+ * returns 0 in case of success and -1 otherwise*/
+int struct_field_value(assembler_state_t *state, int type, const char *label, const char *expr, int *number)
+{
+	char name[MAX_LABEL_LENGTH];
+	const char *p;
+	int field, i;
+	int ret;
+
+	for (p = struct_next_field(state, expr, name); p != NULL; p = struct_next_field(state, p, name)) {
+		if (type >= 0 && struct_field_of(&state->struct_types[type], name) < 0) {
+			fprintf(state->errfile, "%s is not a field of struct %s of %s, line %d\n", name,
+					state->struct_types[type].name, label, state->line_number);
+			return -1;
+		}
+		field = -1;
+		for (i = 0; type < 0 && i < state->nstruct_types; i++) {
+			ret = struct_field_of(&state->struct_types[i], name);
+			if (ret > 0 && field > 0 && ret != field) {
+				fprintf(state->errfile, "Field %s is not the same in all struct types, the type of %s is not known, line %d\n",
+						name, label, state->line_number);
+				return -1;
+			}
+			field = (ret > 0) ? ret : field;
+		}
+	}
+
+	state->field_scope = (type >= 0) ? type : FIELDS_ANY;
+	ret = expr_evaluate(state, expr, number);
+	state->field_scope = FIELDS_NONE;
+	return ret;
+}
+
+/*This method resolves every LABEL.field, once all the labels are defined. A field that
+ * names fields is evaluated in the struct type of the label, and the word must be in a
+ * struct of that type
+ * returns 0 in case of success and -1 otherwise*/
+int struct_resolve(assembler_state_t *state)
+{
+	instruction_t *insn;
+	const char *label;
+	int line_number, error_flag;
+	int type, number;
+	int i, j;
+
+	line_number = state->line_number;
+	error_flag = 0;
+	for (i = 0; i < state->ninstructions && i < LENGTH_MEMORY; i++) {
+		insn = &state->instructions[i];
+		for (j = 0; j < insn->n; j++) {
+			if (insn->type[j] != ADDR_STRUCT) {
+				continue;
+			}
+			state->line_number = insn->line_number;
+			label = symtab_name(&state->symbols, insn->symbol[j]);
+			type = struct_of_label(state, insn->symbol[j]);
+
+			number = insn->value[j];
+			if (number < 0 &&
+				struct_field_value(state, type, label, state->struct_fields[-number - 1], &number) < 0) {
+				error_flag = -1;
+				continue;
+			}
+			if (number < 1 || number > MAX_FIELD_NUMBER ||
+				(type >= 0 && number > state->struct_types[type].words)) {
+				fprintf(state->errfile, "Field %d is out of struct %s, line %d\n", number, label, state->line_number);
+				error_flag = -1;
+				continue;
+			}
+			insn->value[j] = number;
+		}
+	}
+	state->line_number = line_number;
+	return error_flag;
+}
+
+/*This method parse a .structdef operation - the name of a struct type and its fields,
+ * separated by commas. A field is a name, a number of a single word, or name[size], a
+ * string of size words with its '\0'. The type is defined as a constant of its size in
+ * words, and must be defined before it is used. The names of the fields belong to the
+ * type - LABEL.field is the word of the field in the struct type of LABEL, see
+ * struct_resolve()
+ *  returns 0 in case of parse success and -1 otherwise*/
+int parse_structdef(operation_info_t *info, assembler_state_t *state, char *operands) {
+	char *fields[MAX_STRUCT_FIELDS];
+	struct_type_t type;
+	char *name, *p;
+	int offset, size, len, ret;
+	int i;
+
+	/* Skip leading spaces */
+	while (isspace(*operands)) {
+		operands++;
+	}
+	name = operands;
+	while (*operands != '\0' && !isspace(*operands)) {
+		operands++;
+	}
+	if (*operands == '\0') {
+		fprintf(state->errfile, "Missing fields of struct type, line %d\n", state->line_number);
+		return -1;
+	}
+	*(operands++) = '\0'; /*End the name of the type*/
+
+	ret = check_label(name, state);
+	if (ret < 0) {/*The method "check_label" already gives error prints*/
 		return ret;
-	/* The second operand is a string*/
-	emit_data_string(state, string);
+	}
+	if (state->nstruct_types == MAX_STRUCT_TYPES) {
+		fprintf(state->errfile, "Too many struct types, line %d\n", state->line_number);
+		return -1;
+	}
+	strcpy(type.name, name);
+
+	offset = 0;
+	for (type.nfields = 0; ; type.nfields++) {
+		ret = get_next_token(state, &p, &operands);
+		if (ret == END_OF_TOKENS) {
+			break;
+		} else if (ret < 0) {/*The method "get_next_token" already gives error prints*/
+			return ret;
+		}
+		if (type.nfields == MAX_STRUCT_FIELDS) {
+			fprintf(state->errfile, "Too many fields of struct type %s, line %d\n", name, state->line_number);
+			return -1;
+		}
+		fields[type.nfields] = p;
+
+		size = 1;
+		p = strchr(fields[type.nfields], '[');
+		if (p != NULL) { /* A string of the given size */
+			*(p++) = '\0';
+			len = strlen(p);
+			if (len < 2 || p[len - 1] != ']') {
+				fprintf(state->errfile, "Invalid size of field %s, line %d\n", fields[type.nfields],
+						state->line_number);
+				return -1;
+			}
+			p[len - 1] = '\0';
+			ret = expr_evaluate(state, p, &size);
+			if (ret < 0) {
+				return ret;
+			}
+			if (size < 1 || size > LENGTH_MEMORY) {
+				fprintf(state->errfile, "Invalid size of field %s, line %d\n", fields[type.nfields],
+						state->line_number);
+				return -1;
+			}
+		}
+
+		ret = check_label(fields[type.nfields], state);
+		if (ret < 0) {
+			return ret;
+		}
+		for (i = 0; i < type.nfields; i++) {
+			if (!strcmp(fields[i], fields[type.nfields])) {
+				fprintf(state->errfile, "Field %s of struct type %s re-defined, line %d\n", fields[i], name,
+						state->line_number);
+				return -1;
+			}
+		}
+		if (offset >= MAX_FIELD_NUMBER) {
+			fprintf(state->errfile, "Struct type %s is too large, line %d\n", name, state->line_number);
+			return -1;
+		}
+		type.size[type.nfields] = size;
+		type.is_string[type.nfields] = (p != NULL);
+		offset += size;
+	}
+	if (type.nfields == 0) {
+		fprintf(state->errfile, "Missing fields of struct type, line %d\n", state->line_number);
+		return -1;
+	}
+
+	ret = symtab_new_constant(&state->symbols, name, offset, state);
+	if (ret < 0) { /*The method symtab_new_constant already gives specified error*/
+		return ret;
+	}
+	type.words = offset;
+	for (i = 0; i < type.nfields; i++) {
+		strcpy(type.field[i], fields[i]);
+	}
+
+	state->struct_types[state->nstruct_types++] = type;
+	return 0; /*Parse operand succeed*/
+}
+
+/*This method parse a .struct operation - the values of the fields of a struct, separated
+ * by commas, each a number or a string. When they follow the name of a struct type they
+ * are checked against its fields, a string is padded to the size of its field and the
+ * fields without a value are 0
+ * returns 0 in case of parse success and -1 otherwise*/
+int parse_struct(operation_info_t *info, assembler_state_t *state, char *operands)
+{
+	const struct_type_t *type;
+	char *value, *p, c;
+	int field, number, dc, len, ret;
+
+	/* Skip leading spaces */
+	while (isspace(*operands)) {
+		operands++;
+	}
+
+	/* The name of a type is followed by a space, a value by a comma */
+	type = NULL;
+	for (p = operands; isalnum(*p); p++)
+		;
+	if (p > operands && (*p == '\0' || isspace(*p))) {
+		c = *p;
+		*p = '\0';
+		type = struct_find(state, operands);
+		*p = c;
+		if (type != NULL) {
+			operands = p;
+		}
+	}
+	state->line_struct_type = (type != NULL) ? type - state->struct_types : -1;
+
+	for (field = 0; ; field++) {
+		ret = get_next_token(state, &value, &operands);
+		if (ret == END_OF_TOKENS) {
+			break;
+		} else if (ret < 0) {/*The method "get_next_token" already gives error prints*/
+			return ret;
+		}
+		if (type != NULL && field == type->nfields) {
+			fprintf(state->errfile, "Too many fields of struct %s, line %d\n", type->name, state->line_number);
+			return -1;
+		}
+
+		dc = state->DC;
+		if (*value == '"') { /* get_next_token() made sure the string ends with '"' */
+			len = strlen(value);
+			value[len - 1] = '\0';
+			if (type != NULL && (!type->is_string[field] || len - 2 >= type->size[field])) {
+				fprintf(state->errfile, "Invalid string of field %d of struct %s, line %d\n", field + 1,
+						type->name, state->line_number);
+				return -1;
+			}
+			emit_data_string(state, value + 1);
+		} else {
+			if (type != NULL && type->is_string[field]) {
+				fprintf(state->errfile, "Missing string of field %d of struct %s, line %d\n", field + 1,
+						type->name, state->line_number);
+				return -1;
+			}
+			ret = expr_evaluate(state, value, &number);
+			if (ret < 0) {
+				return ret;
+			}
+			emit_data(state, number);
+		}
+
+		while (type != NULL && state->DC - dc < type->size[field]) {
+			emit_data(state, 0);
+		}
+	}
+
+	if (type == NULL && field == 0) {
+		fprintf(state->errfile, "Missing fields of struct, line %d\n", state->line_number);
+		return -1;
+	}
+	for (; type != NULL && field < type->nfields; field++) {
+		for (dc = 0; dc < type->size[field]; dc++) {
+			emit_data(state, 0);
+		}
+	}
 
 	return 0; /*Success*/
 }
@@ -231,6 +613,7 @@ int parse_struct(operation_info_t *info, assembler_state_t *state, char *operand
  * and -1 otherwise */
 int parse_operand(assembler_state_t *state, char *operand_str, operand_info_t *opinfo)
 {
+	char name[MAX_LABEL_LENGTH];
 	int register_id, ret;
 	char *p;
 
@@ -241,14 +624,14 @@ int parse_operand(assembler_state_t *state, char *operand_str, operand_info_t *o
 			opinfo->data.register_id = register_id;
 			return 0;
 		} else {
-			fprintf(stderr, "Invalid register name, line %d\n", state->line_number);
+			fprintf(state->errfile, "Invalid register name, line %d\n", state->line_number);
 			return -1;
 		}
 	}
 
 	if (operand_str[0] == '#') {
 		opinfo->type = ADDR_IMMEDIATE;
-		return my_atoi(state, operand_str + 1, &opinfo->data.immediate);
+		return expr_evaluate(state, operand_str + 1, &opinfo->data.immediate);
 	}
 
 	p = strchr(operand_str, '.');
@@ -261,13 +644,26 @@ int parse_operand(assembler_state_t *state, char *operand_str, operand_info_t *o
 		}
 		opinfo->data.struc.label = operand_str;
 
-		ret = my_atoi(state, p + 1, &opinfo->data.struc.field_number);
+		/* A field of .structdef is of the struct type of the label, which may be defined
+		 * later - it is evaluated once all the labels are, see struct_resolve() */
+		if (struct_next_field(state, p + 1, name) != NULL) {
+			if (state->nstruct_fields == LENGTH_MEMORY) {
+				fprintf(state->errfile, "Too many struct fields, line %d\n", state->line_number);
+				return -1;
+			}
+			strcpy(state->struct_fields[state->nstruct_fields++], p + 1);
+			opinfo->data.struc.field_number = -state->nstruct_fields;
+			return 0;
+		}
+
+		/* A number - the word of the struct it is at */
+		ret = expr_evaluate(state, p + 1, &opinfo->data.struc.field_number);
 		if (ret < 0) {
 			return ret;
 		}
 
-		if (opinfo->data.struc.field_number !=1 && opinfo->data.struc.field_number != 2) {
-			fprintf(stderr, "Illegal filed number, line %d\n", state->line_number);
+		if (opinfo->data.struc.field_number < 1 || opinfo->data.struc.field_number > MAX_FIELD_NUMBER) {
+			fprintf(state->errfile, "Illegal filed number, line %d\n", state->line_number);
 			return -1;
 		}
 
@@ -281,95 +677,137 @@ int parse_operand(assembler_state_t *state, char *operand_str, operand_info_t *o
 	}
 
 	/*The operand does not fit to any addressing methods*/
-	fprintf(stderr, "Invalid operand, line %d\n", state->line_number);
+	fprintf(state->errfile, "Invalid operand, line %d\n", state->line_number);
 	return -1;
 }
 
-/*This method emits the opcode to the code array
- * returns 0 in case of emit success and -1 otherwise*/
-void emit_opcode(operation_info_t *info, assembler_state_t *state, operand_info_t opinfo[], int n)
-{
-	int word;
-	/* Build first word of the operation */
-	if (n == 1) {
-		word = opinfo[0].type << 2; /* Fill bits 2,3 - single destination operand */
-	} else if (n == 2) {
-		word = (opinfo[0].type << 4) | /* Fill bits 4,5 - source operand is first */
-			   (opinfo[1].type << 2); /* Fill bits 2,3 - dest operand is second */
-	} else {
-		word = 0;
-	}
-	word |= info->opcode << 6; /* Add opcode */
-
-	/* Emit opcode word */
-	emit_code(state, word);
-}
-
-/*This method emits a given number of operands to code array
- * returns 0 in case of emit success and -1 otherwise*/
-int emit_n_operands(operation_info_t *info, assembler_state_t *state, operand_info_t opinfo[], int n)
+/*This method checks the addressing modes of the operands and records the instruction,
+ * leaving room for its words in the code array. The words are emitted later by
+ * encode_instructions()
+ * returns 0 in case of success and -1 otherwise*/
+int record_instruction(operation_info_t *info, assembler_state_t *state, operand_info_t opinfo[], int n)
 {
-	int word;
+	instruction_t *insn, dummy;
+	const encoding_t *e;
 	int i;
-	int ret;
 
-	if (n >= 1) {
-		if ((BIT(opinfo[0].type) & info->legal_addrmode_1st_op) == 0) {
-			fprintf(stderr, "Illegal addressing mode of 1st operand, line %d\n", state->line_number);
-			return -1;
-		}
-	}
-	if (n >= 2) {
-		if ((BIT(opinfo[1].type) & info->legal_addrmode_2nd_op) == 0) {
-			fprintf(stderr, "Illegal addressing mode of 2nd operand, line %d\n", state->line_number);
-			return -1;
-		}
+	/* Past the end the instruction is only counted, the overflow is reported by the caller */
+	insn = (state->ninstructions < LENGTH_MEMORY) ? &state->instructions[state->ninstructions] : &dummy;
+
+	insn->opcode = info->opcode;
+	insn->n = n;
+	insn->line_number = source_line(state);
+	for (i = 0; i < 2; i++) { /* A missing operand is immediate 0, see encoding.h */
+		insn->type[i] = (i < n) ? opinfo[i].type : ADDR_IMMEDIATE;
+		insn->value[i] = 0;
+		insn->symbol[i] = -1;
 	}
 
-	/* Special case - 2 registers */
-	if (n == 2 && opinfo[0].type == ADDR_REGISTER && opinfo[1].type == ADDR_REGISTER) {
-		word = (opinfo[1].data.register_id << 2) | /* 2-5 - Dest operand */
-			   (opinfo[0].data.register_id << 6);  /* 6-9 - Source operand */
-		emit_code(state, word);
-		return 0;
+	e = encoding_of(insn);
+	if ((e->legal & ENCODING_LEGAL_1ST) == 0) {
+		fprintf(state->errfile, "Illegal addressing mode of 1st operand, line %d\n", state->line_number);
+		return -1;
+	}
+	if ((e->legal & ENCODING_LEGAL_2ND) == 0) {
+		fprintf(state->errfile, "Illegal addressing mode of 2nd operand, line %d\n", state->line_number);
+		return -1;
 	}
 
 	for (i = 0; i < n; i++) {
 		switch (opinfo[i].type) {
 		case ADDR_IMMEDIATE:
-			word = opinfo[i].data.immediate << 2; /*ARE=00 */
-			emit_code(state, word);
+			insn->value[i] = opinfo[i].data.immediate;
 			break;
 		case ADDR_DIRECT:
-			ret = emit_relocation(state, opinfo[i].data.label);
-			if (ret < 0) {
-				return ret;
+			insn->symbol[i] = symtab_new_operand(&state->symbols, opinfo[i].data.label);
+			if (insn->symbol[i] < 0) {
+				return -1;
 			}
 			break;
 		case ADDR_STRUCT:
-			ret = emit_relocation(state, opinfo[i].data.struc.label);
-			if (ret < 0) {
-				return ret;
+			insn->symbol[i] = symtab_new_operand(&state->symbols, opinfo[i].data.struc.label);
+			if (insn->symbol[i] < 0) {
+				return -1;
 			}
-			word = opinfo[i].data.struc.field_number << 2; /* Emit field number */
-			emit_code(state, word); /*ARE=00 */
+			insn->value[i] = opinfo[i].data.struc.field_number;
 			break;
 		case ADDR_REGISTER:
-			if (i == (n-1))
-				word = opinfo[i].data.register_id << 2; /* Dest operand */
-			else
-				word = opinfo[i].data.register_id << 6; /* Source operand */
-
-			emit_code(state, word); /*ARE=00 */
+			insn->value[i] = opinfo[i].data.register_id;
 			break;
 		}
 	}
 
+	state->ninstructions++;
+	state->IC += e->size;
+	return 0;
+}
+
+/*This method emits the words of a single instruction to the code array, as its encoding
+ * tells - every operand value goes to its word the same way, so there is no case for any
+ * mode. A label operand adds a relocation of its word
+ * returns 0 in case of emit success and -1 otherwise*/
+int encode_instruction(assembler_state_t *state, const instruction_t *insn)
+{
+	int words[ENCODING_MAX_WORDS + 1]; /* And one for the value of a missing operand */
+	const encoding_t *e;
+	int ic, i;
+	int ret;
+
+	e = encoding_of(insn);
+	words[0] = e->first;
+	for (i = 1; i <= ENCODING_MAX_WORDS; i++) {
+		words[i] = 0;
+	}
+	words[e->word[0]] |= insn->value[0] << e->shift[0];
+	words[e->word[1]] |= insn->value[1] << e->shift[1];
+
+	ic = state->IC;
+	for (i = 0; i < e->size; i++) {
+		emit_code(state, words[i]);
+	}
+
+	/* The word is filled when the symbol is resolved */
+	for (i = 0; i < insn->n; i++) {
+		if (insn->symbol[i] >= 0) {
+			ret = symtab_new_relocation(symtab_symbol(&state->symbols, insn->symbol[i]), ic + e->reloc[i]);
+			if (ret < 0) {
+				return ret;
+			}
+		}
+	}
+
 	return 0;
 }
 
-/*This method parse a given number of operands and then first emits the
- *  opcode to code array and second emits the operands to code array
+/*This method encodes all the recorded instructions, in order, to the code array and
+ * adds their relocations
+ * returns 0 in case of success and -1 otherwise*/
+int encode_instructions(assembler_state_t *state)
+{
+	int size, ic;
+	int ret;
+	int i;
+
+	size = state->IC;
+	state->IC = 0;
+
+	for (i = 0; i < state->ninstructions && i < LENGTH_MEMORY; i++) {
+		ic = state->IC;
+		ret = encode_instruction(state, &state->instructions[i]);
+		if (ret < 0) {
+			state->IC = size;
+			return ret;
+		}
+		for (; ic < state->IC && ic < LENGTH_MEMORY; ic++) {
+			state->code_lines[ic] = state->instructions[i].line_number;
+		}
+	}
+
+	state->IC = size;
+	return 0;
+}
+
+/*This method parse a given number of operands and then records the instruction
  *  returns 0 in case of parse success and -1 otherwise*/
 int parse_n_operands(operation_info_t *info, assembler_state_t *state, char *operands, int n) {
 	operand_info_t opinfo[2]; /*There are two fields(operands) in operation_info struct - one is a number second a string*/
@@ -390,12 +828,11 @@ int parse_n_operands(operation_info_t *info, assembler_state_t *state, char *ope
 
 	ret = get_next_token(state, &operand_str, &operands);
 	if (ret == 0) {
-		fprintf(stderr, "Too many operands, line %d\n", state->line_number);
+		fprintf(state->errfile, "Too many operands, line %d\n", state->line_number);
 		return -1;
 	}
 
-	emit_opcode(info, state, opinfo, n);
-	return emit_n_operands(info, state, opinfo, n);
+	return record_instruction(info, state, opinfo, n);
 }
 
 /*This method parse 0 operands returns 0 in success and -1 otherwise*/
@@ -437,13 +874,58 @@ int parse_entry(operation_info_t *info, assembler_state_t *state, char *operands
 
 	ret = get_next_token(state, &operand_str, &operands);
 	if (ret == 0) {
-		fprintf(stderr, "Too many operands, line %d\n", state->line_number);
+		fprintf(state->errfile, "Too many operands, line %d\n", state->line_number);
 		return -1;
 	}
 
 	return 0;
 }
 
+/*This method parse an .equ operation - a name and its value, a constant expression,
+ * separated by spaces. The value is given wherever the name is used in an expression
+ *  returns 0 in case of parse success and -1 otherwise*/
+int parse_equ(operation_info_t *info, assembler_state_t *state, char *operands) {
+	char *name, *operand_str;
+	int number, ret;
+
+	/* Skip leading spaces */
+	while (isspace(*operands)) {
+		operands++;
+	}
+	name = operands;
+	while (*operands != '\0' && !isspace(*operands)) {
+		operands++;
+	}
+	if (*operands == '\0') {
+		fprintf(state->errfile, "Missing value of constant, line %d\n", state->line_number);
+		return -1;
+	}
+	*(operands++) = '\0'; /*End the name of the constant*/
+
+	ret = check_label(name, state);
+	if (ret < 0) {/*The method "check_label" already gives error prints*/
+		return ret;
+	}
+
+	ret = get_next_number(state, &number, &operands);
+	if (ret < 0) {/*The method "get_next_number" already gives error prints*/
+		return ret;
+	}
+
+	ret = get_next_token(state, &operand_str, &operands);
+	if (ret == 0) {
+		fprintf(state->errfile, "Too many operands, line %d\n", state->line_number);
+		return -1;
+	}
+
+	ret = symtab_new_constant(&state->symbols, name, number, state);
+	if (ret < 0) { /*The method symtab_new_constant already gives specified error*/
+		return ret;
+	}
+
+	return 0; /*Parse operand succeed*/
+}
+
 /*This method parse an .extern operation, checks for mistakes,
  *  if the operand is valid adds it to data array
  *  returns 0 in case of parse success and -1 otherwise*/
@@ -460,20 +942,24 @@ int parse_extern(operation_info_t *info, assembler_state_t *state, char *operand
 		return ret;
 	}
 	ret = symtab_new_label(&state->symbols, operand_str,
-			               SYMBOL_TYPE_EXTERNAL, 0, 0);
+			               SYMBOL_TYPE_EXTERNAL, 0, 0, state);
 	if (ret < 0) { /*The method symtab_new_label already gives specified error*/
 		return ret;
 	}
 
 	ret = get_next_token(state, &operand_str, &operands);
 	if (ret == 0) {
-		fprintf(stderr, "Too many operands, line %d\n", state->line_number);
+		fprintf(state->errfile, "Too many operands, line %d\n", state->line_number);
 		return -1;
 	}
 
 	return 0; /*Parse operand succeed*/
 }
 
+/*An instruction of ops[] - the parse method is picked by the number of operands*/
+#define OPERATION(name, opcode, legal_1st, legal_2nd, n) \
+	{name, opcode, SYMBOL_TYPE_CODE, legal_1st, legal_2nd, parse_##n##operands},
+
 /*A structure of operands and their information
  * 1)the name of the operation
  * 2)the op code
@@ -482,27 +968,15 @@ int parse_extern(operation_info_t *info, assembler_state_t *state, char *operand
  * 5)what is the legal address mode for destination address
  * 6) what should be the kind of operands the operation gets*/
 operation_info_t ops[] = {
-	{"mov",     0, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  parse_2operands},
-	{"cmp",     1, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_0123, parse_2operands},
-	{"add",     2, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  parse_2operands},
-	{"sub",     3, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  parse_2operands},
-	{"lea",     6, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_12, LEGAL_ADDRMODE_123,  parse_2operands},
-	{"not",     4, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"clr",     5, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"inc",     7, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"dec",     8, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"jmp",     9, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"bne",    10, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"red",    11, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"prn",    12, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"jsr",    13, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_123, LEGAL_ADDRMODE_NONE, parse_1operands},
-	{"rts",    14, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_0operands},
-	{"stop",   15, SYMBOL_TYPE_CODE, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_0operands},
+	INSTRUCTIONS(OPERATION)
 	{".data",   0, SYMBOL_TYPE_DATA, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_data},
 	{".string", 0, SYMBOL_TYPE_DATA, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_string},
 	{".struct", 0, SYMBOL_TYPE_DATA, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_struct},
+	{".structdef", 0, SYMBOL_TYPE_UNKNOWN, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_structdef},
 	{".entry",  0, SYMBOL_TYPE_UNKNOWN, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_entry},
 	{".extern", 0, SYMBOL_TYPE_UNKNOWN, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_extern},
+	{".include", 0, SYMBOL_TYPE_UNKNOWN, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_include},
+	{".equ",    0, SYMBOL_TYPE_UNKNOWN, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, parse_equ},
 	{NULL, -1, -1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, NULL}
 };
 
@@ -530,20 +1004,20 @@ int check_label(const char label[], assembler_state_t *state)
 	p = label; /*A pointer that points on the first character of a label*/
 
 	if(strlen(p) <= 0){
-		fprintf(stderr, "No label found, line %d\n", state->line_number);
+		fprintf(state->errfile, "No label found, line %d\n", state->line_number);
 		return -1;
 	} if(isalpha(*p) == 0) {
-		fprintf(stderr, "The label does not start with an alphabet, line %d\n", state->line_number);
+		fprintf(state->errfile, "The label does not start with an alphabet, line %d\n", state->line_number);
 		return -1;
 	} if(strlen(p) >= MAX_LABEL_LENGTH) {
-		fprintf(stderr, "The label is too long, line %d\n", state->line_number);
+		fprintf(state->errfile, "The label is too long, line %d\n", state->line_number);
 		return -1;
 	}
 
 	/*Checks if not operation name or directive name*/
 	for(i = 0; i < LENGTH_OF_OPS; i++) {
 		if(strcmp(label, ops[i].name) == 0) {
-			fprintf(stderr, "The name of the label matches operation name or directing operation name, line %d\n",
+			fprintf(state->errfile, "The name of the label matches operation name or directing operation name, line %d\n",
 					state->line_number);
 			return -1;
 		}
@@ -553,14 +1027,14 @@ int check_label(const char label[], assembler_state_t *state)
 	if(strcmp(label, "r0") == 0 || strcmp(label, "r1") == 0 ||strcmp(label, "r2") == 0 || strcmp(label, "r3") == 0 ||
 	   strcmp(label, "r4") == 0 || strcmp(label, "r5") == 0 ||strcmp(label, "r6") == 0 || strcmp(label, "r7") == 0 )
 	{
-		fprintf(stderr, "The name of a label matches a register name, line %d\n", state->line_number);
+		fprintf(state->errfile, "The name of a label matches a register name, line %d\n", state->line_number);
 		return -1;
 	}
 
 	/*Check if all the characters are made of digits and alphabet*/
 	while(*p != '\0'){
 		if(!isalpha(*p) && !isdigit(*p)){
-			fprintf(stderr, "The label doesn't consist only of digits and alphabet, line %d\n", state->line_number);
+			fprintf(state->errfile, "The label doesn't consist only of digits and alphabet, line %d\n", state->line_number);
 			return -1;
 		}
 		p++;
@@ -609,7 +1083,7 @@ int tokenize_line(char *line, char **label, char **operation, char **operands, a
 			p++;
 		}
 		if (*p == '\0') {
-			fprintf(stderr, "Missing operation name after label, line %d\n", state -> line_number);
+			fprintf(state->errfile, "Missing operation name after label, line %d\n", state -> line_number);
 			return -1;
 		}
 		/* Read operation */
@@ -620,17 +1094,19 @@ int tokenize_line(char *line, char **label, char **operation, char **operands, a
 	}
 
 	if (start == p) { /*If there was not any operation*/
-		fprintf(stderr, "Unexpected character '%c'\n", *p);
+		fprintf(state->errfile, "Unexpected character '%c'\n", *p);
 		return -1;
 	}
 	/*There must be at least one space between operation and operands*/
 	if (!isspace(*p) && !(*p == '\0')) {
-		fprintf(stderr, "unexpected character '%c', line %d\n", *p, state -> line_number);
+		fprintf(state->errfile, "unexpected character '%c', line %d\n", *p, state -> line_number);
 		return -1;
 	}
 
 	*operation = start;
-	*(p++) = '\0';
+	if (*p != '\0') { /*Do not skip the end of the line if there are no operands*/
+		*(p++) = '\0';
+	}
 
 	/* Rest of the line is operands */
 	*operands = p;
@@ -0,0 +1,120 @@
+#include "assembler.h"
+#include "encoding.h"
+
+#include <stdio.h>
+
+/*A rewrite of the instruction stream that never changes what the program does.
+ * Only cmp changes the flags, so any other instruction that leaves its operands as they
+ * were can go*/
+typedef struct peephole_rule {
+	const char *name;
+	/* Returns non zero when insn can be removed. next is the instruction after it (NULL
+	 * at the end) and next_ic is the address right after insn */
+	int (*removable)(const assembler_state_t *state, const instruction_t *insn, const instruction_t *next,
+					 int next_ic);
+} peephole_rule_t;
+
+/*mov r1,r1*/
+int peephole_self_move(const assembler_state_t *state, const instruction_t *insn,
+					   const instruction_t *next, int next_ic)
+{
+	return insn->opcode == OPCODE_MOV &&
+		   insn->type[0] == ADDR_REGISTER && insn->type[1] == ADDR_REGISTER &&
+		   insn->value[0] == insn->value[1];
+}
+
+/*add #0,X and sub #0,X*/
+int peephole_add_zero(const assembler_state_t *state, const instruction_t *insn,
+					  const instruction_t *next, int next_ic)
+{
+	return (insn->opcode == OPCODE_ADD || insn->opcode == OPCODE_SUB) &&
+		   insn->type[0] == ADDR_IMMEDIATE && insn->value[0] == 0;
+}
+
+/*cmp whose flags are overwritten right away by another cmp*/
+int peephole_dead_cmp(const assembler_state_t *state, const instruction_t *insn,
+					  const instruction_t *next, int next_ic)
+{
+	return insn->opcode == OPCODE_CMP && next != NULL && next->opcode == OPCODE_CMP;
+}
+
+/*jmp or bne to the instruction right after it. Only labels defined in this source (or in
+ * this part of it) are known to be there*/
+int peephole_jump_to_next(const assembler_state_t *state, const instruction_t *insn,
+						  const instruction_t *next, int next_ic)
+{
+	return (insn->opcode == OPCODE_JMP || insn->opcode == OPCODE_BNE) &&
+		   insn->type[0] == ADDR_DIRECT &&
+		   symtab_symbol(&state->symbols, insn->symbol[0])->type == SYMBOL_TYPE_CODE &&
+		   symtab_symbol(&state->symbols, insn->symbol[0])->index == next_ic;
+}
+
+peephole_rule_t peephole_rules[] = {
+	{"mov to itself",   peephole_self_move},
+	{"add/sub of zero", peephole_add_zero},
+	{"overwritten cmp", peephole_dead_cmp},
+	{"jump to next",    peephole_jump_to_next},
+	{NULL,              NULL}
+};
+
+/*This method runs all the rules once over the recorded instructions, removes what they
+ * match and moves the code labels to the new addresses
+ * returns the number of code words removed*/
+int peephole_pass(assembler_state_t *state)
+{
+	short remap[LENGTH_MEMORY + 1];
+	const instruction_t *insn, *next;
+	peephole_rule_t *rule;
+	int ic, new_ic, size;
+	int i, n;
+
+	ic = 0;
+	new_ic = 0;
+	n = 0;
+	for (i = 0; i < state->ninstructions; i++) {
+		insn = &state->instructions[i];
+		next = (i + 1 < state->ninstructions) ? &state->instructions[i + 1] : NULL;
+		size = encoding_of(insn)->size;
+
+		/* A label on a removed instruction ends up on the one after it */
+		remap[ic] = new_ic;
+
+		for (rule = peephole_rules; rule->name != NULL; rule++) {
+			if (rule->removable(state, insn, next, ic + size)) {
+				break;
+			}
+		}
+		if (rule->name == NULL) {
+			state->instructions[n++] = *insn;
+			new_ic += size;
+		}
+		ic += size;
+	}
+	remap[ic] = new_ic;
+
+	if (new_ic == ic) {
+		return 0;
+	}
+
+	state->ninstructions = n;
+	state->IC = new_ic;
+	symtab_remap_code(&state->symbols, remap);
+	return ic - new_ic;
+}
+
+/*This method shrinks the recorded instructions before they are encoded. Removing an
+ * instruction may expose another one, so the rules run until nothing changes*/
+void optimize_instructions(assembler_state_t *state)
+{
+	int saved;
+
+	/* Leave a program that does not fit as it is, it is reported later */
+	if (state->IC > LENGTH_MEMORY || state->ninstructions > LENGTH_MEMORY) {
+		return;
+	}
+
+	do {
+		saved = peephole_pass(state);
+		state->words_saved += saved;
+	} while (saved > 0);
+}
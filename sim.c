@@ -0,0 +1,376 @@
+#include "sim.h"
+
+#include <limits.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Threaded dispatch (goto *) is a GNU extension - other compilers get a switch */
+#if defined(__GNUC__) && !defined(SIM_SWITCH)
+#define SIM_THREADED
+#endif
+
+#define SIM_WORD(v) ((v) & 1023)
+
+/*The operands of every opcode, as ops[] defines them*/
+typedef struct sim_opinfo {
+	int n;
+	int legal_src;
+	int legal_dst;
+	int src_address; /* The source is taken as an address - lea */
+	int dst_address; /* The destination is taken as an address - the jumps */
+} sim_opinfo_t;
+
+const sim_opinfo_t sim_ops[16] = {
+	{2, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  0, 0}, /* mov */
+	{2, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_0123, 0, 0}, /* cmp */
+	{2, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  0, 0}, /* add */
+	{2, LEGAL_ADDRMODE_0123, LEGAL_ADDRMODE_123,  0, 0}, /* sub */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 0}, /* not */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 0}, /* clr */
+	{2, LEGAL_ADDRMODE_12,   LEGAL_ADDRMODE_123,  1, 0}, /* lea */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 0}, /* inc */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 0}, /* dec */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 1}, /* jmp */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 1}, /* bne */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 0}, /* red */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_0123, 0, 0}, /* prn */
+	{1, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_123,  0, 1}, /* jsr */
+	{0, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, 0, 0}, /* rts */
+	{0, LEGAL_ADDRMODE_NONE, LEGAL_ADDRMODE_NONE, 0, 0}  /* stop */
+};
+
+/*The fault of a run that reached its step limit*/
+const char sim_limit_reached[] = "Step limit reached";
+
+/*This method returns the value of a word as a signed number*/
+int sim_signed(int word)
+{
+	return (word & 512) ? word - 1024 : word;
+}
+
+/*This method loads an assembled program - the code words at 100 and the data words
+ * right after them, the same as write_object() writes them
+ * returns 0 in case of success and -1 otherwise*/
+int sim_load(sim_t *sim, const assembler_state_t *state, FILE *in, FILE *out)
+{
+	int i;
+
+	if (ASSEMBLY_CODE_START_ADDRESS + state->IC + state->DC > LENGTH_MEMORY) {
+		fprintf(stderr, "Program %s does not fit the memory\n", state->filename);
+		return -1;
+	}
+
+	memset(sim->mem, 0, sizeof(sim->mem));
+	memset(sim->reg, 0, sizeof(sim->reg));
+	for (i = 0; i < state->IC; i++) {
+		sim->mem[ASSEMBLY_CODE_START_ADDRESS + i] = SIM_WORD(state->code[i]);
+	}
+	for (i = 0; i < state->DC; i++) {
+		sim->mem[ASSEMBLY_CODE_START_ADDRESS + state->IC + i] = SIM_WORD(state->data[i]);
+	}
+
+	sim->end = ASSEMBLY_CODE_START_ADDRESS + state->IC + state->DC;
+	for (i = 0; i < SIM_CODE_SIZE; i++) {
+		sim->code[i].op = (i >= ASSEMBLY_CODE_START_ADDRESS && i < sim->end) ? SIM_DECODE : SIM_FAULT;
+		sim->code[i].size = 0;
+	}
+
+	sim->pc = ASSEMBLY_CODE_START_ADDRESS;
+	sim->zero = 0;
+	sim->sp = 0;
+	sim->in = in;
+	sim->out = out;
+	sim->steps = 0;
+	sim->fault = NULL;
+	return 0;
+}
+
+/*This method decodes an operand of the instruction at pc, from the word at *next on
+ * returns 0 in case of success and -1 otherwise*/
+int sim_decode_operand(sim_t *sim, sim_insn_t *insn, int mode, int i, int address, int *next, short **ref)
+{
+	int word, field;
+
+	if (*next >= sim->end || (mode == ADDR_STRUCT && *next + 1 >= sim->end)) {
+		sim->fault = "Instruction runs past the end of the program";
+		return -1;
+	}
+	word = sim->mem[(*next)++];
+
+	switch (mode) {
+	case ADDR_IMMEDIATE:
+		word >>= 2; /* 8 bits, signed */
+		insn->imm[i] = SIM_WORD((word & 128) ? word - 256 : word);
+		*ref = &insn->imm[i];
+		return 0;
+	case ADDR_REGISTER:
+		word = (i == 0) ? word >> 6 : word >> 2; /* Source in bits 6-9, destination in 2-5 */
+		*ref = &sim->reg[word & 7];
+		return ((word & 15) < 8) ? 0 : -1;
+	}
+
+	/* Direct or struct */
+	if ((word & 3) == ARE_EXTERN) {
+		sim->fault = "Use of an unresolved external";
+		return -1;
+	}
+	word >>= 2;
+	if (mode == ADDR_STRUCT) {
+		field = sim->mem[(*next)++] >> 2;
+		word = (word + field - 1) & (LENGTH_MEMORY - 1);
+	}
+
+	if (address) {
+		insn->imm[i] = word;
+		*ref = &insn->imm[i];
+	} else {
+		*ref = &sim->mem[word];
+	}
+	return 0;
+}
+
+/*This method decodes the instruction at pc, see sim_insn_t
+ * returns 0 in case of success and -1 otherwise*/
+int sim_decode(sim_t *sim, int pc)
+{
+	sim_insn_t *insn = &sim->code[pc];
+	const sim_opinfo_t *info;
+	int word, op, mode[2];
+	int next;
+
+	word = sim->mem[pc];
+	op = (word >> 6) & 15;
+	mode[0] = (word >> 4) & 3;
+	mode[1] = (word >> 2) & 3;
+	info = &sim_ops[op];
+
+	sim->fault = "Illegal instruction";
+	insn->op = SIM_FAULT;
+	insn->size = 0;
+	insn->dst_mem = 0;
+	insn->src = insn->dst = NULL;
+
+	if ((word & 3) != ARE_FIXED || (info->n < 2 && mode[0] != 0) || (info->n < 1 && mode[1] != 0)) {
+		return -1;
+	}
+	if ((info->n == 2 && !(BIT(mode[0]) & info->legal_src)) || (info->n >= 1 && !(BIT(mode[1]) & info->legal_dst))) {
+		return -1;
+	}
+
+	next = pc + 1;
+	if (info->n == 2 && mode[0] == ADDR_REGISTER && mode[1] == ADDR_REGISTER) {
+		/* Special case - 2 registers share a single word */
+		if (sim_decode_operand(sim, insn, ADDR_REGISTER, 0, 0, &next, &insn->src) < 0) {
+			return -1;
+		}
+		next--;
+		if (sim_decode_operand(sim, insn, ADDR_REGISTER, 1, 0, &next, &insn->dst) < 0) {
+			return -1;
+		}
+	} else {
+		if (info->n == 2 && sim_decode_operand(sim, insn, mode[0], 0, info->src_address, &next, &insn->src) < 0) {
+			return -1;
+		}
+		if (info->n >= 1 && sim_decode_operand(sim, insn, mode[1], 1, info->dst_address, &next, &insn->dst) < 0) {
+			return -1;
+		}
+	}
+
+	insn->op = op;
+	insn->size = next - pc;
+	insn->dst_mem = (insn->dst >= sim->mem && insn->dst < sim->mem + LENGTH_MEMORY);
+	sim->fault = NULL;
+	return 0;
+}
+
+/*This method drops the decoded instructions that a written word may be a part of*/
+void sim_invalidate(sim_t *sim, int address)
+{
+	int pc;
+
+	for (pc = address; pc > address - 5 && pc >= ASSEMBLY_CODE_START_ADDRESS; pc--) {
+		if (pc < sim->end) {
+			sim->code[pc].op = SIM_DECODE;
+		}
+	}
+}
+
+#define SIM_STORE(v) do { \
+		*insn->dst = SIM_WORD(v); \
+		if (insn->dst_mem) { \
+			sim_invalidate(sim, insn->dst - sim->mem); \
+		} \
+	} while (0)
+
+#ifdef SIM_THREADED
+#define SIM_OP(op) L_##op:
+#define SIM_DISPATCH() do { \
+		if (--budget == 0) goto limit; \
+		insn = &sim->code[pc]; \
+		goto *labels[insn->op]; \
+	} while (0)
+#else
+#define SIM_OP(op) case op:
+#define SIM_DISPATCH() continue
+#endif
+
+/* Only the dispatch of sim_run() is let use the GNU extension, see SIM_THREADED */
+#ifdef SIM_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/*This method runs the loaded program until stop, a fault, or max_steps instructions
+ * (0 for no limit). Every instruction is decoded the first time it runs, and then
+ * dispatched straight from its decoded form
+ * returns 0 when the program stopped and -1 otherwise, with the reason in sim->fault*/
+int sim_run(sim_t *sim, unsigned long max_steps)
+{
+#ifdef SIM_THREADED
+	static const void *labels[] = {
+		&&L_OPCODE_MOV, &&L_OPCODE_CMP, &&L_OPCODE_ADD, &&L_OPCODE_SUB,
+		&&L_OPCODE_NOT, &&L_OPCODE_CLR, &&L_OPCODE_LEA, &&L_OPCODE_INC,
+		&&L_OPCODE_DEC, &&L_OPCODE_JMP, &&L_OPCODE_BNE, &&L_OPCODE_RED,
+		&&L_OPCODE_PRN, &&L_OPCODE_JSR, &&L_OPCODE_RTS, &&L_OPCODE_STOP,
+		&&L_SIM_DECODE, &&L_SIM_FAULT
+	};
+#endif
+	unsigned long budget, start;
+	sim_insn_t *insn;
+	int pc, zero;
+	int value;
+	int ret;
+
+	start = budget = (max_steps != 0) ? max_steps + 1 : ULONG_MAX;
+	pc = sim->pc;
+	zero = sim->zero;
+	ret = -1;
+
+#ifdef SIM_THREADED
+	SIM_DISPATCH();
+#else
+	for (;;) {
+		if (--budget == 0) {
+			goto limit;
+		}
+		insn = &sim->code[pc];
+		switch (insn->op) {
+#endif
+
+	SIM_OP(OPCODE_MOV)
+		SIM_STORE(*insn->src);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_CMP)
+		zero = (*insn->src == *insn->dst);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_ADD)
+		SIM_STORE(*insn->dst + *insn->src);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_SUB)
+		SIM_STORE(*insn->dst - *insn->src);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_NOT)
+		SIM_STORE(~*insn->dst);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_CLR)
+		SIM_STORE(0);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_LEA)
+		SIM_STORE(*insn->src);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_INC)
+		SIM_STORE(*insn->dst + 1);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_DEC)
+		SIM_STORE(*insn->dst - 1);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_JMP)
+		pc = *insn->dst;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_BNE)
+		pc = zero ? pc + insn->size : *insn->dst;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_RED)
+		if (sim->in == NULL || fscanf(sim->in, "%d", &value) != 1) {
+			sim->fault = "No more input for red";
+			goto out;
+		}
+		SIM_STORE(value);
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_PRN)
+		fprintf(sim->out, "%d\n", sim_signed(*insn->dst));
+		pc += insn->size;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_JSR)
+		if (sim->sp == SIM_STACK_SIZE) {
+			sim->fault = "Stack overflow in jsr";
+			goto out;
+		}
+		sim->stack[sim->sp++] = pc + insn->size;
+		pc = *insn->dst;
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_RTS)
+		if (sim->sp == 0) {
+			sim->fault = "rts with an empty stack";
+			goto out;
+		}
+		pc = sim->stack[--sim->sp];
+		SIM_DISPATCH();
+
+	SIM_OP(OPCODE_STOP)
+		ret = 0;
+		goto out;
+
+	SIM_OP(SIM_DECODE)
+		if (sim_decode(sim, pc) < 0) {
+			goto out;
+		}
+		budget++; /* Not an instruction */
+		SIM_DISPATCH();
+
+	SIM_OP(SIM_FAULT)
+		sim->fault = "Jump outside the program";
+		goto out;
+
+#ifndef SIM_THREADED
+		}
+	}
+#endif
+
+limit:
+	sim->fault = sim_limit_reached;
+	budget++; /* The next instruction did not run */
+out:
+	sim->pc = pc;
+	sim->zero = zero;
+	sim->steps += start - budget;
+	return ret;
+}
+
+#ifdef SIM_THREADED
+#pragma GCC diagnostic pop
+#endif
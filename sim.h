@@ -0,0 +1,53 @@
+
+#ifndef SIM_H
+#define SIM_H
+
+#include "assembler.h"
+
+#include <stdio.h>
+
+#define SIM_CODE_SIZE  1024 /* Every value a register holds can be jumped to */
+#define SIM_STACK_SIZE 256
+
+/*Not opcodes - an address not decoded yet (or written since), and an address that
+ * cannot be run*/
+#define SIM_DECODE 16
+#define SIM_FAULT  17
+
+/*An instruction decoded once, kept until a word of it is written. The operands point to
+ * where their values are - a register, a memory word or imm, which holds an immediate
+ * or the address that lea and the jumps take*/
+typedef struct sim_insn {
+	unsigned char op;      /* opcode_t, SIM_DECODE or SIM_FAULT */
+	unsigned char size;    /* In words */
+	unsigned char dst_mem; /* The destination is a memory word */
+	short         imm[2];
+	short         *src;
+	short         *dst;    /* The single operand of a 1 operand instruction */
+} sim_insn_t;
+
+/*The machine - 8 registers and 256 words of 10 bits, the program loaded at 100*/
+typedef struct sim {
+	short         mem[LENGTH_MEMORY];
+	short         reg[8];
+	int           pc;
+	int           zero;    /* Set by cmp when the operands are equal, tested by bne */
+	int           end;     /* First address after the program */
+	short         stack[SIM_STACK_SIZE]; /* Return addresses of jsr */
+	int           sp;
+	FILE          *in;     /* Numbers read by red */
+	FILE          *out;    /* Numbers printed by prn */
+	unsigned long steps;
+	const char    *fault;  /* Why the run stopped, NULL after stop */
+	sim_insn_t    code[SIM_CODE_SIZE];
+} sim_t;
+
+extern const char sim_limit_reached[];
+
+int sim_load(sim_t *sim, const assembler_state_t *state, FILE *in, FILE *out);
+int sim_decode(sim_t *sim, int pc);
+void sim_invalidate(sim_t *sim, int address);
+int sim_run(sim_t *sim, unsigned long max_steps);
+int sim_signed(int word);
+
+#endif
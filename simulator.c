@@ -0,0 +1,190 @@
+#include "assembler.h"
+#include "object.h"
+#include "sim.h"
+#include "jit.h"
+#include "map.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/*This method returns the time in seconds, to measure a run*/
+double simulate_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*This method prints the source line and label of an address, when the program was
+ * assembled with --binary --map*/
+void simulate_where(const char *filename, int address)
+{
+	char path[MAX_PATH];
+	const map_word_t *w;
+	map_file_t map;
+
+	sprintf(path, "%s.%s", filename, MAP_EXT);
+	if (access(path, R_OK) < 0 || map_map(&map, filename) < 0) {
+		return;
+	}
+
+	w = map_find(&map, address);
+	if (w != NULL && w->label != MAP_NO_LABEL && w->offset == 0) {
+		fprintf(stderr, "%s: address %d is line %lu, %s\n", filename, address, (unsigned long)w->line,
+				map.names + w->label);
+	} else if (w != NULL && w->label != MAP_NO_LABEL) {
+		fprintf(stderr, "%s: address %d is line %lu, %s+%d\n", filename, address, (unsigned long)w->line,
+				map.names + w->label, w->offset);
+	} else if (w != NULL) {
+		fprintf(stderr, "%s: address %d is line %lu\n", filename, address, (unsigned long)w->line);
+	}
+	map_unmap(&map);
+}
+
+/*How simulate() runs a program*/
+#define SIMULATE_INTERPRET 0
+#define SIMULATE_JIT       1
+#define SIMULATE_BENCH     2 /* Both ways, comparing the rates */
+
+/*This method runs a loaded program in the interpreter, or in native code when jit is given
+ * returns 0 in case of success and -1 otherwise*/
+int simulate_run(const char *filename, const assembler_state_t *state, jit_t *jit, FILE *in, FILE *out,
+				 unsigned long max_steps, double *rate)
+{
+	static sim_t interpreter;
+	sim_t *sim;
+	double start, seconds;
+	int ret;
+
+	sim = (jit != NULL) ? &jit->sim : &interpreter;
+	ret = (jit != NULL) ? jit_load(jit, state, in, out) : sim_load(sim, state, in, out);
+	if (ret < 0) {
+		return ret;
+	}
+
+	start = simulate_clock();
+	ret = (jit != NULL) ? jit_run(jit, max_steps) : sim_run(sim, max_steps);
+	seconds = simulate_clock() - start;
+	fflush(out);
+
+	*rate = (seconds > 0) ? sim->steps / seconds : 0.0;
+	if (ret < 0) {
+		fprintf(stderr, "%s: %s, address %d\n", filename, sim->fault, sim->pc);
+		simulate_where(filename, sim->pc);
+	}
+	fprintf(stderr, "%s: %lu instructions in %.3f seconds, %.0f per second%s\n", filename, sim->steps,
+			seconds, *rate, (jit == NULL) ? "" : (jit->interpret ? " (jit, code written - interpreted)" : " (jit)"));
+	return ret;
+}
+
+/*This method loads an assembled program (<name>.obb, or <name>.ob with .ent and .ext)
+ * and runs it, reporting the instructions it ran per second
+ * returns 0 in case of success and -1 otherwise*/
+int simulate(const char *filename, FILE *in, unsigned long max_steps, int mode, jit_t *jit)
+{
+	static assembler_state_t state;
+	assembler_options_t options;
+	double interpreted, native;
+	FILE *out;
+	int ret;
+
+	memset(&options, 0, sizeof(options));
+	memset(&state, 0, sizeof(state));
+	state.filename = filename;
+	state.options = &options;
+	state.errfile = stderr;
+
+	if (read_object(&state) < 0) {
+		return -1;
+	}
+
+	if (mode != SIMULATE_BENCH) {
+		return simulate_run(filename, &state, (mode == SIMULATE_JIT) ? jit : NULL, in, stdout, max_steps, &native);
+	}
+
+	/* The same run twice, the output of prn is dropped */
+	out = fopen("/dev/null", "w");
+	if (out == NULL) {
+		fprintf(stderr, "Cannot open file /dev/null for writing\n");
+		return -1;
+	}
+	ret = simulate_run(filename, &state, NULL, in, out, max_steps, &interpreted);
+	if (in != stdin) {
+		rewind(in);
+	}
+	if (simulate_run(filename, &state, jit, in, out, max_steps, &native) < 0) {
+		ret = -1;
+	}
+	fclose(out);
+
+	if (interpreted > 0) {
+		fprintf(stderr, "%s: the jit runs %.1f times as fast as the interpreter\n", filename, native / interpreted);
+	}
+	return ret;
+}
+
+/*This method is the main of the simulator - runs the programs given in the command line,
+ * in the interpreter, in native code (--jit), or both ways to compare them (--bench).
+ * red reads the numbers of the -i file (or of the standard input), prn prints to the
+ * standard output*/
+int main(int argc, char *argv[])
+{
+	static jit_t jit;
+	unsigned long max_steps;
+	FILE *in;
+	int error_flag;
+	int mode;
+	int i;
+
+	in = stdin;
+	max_steps = 0;
+	mode = SIMULATE_INTERPRET;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "--jit") == 0) {
+			mode = SIMULATE_JIT;
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			mode = SIMULATE_BENCH;
+		} else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc && in == stdin) {
+			in = fopen(argv[++i], "r");
+			if (in == NULL) {
+				fprintf(stderr, "Cannot open file %s for reading\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			max_steps = strtoul(argv[++i], NULL, 10);
+		} else {
+			break;
+		}
+	}
+	if (i == argc || argv[i][0] == '-') {
+		fprintf(stderr, "Usage: %s [--jit | --bench] [-i input] [-n max-instructions] program...\n", argv[0]);
+		return 1;
+	}
+
+	if (mode != SIMULATE_INTERPRET && jit_init(&jit) < 0) {
+		fprintf(stderr, "No jit for this host, interpreting\n");
+		mode = SIMULATE_INTERPRET;
+	}
+
+	error_flag = 0;
+	for (; i < argc; i++) {
+		if (strlen(argv[i]) + 5 > MAX_PATH) {
+			fprintf(stderr, "File name %s is too long\n", argv[i]);
+			error_flag = 1;
+			continue;
+		}
+		if (simulate(argv[i], in, max_steps, mode, &jit) < 0) {
+			error_flag = 1;
+		}
+	}
+
+	jit_cleanup(&jit);
+	if (in != stdin) {
+		fclose(in);
+	}
+	return error_flag;
+}
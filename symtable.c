@@ -2,42 +2,45 @@
 #include "symtable.h"
 #include "assembler.h"
 #include "defs.h"
+#include "io.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 
-/*This method initializes all the symbols table contents to NULL*/
+/*This method initializes an empty symbols table*/
 void symtab_init(symtab_t *t)
 {
 	int i;
 
 	for (i = 0; i < SYMBOL_HASH_SIZE; i++) {
-		(*t)[i] = NULL;
+		t->buckets[i] = -1;
 	}
+	t->symbols = NULL;
+	t->names = NULL;
+	t->n = 0;
+	t->capacity = 0;
 }
 /*This method frees the symbols table contents */
 void symtab_free(symtab_t *t)
 {
 	relocation_t *r;
 	symbol_t *s;
-	int bucket;
-
-	for (bucket = 0; bucket < SYMBOL_HASH_SIZE; bucket++) {
-		while ((*t)[bucket] != NULL) {
-			s = (*t)[bucket];
-			(*t)[bucket] = s->next;
-
-			while (s->relocations !=NULL) {
-				r = s->relocations;
-				s->relocations = r->next;
-				free(r);
-			}
-
-			free(s);
+	int id;
+
+	for (id = 0; id < t->n; id++) {
+		s = &t->symbols[id];
+		while (s->relocations !=NULL) {
+			r = s->relocations;
+			s->relocations = r->next;
+			free(r);
 		}
 	}
+
+	free(t->symbols);
+	free(t->names);
+	symtab_init(t);
 }
 
 /*This method form hash value for string name
@@ -55,66 +58,91 @@ int calc_hash(const char *name)
 }
 
 /*This method finds a symbol name in the list
- * returns a structure of symbol_t in case of success and NULL otherwise*/
-symbol_t *find_in_bucket(symtab_t *t, int bucket, const char *name)
+ * returns the id of the symbol in case of success and -1 otherwise*/
+int find_in_bucket(const symtab_t *t, int bucket, const char *name)
 {
-	symbol_t *s;
+	int id;
 
-	for (s = (*t)[bucket]; s != NULL; s = s->next) {
-		if (!strcmp(name, s->name)) {
-			return s;
+	for (id = t->buckets[bucket]; id >= 0; id = t->symbols[id].next) {
+		if (!strcmp(name, t->names[id])) {
+			return id;
 		}
 	}
-	return NULL;
+	return -1;
 }
-/*This method adds new symbol to the list
- * returns 0 in case of success and -1 otherwise*/
-int add_new_symbol(symtab_t *t, int bucket, const char *name, symbol_t **newsym)
+
+/*This method finds a symbol by its name
+ * returns the id of the symbol or -1 if there is no such symbol*/
+int symtab_find(const symtab_t *t, const char *name)
 {
-	symbol_t *s;
+	return find_in_bucket(t, calc_hash(name), name);
+}
 
-	s = malloc(sizeof (*s));
-	if (s == NULL) {
-		fprintf(stderr, "Failed to allocate symbol\n");
-		return -1;
+/*This method adds new symbol to the list. Pointers to the symbols of the table are
+ * not valid after it, the ids are
+ * returns the id of the symbol in case of success and -1 otherwise*/
+int add_new_symbol(symtab_t *t, int bucket, const char *name)
+{
+	char (*names)[MAX_LABEL_LENGTH];
+	symbol_t *symbols, *s;
+	int capacity;
+
+	if (t->n == t->capacity) {
+		capacity = (t->capacity == 0) ? 64 : 2 * t->capacity;
+		symbols = realloc(t->symbols, capacity * sizeof(*symbols));
+		if (symbols != NULL) {
+			t->symbols = symbols;
+		}
+		names = realloc(t->names, capacity * sizeof(*names));
+		if (names != NULL) {
+			t->names = names;
+		}
+		if (symbols == NULL || names == NULL) {
+			fprintf(stderr, "Failed to allocate symbol\n");
+			return -1;
+		}
+		t->capacity = capacity;
 	}
 
-	strcpy(s->name, name);
+	strcpy(t->names[t->n], name);
+	s = &t->symbols[t->n];
 	s->relocations = NULL;
 	s->type        = SYMBOL_TYPE_UNKNOWN;
+	s->index       = 0;
+	s->is_entry    = 0;
 
 	/* add to list */
-	s->next = (*t)[bucket];
-	(*t)[bucket] = s;
-	*newsym = s;
+	s->next = t->buckets[bucket];
+	t->buckets[bucket] = t->n;
 
-	return 0;
+	return t->n++;
 }
 
 /*This method checks whether a label name was declared
  * if declared before ,returns -1.
- * if not - adds the name, the address of the new symbol to the list and returns 0 */
+ * if not - adds the name, the address of the new symbol to the list and returns its id */
 int symtab_new_label(symtab_t *t, const char *name, symbol_type_t type,
-		             int ic, int dc)
+		             int ic, int dc, const assembler_state_t *state)
 {
 	int bucket;
 	symbol_t *s;
-	int ret;
+	int id;
 
 	bucket = calc_hash(name);
-	s = find_in_bucket(t, bucket, name);
-	if (s != NULL) {
-		if (s->type != SYMBOL_TYPE_UNKNOWN) {
-			fprintf(stderr, "Label %s re-defined\n", name);
+	id = find_in_bucket(t, bucket, name);
+	if (id >= 0) {
+		if (t->symbols[id].type != SYMBOL_TYPE_UNKNOWN) {
+			fprintf(state->errfile, "Label %s re-defined\n", name);
 			return -1;
 		}
 	} else {
-		ret = add_new_symbol(t, bucket, name, &s);
-		if (ret < 0) {
-			return ret;
+		id = add_new_symbol(t, bucket, name);
+		if (id < 0) {
+			return id;
 		}
 	}
 
+	s = &t->symbols[id];
 	s->type  = type;
 	switch (type) {
 	case SYMBOL_TYPE_CODE:
@@ -128,50 +156,61 @@ int symtab_new_label(symtab_t *t, const char *name, symbol_type_t type,
 		break;
 	}
 
-	return 0;
+	return id;
 }
+/*This method defines a constant of .equ, the same way symtab_new_label() defines a label
+ * returns the id of the symbol in case of success and -1 otherwise*/
+int symtab_new_constant(symtab_t *t, const char *name, int value, const assembler_state_t *state)
+{
+	int id;
+
+	id = symtab_new_label(t, name, SYMBOL_TYPE_CONSTANT, 0, 0, state);
+	if (id >= 0) {
+		t->symbols[id].index = value;
+	}
+	return id;
+}
+
 /*This method checks whether a label name(operand of .entry) was declared.
  * if was not declared and fails to add to symbol table returns -1
  * otherwise adds the name, the address of the new symbol to the list, turn the flag "is entry" to 1 and returns 0
  * */
 int symtab_new_entry(symtab_t *t, char *name) {
-	int bucket;
-	symbol_t *s;
-	int ret;
+	int id;
 
-	bucket = calc_hash(name);
-
-	s = find_in_bucket(t, bucket, name);
-	if(s == NULL) {
-		ret = add_new_symbol(t, bucket, name, &s);
-		if(ret < 0)
-			return ret;
+	id = symtab_new_operand(t, name);
+	if (id < 0) {
+		return id;
 	}
-	s->is_entry = 1;
+	t->symbols[id].is_entry = 1;
 	return 0;
 }
 
 /*This method handles a symbol given as operand - if symbol name was not found in the symbols list,
- *add it with type unknown, and allocate new memory to remember the address of this symbol.
- *set the next of r to point on  s->relocations and update s->relocations to point on r.
- *return 0 in case of success and -1 otherwise*/
-int symtab_new_operand(symtab_t *t, const char *name, int ic)
+ *add it with type unknown. This is where a name is interned, later it is only referred to by id
+ *returns the id of the symbol, or -1 in case of failure*/
+int symtab_new_operand(symtab_t *t, const char *name)
 {
 	int bucket;
-	relocation_t *r;
-	symbol_t *s;
-	int ret;
+	int id;
 
 	bucket = calc_hash(name);
 
-	s = find_in_bucket(t, bucket, name);
-	if (s == NULL) {
-		ret = add_new_symbol(t, bucket, name, &s);
-		if (ret < 0) {
-			return ret;
-		}
+	id = find_in_bucket(t, bucket, name);
+	if (id < 0) {
+		id = add_new_symbol(t, bucket, name);
 	}
 
+	return id;
+}
+
+/*This method allocates new memory to remember an address where the symbol is used.
+ *set the next of r to point on  s->relocations and update s->relocations to point on r.
+ *return 0 in case of success and -1 otherwise*/
+int symtab_new_relocation(symbol_t *s, int ic)
+{
+	relocation_t *r;
+
 	r = malloc(sizeof(*r));
 	if (r == NULL) {
 		fprintf(stderr, "Failed to allocate relocation\n");
@@ -186,26 +225,128 @@ int symtab_new_operand(symtab_t *t, const char *name, int ic)
 
 	return 0;
 }
-/*This method updates all the relocation addresses to the actual address of the label
+
+/*This method moves the code labels after code words were removed - remap[ic] is the new
+ * address of the word that was at ic*/
+void symtab_remap_code(symtab_t *t, const short remap[])
+{
+	symbol_t *s;
+	int id;
+
+	for (id = 0; id < t->n; id++) {
+		s = &t->symbols[id];
+		if (s->type == SYMBOL_TYPE_CODE) {
+			s->index = remap[s->index];
+		}
+	}
+}
+
+/*This method moves all the symbols and relocations of src (a table built for a part of the
+ * source whose code starts at ic_offset and data starts at dc_offset) into t.
+ * Symbols are merged in the order they were first seen, so t ends up exactly as if the
+ * whole source was parsed into it. src is left with symbols only and must still be freed.
+ * returns 0 in case of success and -1 otherwise*/
+int symtab_merge(symtab_t *t, symtab_t *src, int ic_offset, int dc_offset, const assembler_state_t *state)
+{
+	symbol_t *s, *dst;
+	relocation_t *r;
+	int id, dst_id;
+	int ret;
+	int error_flag;
+
+	error_flag = 0;
+
+	/* Ids are given in the order the names are first seen */
+	for (id = 0; id < src->n; id++) {
+		s = &src->symbols[id];
+		dst_id = symtab_new_operand(t, src->names[id]);
+		if (dst_id < 0) {
+			return dst_id;
+		}
+
+		if (s->type == SYMBOL_TYPE_CONSTANT) {
+			ret = symtab_new_constant(t, src->names[id], s->index, state);
+			if (ret < 0) {
+				error_flag = ret;
+			}
+		} else if (s->type != SYMBOL_TYPE_UNKNOWN) {
+			ret = symtab_new_label(t, src->names[id], s->type,
+					               s->index + ic_offset, s->index + dc_offset, state);
+			if (ret < 0) {
+				error_flag = ret;
+			}
+		}
+
+		dst = &t->symbols[dst_id];
+		if (s->is_entry) {
+			dst->is_entry = 1;
+		}
+
+		if (s->relocations != NULL) {
+			/* Later relocations go first, the same as symtab_new_relocation() adds them */
+			for (r = s->relocations; ; r = r->next) {
+				r->ic += ic_offset;
+				if (r->next == NULL) {
+					break;
+				}
+			}
+			r->next = dst->relocations;
+			dst->relocations = s->relocations;
+			s->relocations = NULL;
+		}
+	}
+
+	return error_flag;
+}
+
+/*This method remembers a symbol that is written to the outputs
+ * returns 0 in case of success and -1 otherwise*/
+int add_object_symbol(object_symbol_t table[], int *n, int size, const char *name, int address,
+					  const assembler_state_t *state)
+{
+	if (*n >= size) {
+		fprintf(state->errfile, "Too many entries and externals\n");
+		return -1;
+	}
+
+	strcpy(table[*n].name, name);
+	table[*n].address = address;
+	(*n)++;
+	return 0;
+}
+
+/*Orders relocations by address*/
+int compare_relocs(const void *a, const void *b)
+{
+	return *(const short *)a - *(const short *)b;
+}
+
+/*This method updates all the relocation addresses to the actual address of the label,
+ * and collects the entries, the uses of externals and the relocated words for the outputs
  * return 0 in case of success and -1 otherwise*/
-int symtab_update_relocations_and_write(symtab_t *t, assembler_state_t *state)
+int symtab_update_relocations(symtab_t *t, assembler_state_t *state)
 {
-	FILE *entfile = NULL, *extfile = NULL;
-	char base32[3];
 	relocation_t *r;
+	const char *name;
 	symbol_t *s;
-	int bucket;
+	int bucket, id;
 	int word;
 	int address;
+	int ret;
 
+	state->nentries = 0;
+	state->nexterns = 0;
+	state->nrelocs = 0;
+
+	/* By bucket, the newest symbol first - the order the entries and externals are written */
 	for (bucket = 0; bucket < SYMBOL_HASH_SIZE; bucket++) {
-		while ((*t)[bucket] != NULL) {
-			s = (*t)[bucket];
-			(*t)[bucket] = s->next;
+		for (id = t->buckets[bucket]; id >= 0; id = s->next) {
+			s = &t->symbols[id];
+			name = t->names[id];
 
 			switch (s->type) {
 			case SYMBOL_TYPE_UNKNOWN:
-				fprintf(stderr, "Unresolved symbol %s\n", s->name);
+				fprintf(state->errfile, "Unresolved symbol %s\n", name);
 				return -1;
 			case SYMBOL_TYPE_CODE:
 				address = ASSEMBLY_CODE_START_ADDRESS + s->index;
@@ -217,12 +358,23 @@ int symtab_update_relocations_and_write(symtab_t *t, assembler_state_t *state)
 				break;
 			case SYMBOL_TYPE_EXTERNAL:
 				if (s->is_entry) {
-					fprintf(stderr, "Symbol %s cannot be both external and entry\n", s->name);
+					fprintf(state->errfile, "Symbol %s cannot be both external and entry\n", name);
 					return -1;
 				}
 				address = 0;
 				word = (address << 2) | ARE_EXTERN; /*  External */
 				break;
+			case SYMBOL_TYPE_CONSTANT:
+				if (s->relocations != NULL || s->is_entry) {
+					fprintf(state->errfile, "Constant %s is not a label\n", name);
+					return -1;
+				}
+				address = 0;
+				word = 0;
+				break;
+			default:
+				fprintf(state->errfile, "Internal error: symbol %s has an invalid type %d\n", name, (int)s->type);
+				return -1;
 			}
 
 			while (s->relocations != NULL) {
@@ -231,43 +383,73 @@ int symtab_update_relocations_and_write(symtab_t *t, assembler_state_t *state)
 				state->code[r->ic] = word; /* Update operand */
 
 				if (s->type == SYMBOL_TYPE_EXTERNAL) {
-					if (extfile == NULL) {
-						extfile = open_file_with_ext(state->filename, "ext", "w");
-						if (extfile == NULL) {
-							return -1;
-						}
+					ret = add_object_symbol(state->externs, &state->nexterns, LENGTH_MEMORY,
+											name, r->ic + ASSEMBLY_CODE_START_ADDRESS, state);
+					if (ret < 0) {
+						return ret;
 					}
-
-					to_base32(r->ic + ASSEMBLY_CODE_START_ADDRESS, base32);
-					fprintf(extfile, "%s %s\n", s->name, base32);
+				} else if (state->nrelocs < LENGTH_MEMORY) { /* Every relocation is a code word */
+					state->relocs[state->nrelocs++] = r->ic + ASSEMBLY_CODE_START_ADDRESS;
 				}
 
 				free(r);
 			}
 
 			if (s->is_entry) {
-				if (entfile == NULL) {
-					entfile = open_file_with_ext(state->filename, "ent", "w");
-					if (entfile == NULL) {
-						return -1;
-					}
+				ret = add_object_symbol(state->entries, &state->nentries, 2 * LENGTH_MEMORY,
+										name, address, state);
+				if (ret < 0) {
+					return ret;
 				}
-
-				to_base32(address, base32);
-				fprintf(entfile, "%s %s\n", s->name, base32);
 			}
-
-			free(s);
 		}
 	}
 
-	if (extfile != NULL) {
-		fclose(extfile);
-	}
-	if (entfile != NULL) {
-		fclose(entfile);
-	}
+	/* So a loader rebases the image in a single pass */
+	qsort(state->relocs, state->nrelocs, sizeof(state->relocs[0]), compare_relocs);
 	return 0;
 }
 
+/*This method checks the symbols the same way symtab_update_relocations() does, without
+ * patching the code or collecting the outputs, for --check. All the errors are reported
+ * return 0 in case of success and -1 otherwise*/
+int symtab_check(const symtab_t *t, const assembler_state_t *state)
+{
+	const instruction_t *insn;
+	const symbol_t *s;
+	int bucket, id;
+	int error_flag;
+	int i, j;
+
+	error_flag = 0;
+	for (bucket = 0; bucket < SYMBOL_HASH_SIZE; bucket++) {
+		for (id = t->buckets[bucket]; id >= 0; id = s->next) {
+			s = &t->symbols[id];
+			if (s->type == SYMBOL_TYPE_UNKNOWN) {
+				fprintf(state->errfile, "Unresolved symbol %s\n", t->names[id]);
+				error_flag = -1;
+			} else if (s->type == SYMBOL_TYPE_EXTERNAL && s->is_entry) {
+				fprintf(state->errfile, "Symbol %s cannot be both external and entry\n", t->names[id]);
+				error_flag = -1;
+			} else if (s->type == SYMBOL_TYPE_CONSTANT && (s->is_entry || s->relocations != NULL)) {
+				fprintf(state->errfile, "Constant %s is not a label\n", t->names[id]);
+				error_flag = -1;
+			}
+		}
+	}
+
+	/* The instructions are not encoded, so a constant used as a label has no relocation */
+	for (i = 0; i < state->ninstructions && i < LENGTH_MEMORY; i++) {
+		insn = &state->instructions[i];
+		for (j = 0; j < insn->n; j++) {
+			s = (insn->symbol[j] >= 0) ? &t->symbols[insn->symbol[j]] : NULL;
+			if (s != NULL && s->type == SYMBOL_TYPE_CONSTANT && !s->is_entry && s->relocations == NULL) {
+				fprintf(state->errfile, "Constant %s is not a label, line %d\n", t->names[insn->symbol[j]],
+						insn->line_number);
+				error_flag = -1;
+			}
+		}
+	}
 
+	return error_flag;
+}
@@ -10,7 +10,8 @@ typedef enum symbol_type {
 	SYMBOL_TYPE_UNKNOWN,
 	SYMBOL_TYPE_CODE,
 	SYMBOL_TYPE_DATA,
-	SYMBOL_TYPE_EXTERNAL
+	SYMBOL_TYPE_EXTERNAL,
+	SYMBOL_TYPE_CONSTANT  /* Of .equ, the index is the value */
 } symbol_type_t;
 
 
@@ -23,28 +24,50 @@ struct relocation {
 
 typedef struct symbol symbol_t;
 struct symbol {
-	char          name[MAX_LABEL_LENGTH];
 	symbol_type_t type;
     int           index; /* ic or dc */
     relocation_t  *relocations;
     int           is_entry;
-    symbol_t      *next; /* Next in hash */
+    int           next;  /* Id of the next symbol in hash, -1 at the end */
 };
 
 
-typedef symbol_t *symtab_t[SYMBOL_HASH_SIZE];
+/*The symbols of a source. Every distinct label is interned once, when the parser first
+ * sees it, and gets a dense id - the symbols, the instructions and the data blocks refer to
+ * it by id, so only the interning compares names*/
+typedef struct symtab {
+	int      buckets[SYMBOL_HASH_SIZE];  /* Id of the newest symbol of each bucket, or -1 */
+	symbol_t *symbols;                   /* By id, in the order the names were first seen */
+	char     (*names)[MAX_LABEL_LENGTH]; /* By id, apart from the symbols, which stay small */
+	int      n;
+	int      capacity;
+} symtab_t;
+
+#define symtab_symbol(t, id) (&(t)->symbols[id])
+#define symtab_name(t, id)   ((const char *)(t)->names[id])
 
 
 void symtab_init(symtab_t *t);
 
+int calc_hash(const char *name);
+
 void symtab_free(symtab_t *t);
 
 int symtab_new_label(symtab_t *t, const char *name, symbol_type_t type,
-			         int ic, int dc);
+			         int ic, int dc, const assembler_state_t *state);
+
+int symtab_new_constant(symtab_t *t, const char *name, int value, const assembler_state_t *state);
+
+int symtab_find(const symtab_t *t, const char *name);
+int symtab_new_operand(symtab_t *t, const char *name);
+int symtab_new_relocation(symbol_t *s, int ic);
+
+void symtab_remap_code(symtab_t *t, const short remap[]);
 
-int symtab_new_operand(symtab_t *t, const char *name, int ic);
+int symtab_merge(symtab_t *t, symtab_t *src, int ic_offset, int dc_offset, const assembler_state_t *state);
 
-int symtab_update_relocations_and_write(symtab_t *t, assembler_state_t *state);
+int symtab_update_relocations(symtab_t *t, assembler_state_t *state);
+int symtab_check(const symtab_t *t, const assembler_state_t *state);
 int symtab_new_entry(symtab_t *t, char *name);
 
 #endif
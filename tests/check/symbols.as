@@ -0,0 +1,11 @@
+; --check - every unresolved symbol and every external that is also an entry
+.entry MAIN
+.entry GONE
+.extern OUT
+.entry OUT
+.extern ALSO
+.entry ALSO
+MAIN:	mov MISSING, r1
+	jsr OUT
+	prn ALSO
+	stop
@@ -0,0 +1,7 @@
+; Linked after main - moved, so it is assembled with --relocatable
+.entry COUNT
+.entry TWICE
+TWICE:	add r2, r2
+	lea COUNT, r3
+	rts
+COUNT:	.data 3
@@ -0,0 +1,11 @@
+; The first module of the image - it is not moved, so it needs no relocations
+.entry MAIN
+.extern COUNT
+.extern TWICE
+MAIN:	mov COUNT, r1
+LOOP:	jsr TWICE
+	dec r1
+	bne LOOP
+	prn RESULT
+	stop
+RESULT:	.data 0
@@ -0,0 +1,4 @@
+; In the archive, but no module uses it - it is not linked
+.entry SPARE
+SPARE:	clr r1
+	rts
@@ -0,0 +1,18 @@
+; The words of a macro are mapped to the lines that use it
+mcro save
+	mov r1, SAVED
+	inc COUNT
+endmcro
+.entry MAIN
+MAIN:	mov #5, r1
+	save
+LOOP:	dec r1
+	bne LOOP
+	save
+	stop
+SAVED:	.data 0
+COUNT:	.data 0
+mcro slot
+	.data 7
+endmcro
+	slot
@@ -0,0 +1,14 @@
+; Data compaction (--compact-data) - strings pooled, unused data dropped
+.entry MAIN
+.entry KEPT
+MAIN:	lea HELLO, r1
+	lea LO, r2
+	lea AGAIN, r3
+	prn POINT
+	stop
+HELLO:	.string "hello"
+UNUSED:	.data 1, 2, 3
+LO:	.string "lo"
+AGAIN:	.string "hello"
+KEPT:	.data 9
+POINT:	.struct 4, "xy"
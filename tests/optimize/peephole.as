@@ -0,0 +1,16 @@
+; Every rule of the peephole pass (-O), and what it must keep
+.entry MAIN
+MAIN:	mov r1, r1
+	add #0, r2
+	sub #0, COUNT
+	cmp r1, r2
+	cmp r3, #4
+	bne NEXT
+NEXT:	jmp AFTER
+AFTER:	mov r2, r2
+	add #1, r2
+	cmp r1, #0
+	bne MAIN
+	prn COUNT
+	stop
+COUNT:	.data 5
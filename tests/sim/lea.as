@@ -0,0 +1,10 @@
+; lea to a register and to memory - the word gets the address of the label
+MAIN:	lea TEXT, r1
+	lea TEXT, PTR
+	prn r1
+	prn PTR
+	lea PTR, PTR
+	prn PTR
+	stop
+TEXT:	.string "ab"
+PTR:	.data 7
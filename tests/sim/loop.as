@@ -0,0 +1,15 @@
+; Prints a countdown and a sum - the same with the interpreter and the JIT
+MAIN:	mov #10, r1
+	clr r2
+LOOP:	prn r1
+	add r1, r2
+	jsr TWICE
+	dec r1
+	cmp r1, #0
+	bne LOOP
+	prn r2
+	prn TOTAL
+	stop
+TWICE:	add r2, TOTAL
+	rts
+TOTAL:	.data 0
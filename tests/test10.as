@@ -0,0 +1,19 @@
+; constants of .equ and constant expressions
+.entry MAIN
+.equ SIZE 4
+.equ TWICE SIZE*2
+.equ MASK (TWICE+SIZE)%5-1
+.equ NEG -SIZE
+; length() takes a data label defined before
+STR:	.string "hello"
+ARR:	.data SIZE, TWICE, -TWICE, SIZE*SIZE-1, 2147483647-2147483646
+	.data length(ARR)
+MAIN:	mov #SIZE, r1
+	add #TWICE-1, r1
+	prn #-(SIZE+3)*2
+	cmp #MASK, r1
+	sub #NEG/2, ARR
+	mov #length(STR), r2
+	mov #length(ARR)+length(STR), r3
+	prn #100/7*7+100%7
+	stop
@@ -0,0 +1,20 @@
+; invalid constants and expressions
+.equ SIZE 4
+.equ SIZE 5
+.equ BIG 4294967296
+.equ
+.equ NOVALUE
+	prn #UNDEF
+	prn #SIZE/0
+	prn #SIZE%0
+	prn #(SIZE+1
+	prn #SIZE+
+	prn #length(NOLABEL)
+	prn #length(MAIN)
+MAIN:	prn #2147483647+1
+	prn #-2147483647-2
+	prn #2147483647*2147483647*4
+	prn #(-2147483647-1)/-1
+A:	.data 2147483648
+B:	.data 1, SIZE*, 2
+	stop
@@ -0,0 +1,12 @@
+; .include - the lines of the file are assembled in place of the directive
+.entry MAIN
+.extern PRINT
+.include "test12.inc"
+MAIN:	mov #LIMIT, r1
+LOOP:	jsr PRINT
+	dec r1
+	cmp r1, #0
+	bne LOOP
+	lea MSG, r2
+	prn COUNT
+	stop
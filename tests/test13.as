@@ -0,0 +1,20 @@
+; Macros - a label on a use, and a macro used in another one
+.entry MAIN
+mcro swap
+	mov r1, r3
+	mov r2, r1
+	mov r3, r2
+endmcro
+mcro step
+	swap
+	inc COUNT
+endmcro
+MAIN:	mov #1, r1
+	mov #2, r2
+AGAIN:	step
+	cmp COUNT, #3
+	bne AGAIN
+	swap
+	prn COUNT
+	stop
+COUNT:	.data 0
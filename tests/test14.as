@@ -0,0 +1,10 @@
+; Errors of macros - none of them may assemble
+mcro loop
+	loop
+endmcro
+mcro extra tokens
+endmcro
+	loop
+endmcro
+mcro open
+	stop
@@ -0,0 +1,13 @@
+; fields of struct types are of their type - two types may share a name
+.entry MAIN
+.extern OWNER
+.structdef PERSON id, age
+.structdef ITEM id, name[4], price
+MAIN:	mov PER.age, r2
+	add IT.price, r2
+	cmp PER.id, IT.id
+	prn IT.name+1
+	prn OWNER.id
+	stop
+PER:	.struct PERSON 7, 30
+IT:	.struct ITEM 9, "pen", 25
@@ -0,0 +1,36 @@
+; every legal combination of addressing modes of mov and cmp
+.entry LOOP
+.entry ARR
+.extern EXT1
+LOOP:	mov #-128, ARR
+	mov #127, ST.1
+	mov #-1, r2
+	mov STR, LOOP
+	mov LOOP, ST.2
+	mov ARR, r3
+	mov ST.1, STR
+	mov ST.2, ST.1
+	mov ST.1, r4
+	mov r3, EXT1
+	mov r6, ST.2
+	mov r1, r5
+	cmp #0, #5
+	cmp #-77, EXT1
+	cmp #100, ST.2
+	cmp #33, r1
+	cmp LOOP, #-50
+	cmp ARR, EXT1
+	cmp EXT1, ST.2
+	cmp STR, r5
+	cmp ST.1, #64
+	cmp ST.2, EXT1
+	cmp ST.1, ST.2
+	cmp ST.2, r1
+	cmp r0, #1
+	cmp r3, EXT1
+	cmp r6, ST.2
+	cmp r1, r5
+	stop
+ARR:	.data 7, -8, 511, -512
+STR:	.string "ok"
+ST:	.struct -3, "x"
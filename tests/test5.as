@@ -0,0 +1,38 @@
+; every legal combination of addressing modes of add, sub and lea
+.entry LOOP
+.entry ARR
+.extern EXT1
+LOOP:	add #-9, ARR
+	add #12, ST.1
+	add #99, r2
+	add STR, LOOP
+	add LOOP, ST.2
+	add ARR, r3
+	add ST.1, STR
+	add ST.2, ST.1
+	add ST.1, r4
+	add r3, EXT1
+	add r6, ST.2
+	add r1, r5
+	sub #-100, ARR
+	sub #7, ST.1
+	sub #3, r6
+	sub STR, LOOP
+	sub LOOP, ST.2
+	sub ARR, r7
+	sub ST.1, STR
+	sub ST.2, ST.1
+	sub ST.1, r0
+	sub r7, EXT1
+	sub r2, ST.2
+	sub r5, r1
+	lea LOOP, ARR
+	lea ARR, ST.1
+	lea EXT1, r2
+	lea ST.2, LOOP
+	lea ST.1, ST.2
+	lea ST.2, r3
+	stop
+ARR:	.data 7, -8, 511, -512
+STR:	.string "ok"
+ST:	.struct -3, "x"
@@ -0,0 +1,37 @@
+; every legal addressing mode of the single and no operand instructions
+.entry LOOP
+.entry ARR
+.extern EXT1
+LOOP:	not LOOP
+	not ST.2
+	not r7
+	clr STR
+	clr ST.1
+	clr r0
+	inc EXT1
+	inc ST.2
+	inc r1
+	dec ARR
+	dec ST.1
+	dec r2
+	jmp LOOP
+	jmp ST.2
+	jmp r3
+	bne STR
+	bne ST.1
+	bne r4
+	red EXT1
+	red ST.2
+	red r5
+	prn #-3
+	prn EXT1
+	prn ST.2
+	prn r1
+	jsr ARR
+	jsr ST.1
+	jsr r2
+	rts
+	stop
+ARR:	.data 7, -8, 511, -512
+STR:	.string "ok"
+ST:	.struct -3, "x"
@@ -0,0 +1,36 @@
+; every illegal combination of addressing modes - every instruction is an error
+	mov #88, #-88
+	mov ARR, #21
+	mov ST.2, #42
+	mov r3, #-42
+	add #66, #-128
+	add ARR, #127
+	add ST.2, #-1
+	add r3, #0
+	sub #5, #-77
+	sub ARR, #100
+	sub ST.2, #33
+	sub r3, #-50
+	lea #64, #1
+	lea #-9, EXT1
+	lea #12, ST.1
+	lea #99, r7
+	lea ARR, #-100
+	lea ST.2, #7
+	lea r3, #3
+	lea r3, EXT1
+	lea r3, ST.1
+	lea r3, r7
+	not #-3
+	clr #88
+	inc #-88
+	dec #21
+	jmp #42
+	bne #-42
+	red #66
+	jsr #-128
+LOOP:	stop
+ARR:	.data 1
+STR:	.string "ok"
+ST:	.struct 1, "x"
+.extern EXT1
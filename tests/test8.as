@@ -0,0 +1,22 @@
+; struct types of .structdef and their fields
+.entry MAIN
+.entry EMP
+.extern BOSS
+.equ NAMELEN 6
+.structdef PERSON id, name[NAMELEN], age
+.structdef PAIR first, second
+MAIN:	mov EMP.age, r2
+	add #PERSON, r2
+	mov EMP.name, BOSS.id
+	prn EMP.name+2
+	cmp BOSS.age, EMP.id
+	lea PR.second, r1
+	inc PR.first
+	mov ST.2, ST.1
+	prn EMP.8
+	stop
+EMP:	.struct PERSON 7, "bob", 30
+	.struct PERSON 8
+PR:	.struct PAIR -1, length(EMP)
+ST:	.struct 5, "ab"
+REC:	.struct 1, 2, "x", NAMELEN
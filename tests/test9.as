@@ -0,0 +1,22 @@
+; invalid struct types and fields
+.structdef PT x, y, tag[4]
+.structdef
+.structdef Q a, a
+.structdef R b[0]
+.structdef S c[3
+.structdef PT z
+A:	.struct PT 1, 2, "toolong"
+B:	.struct PT 1, "s"
+C:	.struct PT 1, 2, "ab", 4
+D:	.struct
+.structdef PAIR first, second
+E:	.struct PAIR 1, 2
+G:	.struct PT 1, 2, "ab"
+	prn A.0
+	prn A.w
+	prn A.256
+	prn A.x.y
+	prn E.x
+	prn E.3
+	prn G.first
+	stop
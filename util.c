@@ -3,6 +3,7 @@
 #include "assembler.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 /*This method opens a file and returns a pointer to it
  * if failed to open it returns null*/
@@ -20,6 +21,33 @@ FILE *open_file_with_ext(const char *filename, const char *ext, const char *mode
 	}
 	return f;
 }
+/*This method reads the next line of a memory buffer into line, exactly as fgets() would
+ * read it from a file - at most size-1 characters, up to and including '\n'
+ * returns 1 if a line was read and 0 at the end of the buffer*/
+int get_line(char *line, int size, const char *buf, long len, long *pos)
+{
+	const char *nl;
+	long n;
+
+	if (*pos >= len) {
+		return 0;
+	}
+
+	n = len - *pos;
+	if (n > size - 1) {
+		n = size - 1;
+	}
+	nl = memchr(buf + *pos, '\n', n);
+	if (nl != NULL) {
+		n = nl - (buf + *pos) + 1;
+	}
+
+	memcpy(line, buf + *pos, n);
+	line[n] = '\0';
+	*pos += n;
+	return 1;
+}
+
 /*This method converts a number to special base 32*/
 void to_base32(int x, char *str)
 {
@@ -30,6 +58,24 @@ void to_base32(int x, char *str)
 	str[2] = '\0';
 }
 
+/*This method reads a number written by to_base32()
+ * returns the number or -1 if str is not 2 base32 digits*/
+int from_base32(const char *str)
+{
+	const char base32[]="!@#$%^&*<>abcdefghijklmnopqrstuv";
+	const char *hi, *lo;
+
+	if (str[0] == '\0' || str[1] == '\0') {
+		return -1;
+	}
+	hi = strchr(base32, str[0]);
+	lo = strchr(base32, str[1]);
+	if (hi == NULL || lo == NULL) {
+		return -1;
+	}
+	return (hi - base32) * 32 + (lo - base32);
+}
+
 /*My version of atoi that handle errors*/
 int my_atoi(assembler_state_t *state, char *number_str, int *number)
 {
@@ -39,9 +85,27 @@ int my_atoi(assembler_state_t *state, char *number_str, int *number)
 
 	/* check if all string is converted */
 	if ((*endptr != '\0') || (endptr == number_str)) {
-		fprintf(stderr, "Invalid numeric value, line %d\n", state->line_number);
+		fprintf(state->errfile, "Invalid numeric value, line %d\n", state->line_number);
 		return -1; /* Failed */
 	} else{
 		return 0; /* Success */
 	}
 }
+
+/*This method returns the number of words an instruction takes*/
+int instruction_size(const instruction_t *insn)
+{
+	int size;
+	int i;
+
+	/* Special case - 2 registers share a single word */
+	if (insn->n == 2 && insn->type[0] == ADDR_REGISTER && insn->type[1] == ADDR_REGISTER) {
+		return 2;
+	}
+
+	size = 1;
+	for (i = 0; i < insn->n; i++) {
+		size += (insn->type[i] == ADDR_STRUCT) ? 2 : 1;
+	}
+	return size;
+}
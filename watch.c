@@ -0,0 +1,459 @@
+#include "watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO) /*Saved in place, or renamed over by an editor*/
+
+/*A watched source - found by the watch of its directory and its file name*/
+typedef struct watch_entry {
+	int        wd;
+	const char *base; /* File name without .as, points into the job name */
+	int        job;   /* -1 for an empty entry */
+} watch_entry_t;
+
+/*A file a source included - found by the watch of its directory and its file name*/
+typedef struct watch_include {
+	int  wd;
+	char name[MAX_PATH];
+	int  job;
+} watch_include_t;
+
+typedef struct watch_state {
+	job_list_t      *jobs;
+	int             fd;        /* inotify instance */
+	watch_entry_t   *table;    /* Open addressing hash of the sources */
+	int             size;      /* A power of 2 */
+	int             count;
+	int             *dir_wds;  /* Watches of the directories given as arguments */
+	watch_include_t *includes; /* Of all the sources */
+	int             nincludes;
+	int             includes_capacity;
+	char            *dirty;    /* Per job - changed since the last rebuild */
+	int             *pending;  /* The changed jobs, in the order they changed */
+	int             npending;
+	int             capacity;  /* Of dirty and pending */
+	struct timespec last_change;
+} watch_state_t;
+
+/*This method returns the milliseconds passed between two times*/
+double elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000.0 + (to->tv_nsec - from->tv_nsec) / 1000000.0;
+}
+
+/*This method forms the hash value of a watched source, same as calc_hash()*/
+unsigned watch_hash(int wd, const char *base, int len)
+{
+	unsigned hashval;
+	int i;
+
+	hashval = wd;
+	for (i = 0; i < len; i++) {
+		hashval = base[i] + 31 * hashval;
+	}
+	return hashval;
+}
+
+/*This method finds the job of a file in a watched directory
+ * returns the job index or -1 if the file is not watched*/
+int watch_find(watch_state_t *w, int wd, const char *base, int len)
+{
+	watch_entry_t *e;
+	unsigned i;
+
+	for (i = watch_hash(wd, base, len) & (w->size - 1); ; i = (i + 1) & (w->size - 1)) {
+		e = &w->table[i];
+		if (e->job < 0) {
+			return -1;
+		}
+		if (e->wd == wd && strncmp(e->base, base, len) == 0 && e->base[len] == '\0') {
+			return e->job;
+		}
+	}
+}
+
+/*This method adds a source to the hash, growing it when it gets half full
+ * returns 0 in case of success and -1 otherwise*/
+int watch_insert(watch_state_t *w, int wd, const char *base, int job)
+{
+	watch_entry_t *old, *e;
+	int old_size, i;
+	unsigned j;
+
+	if (2 * (w->count + 1) > w->size) {
+		old = w->table;
+		old_size = w->size;
+
+		w->size = (old_size == 0) ? 64 : 2 * old_size;
+		w->table = malloc(w->size * sizeof(*w->table));
+		if (w->table == NULL) {
+			fprintf(stderr, "Failed to allocate watch table\n");
+			w->table = old;
+			w->size = old_size;
+			return -1;
+		}
+		for (i = 0; i < w->size; i++) {
+			w->table[i].job = -1;
+		}
+
+		w->count = 0;
+		for (i = 0; i < old_size; i++) {
+			if (old[i].job >= 0) {
+				watch_insert(w, old[i].wd, old[i].base, old[i].job);
+			}
+		}
+		free(old);
+	}
+
+	for (j = watch_hash(wd, base, strlen(base)) & (w->size - 1); w->table[j].job >= 0; j = (j + 1) & (w->size - 1))
+		;
+	e = &w->table[j];
+	e->wd = wd;
+	e->base = base;
+	e->job = job;
+	w->count++;
+	return 0;
+}
+
+/*This method makes sure the dirty flags cover all the jobs
+ * returns 0 in case of success and -1 otherwise*/
+int watch_grow(watch_state_t *w)
+{
+	char *dirty;
+	int *pending;
+	int capacity;
+
+	if (w->jobs->n <= w->capacity) {
+		return 0;
+	}
+
+	capacity = 2 * w->jobs->n;
+	dirty = realloc(w->dirty, capacity);
+	if (dirty != NULL) {
+		w->dirty = dirty;
+	}
+	pending = realloc(w->pending, capacity * sizeof(*pending));
+	if (pending != NULL) {
+		w->pending = pending;
+	}
+	if (dirty == NULL || pending == NULL) {
+		fprintf(stderr, "Failed to allocate watch table\n");
+		return -1;
+	}
+
+	memset(w->dirty + w->capacity, 0, capacity - w->capacity);
+	w->capacity = capacity;
+	return 0;
+}
+
+/*This method watches the directory of a file, and finds the name of the file in it
+ * returns the watch of the directory or -1 in case of failure*/
+int watch_directory(watch_state_t *w, const char *name, const char **basep)
+{
+	char dir[MAX_PATH];
+	const char *base;
+	int wd;
+
+	base = strrchr(name, '/');
+	if (base == NULL) {
+		strcpy(dir, ".");
+		base = name;
+	} else {
+		sprintf(dir, "%.*s", (int)(base - name), name);
+		if (dir[0] == '\0') {
+			strcpy(dir, "/");
+		}
+		base++;
+	}
+
+	/* The same directory always gets the same watch */
+	wd = inotify_add_watch(w->fd, dir, WATCH_EVENTS);
+	if (wd < 0) {
+		fprintf(stderr, "Cannot watch directory %s\n", dir);
+		return -1;
+	}
+
+	*basep = base;
+	return wd;
+}
+
+/*This method watches the directory of a job, and adds the job to the hash
+ * returns 0 in case of success and -1 otherwise*/
+int watch_job(watch_state_t *w, int job)
+{
+	const char *base;
+	int wd;
+
+	wd = watch_directory(w, w->jobs->jobs[job].name, &base);
+	if (wd < 0) {
+		return -1;
+	}
+
+	return watch_insert(w, wd, base, job);
+}
+
+/*This method watches the files a job included when it was last assembled, instead of
+ * the ones it included before
+ * returns 0 in case of success and -1 otherwise*/
+int watch_includes(watch_state_t *w, int job)
+{
+	const include_dep_t *d;
+	watch_include_t *includes;
+	const char *base;
+	int i, n, wd;
+
+	n = 0;
+	for (i = 0; i < w->nincludes; i++) {
+		if (w->includes[i].job != job) {
+			w->includes[n++] = w->includes[i];
+		}
+	}
+	w->nincludes = n;
+
+	for (d = w->jobs->jobs[job].includes; d != NULL; d = d->next) {
+		if (w->nincludes == w->includes_capacity) {
+			n = (w->includes_capacity == 0) ? 16 : 2 * w->includes_capacity;
+			includes = realloc(w->includes, n * sizeof(*includes));
+			if (includes == NULL) {
+				fprintf(stderr, "Failed to allocate watch table\n");
+				return -1;
+			}
+			w->includes = includes;
+			w->includes_capacity = n;
+		}
+
+		wd = watch_directory(w, d->path, &base);
+		if (wd < 0) {
+			return -1;
+		}
+		w->includes[w->nincludes].wd = wd;
+		strcpy(w->includes[w->nincludes].name, base);
+		w->includes[w->nincludes].job = job;
+		w->nincludes++;
+	}
+	return 0;
+}
+
+/*This method marks a job to be assembled again in the next rebuild*/
+void watch_mark(watch_state_t *w, int job)
+{
+	if (!w->dirty[job]) {
+		w->dirty[job] = 1;
+		w->pending[w->npending++] = job;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &w->last_change);
+}
+
+/*This method handles a change of a file in a watched directory. The sources that
+ * include the file are assembled again, and a new .as file in a directory given as an
+ * argument becomes a new job
+ * returns 0 in case of success and -1 otherwise*/
+int watch_change(watch_state_t *w, const struct inotify_event *event)
+{
+	char name[MAX_PATH];
+	int len, job, i;
+
+	for (i = 0; i < w->nincludes; i++) {
+		if (w->includes[i].wd == event->wd && strcmp(w->includes[i].name, event->name) == 0) {
+			watch_mark(w, w->includes[i].job);
+		}
+	}
+
+	len = strlen(event->name);
+	if (len <= 3 || strcmp(event->name + len - 3, ".as") != 0) {
+		return 0;
+	}
+	len -= 3;
+
+	job = watch_find(w, event->wd, event->name, len);
+	if (job < 0) {
+		for (i = 0; i < w->jobs->ndirs && w->dir_wds[i] != event->wd; i++)
+			;
+		if (i == w->jobs->ndirs || strlen(w->jobs->dirs[i]) + len + 2 > MAX_PATH) {
+			return 0;
+		}
+
+		sprintf(name, "%s/%.*s", w->jobs->dirs[i], len, event->name);
+		if (jobs_add(w->jobs, name, NULL) < 0 || watch_grow(w) < 0) {
+			return -1;
+		}
+		job = w->jobs->n - 1;
+		if (watch_job(w, job) < 0) {
+			return -1;
+		}
+	}
+
+	watch_mark(w, job);
+	return 0;
+}
+
+/*This method assembles again all the files that changed, and reports how long it took*/
+void watch_rebuild(watch_state_t *w, io_ctx_t *io, const assembler_options_t *options)
+{
+	struct timespec start, file_start, end;
+	io_request_t *sources;
+	job_t *job;
+	int failed;
+	int ret;
+	int i;
+
+	sources = calloc(w->npending, sizeof(*sources));
+	if (sources == NULL) {
+		fprintf(stderr, "Failed to allocate file list\n");
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < w->npending; i++) {
+		io_submit_read(io, w->jobs->jobs[w->pending[i]].name, "as", &sources[i]);
+	}
+	io_kick(io);
+
+	failed = 0;
+	for (i = 0; i < w->npending; i++) {
+		job = &w->jobs->jobs[w->pending[i]];
+		w->dirty[w->pending[i]] = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &file_start);
+		ret = assemble_one_file(job->outname, options, io, &sources[i], &job->includes);
+		io_release(io, &sources[i]);
+		watch_includes(w, w->pending[i]);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		printf("%s: %s in %.3f ms\n", job->name, (ret < 0) ? "failed" : "assembled",
+			   elapsed_ms(&file_start, &end));
+		if (ret < 0) {
+			failed++;
+		}
+	}
+
+	if (io_flush(io) < 0) {
+		failed++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("Rebuilt %d file(s), %d failed, in %.3f ms - %.3f ms after the last change\n",
+		   w->npending, failed, elapsed_ms(&start, &end), elapsed_ms(&w->last_change, &end));
+	fflush(stdout);
+
+	w->npending = 0;
+	free(sources);
+}
+
+/*This method keeps watching the sources, and assembles again every source that is saved.
+ * Saves that come quickly one after the other are collected into a single rebuild.
+ * It only returns in case of failure
+ * returns -1*/
+int watch_files(job_list_t *jobs, const assembler_options_t *options)
+{
+	union {
+		struct inotify_event event;
+		char                 buf[4096];
+	} events;
+	const struct inotify_event *event;
+	struct pollfd pfd;
+	watch_state_t w;
+	io_ctx_t io;
+	ssize_t len;
+	char *p;
+	int ret;
+	int i;
+
+	memset(&w, 0, sizeof(w));
+	w.jobs = jobs;
+	w.fd = inotify_init();
+	if (w.fd < 0) {
+		fprintf(stderr, "Cannot start watching files\n");
+		return -1;
+	}
+
+	ret = watch_grow(&w);
+	for (i = 0; ret == 0 && i < jobs->n; i++) {
+		ret = watch_job(&w, i);
+		if (ret == 0) {
+			ret = watch_includes(&w, i);
+		}
+	}
+
+	w.dir_wds = malloc((jobs->ndirs + 1) * sizeof(*w.dir_wds));
+	if (w.dir_wds == NULL) {
+		ret = -1;
+	}
+	for (i = 0; ret == 0 && i < jobs->ndirs; i++) {
+		w.dir_wds[i] = inotify_add_watch(w.fd, jobs->dirs[i], WATCH_EVENTS);
+		if (w.dir_wds[i] < 0) {
+			fprintf(stderr, "Cannot watch directory %s\n", jobs->dirs[i]);
+			ret = -1;
+		}
+	}
+
+	io_init(&io, 2 * options->io_depth, options->use_uring);
+
+	if (ret == 0) {
+		printf("Watching %d file(s)\n", jobs->n);
+		fflush(stdout);
+	}
+
+	pfd.fd = w.fd;
+	pfd.events = POLLIN;
+	while (ret == 0) {
+		/* Wait for a change, or for the changes to settle */
+		ret = poll(&pfd, 1, (w.npending > 0) ? WATCH_SETTLE_MS : -1);
+		if (ret < 0) {
+			ret = (errno == EINTR) ? 0 : -1;
+			continue;
+		}
+		if (ret == 0) {
+			watch_rebuild(&w, &io, options);
+			continue;
+		}
+
+		len = read(w.fd, events.buf, sizeof(events.buf));
+		if (len < 0) {
+			ret = (errno == EINTR) ? 0 : -1;
+			continue;
+		}
+
+		ret = 0;
+		for (p = events.buf; ret == 0 && p < events.buf + len; p += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)p;
+			if (event->len > 0) {
+				ret = watch_change(&w, event);
+			}
+		}
+	}
+
+	fprintf(stderr, "Stopped watching files\n");
+
+	io_flush(&io);
+	io_cleanup(&io);
+	close(w.fd);
+	free(w.table);
+	free(w.dir_wds);
+	free(w.includes);
+	free(w.dirty);
+	free(w.pending);
+	return -1;
+}
+
+#else
+
+/*Watching needs inotify*/
+int watch_files(job_list_t *jobs, const assembler_options_t *options)
+{
+	fprintf(stderr, "Watch mode is not supported on this system\n");
+	return -1;
+}
+
+#endif
@@ -0,0 +1,12 @@
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "assembler.h"
+#include "jobs.h"
+
+#define WATCH_SETTLE_MS 20 /*Changes closer than this to each other are rebuilt together*/
+
+int watch_files(job_list_t *jobs, const assembler_options_t *options);
+
+#endif